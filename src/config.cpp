@@ -25,11 +25,14 @@
 
 #include <fstream>
 
+#include "timestamp_parser.h"
+
 #include "utils/file_helpers.h"
 
 Config::Config() :
 	m_findThreads(1),
 	m_grepThreads(1),
+	m_chunkedFileMinSize(256),
 	m_printProgressWhenOutToStdOut(true),
 	m_directoryRecursionDepth(10),
 	m_ignoreHiddenFiles(true),
@@ -38,6 +41,7 @@ Config::Config() :
 	m_preEmptiveSkipping(true),
 	m_matchCount(-1),
 	m_flushOutput(true),
+	m_unorderedOutput(false),
 	m_outputFilename(true),
 	m_outputRelativeFilename(false),
 	m_outputContentLines(true),
@@ -48,8 +52,18 @@ Config::Config() :
 	m_blankLinesBetweenFiles(true),
 	m_matchItemOrSeperatorChar('|'),
 	m_matchItemAndSeperatorChar('&'),
+	m_countAllOccurrences(false),
+	m_regexSearch(false),
+	m_caseInsensitive(false),
 	m_logTimestampFormat("[%ts%]"),
-	m_fileReadBufferSize(32)
+	m_fileReadBufferSize(256),
+	m_memoryMapFiles(true),
+	m_ioUringQueueDepth(0),
+	m_prefetchFiles(4),
+	m_readBufferMemoryLimit(0),
+	m_readBufferHugePages(false),
+	m_followPollInterval(2),
+	m_followRescanInterval(60)
 {
 
 }
@@ -129,6 +143,11 @@ Config::ParseResult Config::parseArgs(int argc, char** argv, int startOptionArg,
 		{
 			return eParseHelpWanted;
 		}
+		else if (argString == "--unordered")
+		{
+			// short-hand for --unorderedOutput=1
+			m_unorderedOutput = true;
+		}
 		else if (argString.size() > 4 && argString.substr(0, 2) == "--")
 		{
 			// handle full options
@@ -227,11 +246,24 @@ Config::ParseResult Config::parseArgs(int argc, char** argv, int startOptionArg,
 			i++;
 			lastProcessedArg ++;
 		}
+		else if (argString == "-co")
+		{
+			m_countAllOccurrences = true;
+		}
+		else if (argString == "-E")
+		{
+			m_regexSearch = true;
+		}
+		else if (argString == "-i")
+		{
+			m_caseInsensitive = true;
+		}
 		else if (argString == "-sc")
 		{
 			std::string nextArg(argv[i + 1]);
 			
-			m_shortCircuitString = nextArg;
+			// can be given multiple times
+			m_shortCircuitStrings.emplace_back(nextArg);
 			
 			i++;			
 			lastProcessedArg ++;
@@ -261,7 +293,8 @@ void Config::printFullOptions() const
 	fprintf(stderr, "\nFull options: (specify with --<option>=<value> or in sniffle.conf file):\n");
 	fprintf(stderr, "(showing defaults):\n");
 	fprintf(stderr, "findThreads:\t\t\t%u: \n", m_findThreads);
-//	fprintf(stderr, "grepThreads:\t\t\t%u: \n", m_grepThreads);
+	fprintf(stderr, "grepThreads:\t\t\t%u: \n", m_grepThreads);
+	fprintf(stderr, "chunkedFileMinSize:\t\t%u (MB):\tWith multiple grep threads, process files this size or larger in parallel chunks (0 to disable).\n", m_chunkedFileMinSize);
 	fprintf(stderr, "printProgressWhenOutToStdOut:\t%i:\n", m_printProgressWhenOutToStdOut);
 	fprintf(stderr, "directoryRecursionDepth:\t%i:\n", m_directoryRecursionDepth);
 	fprintf(stderr, "ignoreHiddenFiles:\t\t%i:\n", m_ignoreHiddenFiles);
@@ -270,6 +303,7 @@ void Config::printFullOptions() const
 	fprintf(stderr, "preEmptiveSkipping:\t\t%i:\n", m_preEmptiveSkipping);
 	fprintf(stderr, "matchCount:\t\t\t%i:\n", m_matchCount);
 	fprintf(stderr, "flushOutput:\t\t\t%i:\n", m_flushOutput);
+	fprintf(stderr, "unorderedOutput:\t\t%i:\t\tWith multiple grep threads, output files as they finish, rather than in order.\n", m_unorderedOutput);
 	fprintf(stderr, "outputFilename:\t\t\t%i:\t\tOutput the filename before matched results within file.\n", m_outputFilename);
 	fprintf(stderr, "outputRelativeFilename:\t\t%i:\t\n", m_outputRelativeFilename);
 	fprintf(stderr, "outputContentLines:\t\t%i:\n", m_outputContentLines);
@@ -277,12 +311,28 @@ void Config::printFullOptions() const
 	fprintf(stderr, "blankLinesBetweenFiles:\t\t%i:\n", m_blankLinesBetweenFiles);
 	fprintf(stderr, "matchItemOrSeperatorChar:\t'%c' :\n", m_matchItemOrSeperatorChar);
 	fprintf(stderr, "matchItemAndSeperatorChar:\t'%c' :\n", m_matchItemAndSeperatorChar);
-	fprintf(stderr, "shortCircuitString:\t\t'%s' :\n", m_shortCircuitString.c_str());
+	fprintf(stderr, "countAllOccurrences:\t\t%i:\t\tCount all occurrences in count mode, rather than matching lines.\n", m_countAllOccurrences);
+	fprintf(stderr, "regexSearch:\t\t\t%i:\t\tSearch strings (and match items) are regular expressions.\n", m_regexSearch);
+	fprintf(stderr, "caseInsensitive:\t\t%i:\t\tSearch strings (and match items) match either case of (ASCII) letters.\n", m_caseInsensitive);
+	std::string shortCircuitStrings;
+	for (const std::string& shortCircuitString : m_shortCircuitStrings)
+	{
+		shortCircuitStrings += shortCircuitStrings.empty() ? "'" : " '";
+		shortCircuitStrings += shortCircuitString + "'";
+	}
+	fprintf(stderr, "shortCircuitString:\t\t%s :\tCan be specified multiple times.\n", shortCircuitStrings.empty() ? "''" : shortCircuitStrings.c_str());
 	fprintf(stderr, "context:\t\t\t\t\tContent lines to print either side of match.\n");
 	fprintf(stderr, "after-context:\t\t\t%u:\t\tContent lines to print after match.\n", m_afterLines);
 	fprintf(stderr, "before-context:\t\t\t%u:\t\tContent lines to print before match.\n", m_beforeLines);
-	fprintf(stderr, "logTimestampFormat:\t\t'%s':\tFormat of log timestamp at beginning of lines.\n", m_logTimestampFormat.c_str());
+	fprintf(stderr, "logTimestampFormat:\t\t'%s':\tFormat of log timestamps at the start of lines (see README).\n", m_logTimestampFormat.c_str());
 	fprintf(stderr, "fileReadBufferSize:\t\t%u (KB):\tBuffer size (in KB) to use for reading files.\n", m_fileReadBufferSize);
+	fprintf(stderr, "memoryMapFiles:\t\t\t%i:\t\tMemory map files larger than the buffer size on local file systems, rather than reading them (files truncated while mapped are treated as ending there).\n", m_memoryMapFiles);
+	fprintf(stderr, "ioUringQueueDepth:\t\t%u:\t\tIf non-zero, read files larger than the read buffer which aren't memory mapped with io_uring, with this many reads of the current file in flight per grep thread.\n", m_ioUringQueueDepth);
+	fprintf(stderr, "prefetchFiles:\t\t\t%u:\t\tNumber of files to open and start reading in ahead of them being processed (0 to disable).\n", m_prefetchFiles);
+	fprintf(stderr, "readBufferMemoryLimit:\t\t%u (MB):\tLimit on the memory used by all the read buffers together (including io_uring buffers), with threads waiting for a buffer beyond it (0 for no limit).\n", m_readBufferMemoryLimit);
+	fprintf(stderr, "readBufferHugePages:\t\t%i:\t\tAllocate read buffers in 2 MB slabs which can use transparent huge pages.\n", m_readBufferHugePages);
+	fprintf(stderr, "followPollInterval:\t\t%u (s):\tIn follow mode, how often to check files which can't be watched (e.g. on NFS).\n", m_followPollInterval);
+	fprintf(stderr, "followRescanInterval:\t\t%u (s):\tIn follow mode, how often to look for new files.\n", m_followRescanInterval);
 }
 
 // for config file
@@ -327,6 +377,11 @@ bool Config::applyKeyValueSetting(const std::string& key, const std::string& val
 		unsigned int intValue = atoi(value.c_str());
 		m_grepThreads = intValue;
 	}
+	else if (key == "chunkedFileMinSize")
+	{
+		unsigned int intValue = atoi(value.c_str());
+		m_chunkedFileMinSize = intValue;
+	}
 	else if (key == "printProgressWhenOutToStdOut")
 	{
 		m_printProgressWhenOutToStdOut = getBooleanValueFromString(value);
@@ -360,6 +415,10 @@ bool Config::applyKeyValueSetting(const std::string& key, const std::string& val
 	{
 		m_flushOutput = getBooleanValueFromString(value);
 	}
+	else if (key == "unorderedOutput")
+	{
+		m_unorderedOutput = getBooleanValueFromString(value);
+	}
 	else if (key == "outputFilename")
 	{
 		m_outputFilename = getBooleanValueFromString(value);
@@ -394,11 +453,23 @@ bool Config::applyKeyValueSetting(const std::string& key, const std::string& val
 			m_matchItemAndSeperatorChar = value[0];
 		}
 	}
+	else if (key == "countAllOccurrences")
+	{
+		m_countAllOccurrences = getBooleanValueFromString(value);
+	}
+	else if (key == "regexSearch")
+	{
+		m_regexSearch = getBooleanValueFromString(value);
+	}
+	else if (key == "caseInsensitive")
+	{
+		m_caseInsensitive = getBooleanValueFromString(value);
+	}
 	else if (key == "shortCircuitString")
 	{
 		if (!value.empty())
 		{
-			m_shortCircuitString = value;
+			m_shortCircuitStrings.emplace_back(value);
 		}
 	}
 	else if (key == "context")
@@ -423,9 +494,11 @@ bool Config::applyKeyValueSetting(const std::string& key, const std::string& val
 		{
 			m_logTimestampFormat = value;
 			
-			if (m_logTimestampFormat.find("%ts%") == std::string::npos)
+			TimestampParser timestampParser;
+			std::string errorMessage;
+			if (!timestampParser.init(m_logTimestampFormat, errorMessage))
 			{
-				fprintf(stderr, "Invalid logTimestampFormat specified. Ignoring and using default.\n");
+				fprintf(stderr, "Invalid logTimestampFormat specified: %s Ignoring and using default.\n", errorMessage.c_str());
 				m_logTimestampFormat = "[%ts%]";
 				return false;
 			}
@@ -436,6 +509,39 @@ bool Config::applyKeyValueSetting(const std::string& key, const std::string& val
 		unsigned int intValue = atoi(value.c_str());
 		m_fileReadBufferSize = intValue;
 	}
+	else if (key == "memoryMapFiles")
+	{
+		m_memoryMapFiles = getBooleanValueFromString(value);
+	}
+	else if (key == "ioUringQueueDepth")
+	{
+		unsigned int intValue = atoi(value.c_str());
+		m_ioUringQueueDepth = intValue;
+	}
+	else if (key == "prefetchFiles")
+	{
+		unsigned int intValue = atoi(value.c_str());
+		m_prefetchFiles = intValue;
+	}
+	else if (key == "readBufferMemoryLimit")
+	{
+		unsigned int intValue = atoi(value.c_str());
+		m_readBufferMemoryLimit = intValue;
+	}
+	else if (key == "readBufferHugePages")
+	{
+		m_readBufferHugePages = getBooleanValueFromString(value);
+	}
+	else if (key == "followPollInterval")
+	{
+		unsigned int intValue = atoi(value.c_str());
+		m_followPollInterval = intValue;
+	}
+	else if (key == "followRescanInterval")
+	{
+		unsigned int intValue = atoi(value.c_str());
+		m_followRescanInterval = intValue;
+	}
 	else
 	{
 		return false;
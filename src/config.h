@@ -20,6 +20,7 @@
 #define CONFIG_H
 
 #include <string>
+#include <vector>
 
 class Config
 {
@@ -51,6 +52,11 @@ public:
 		return m_grepThreads;
 	}
 
+	unsigned int getChunkedFileMinSize() const
+	{
+		return m_chunkedFileMinSize;
+	}
+
 	bool getPrintProgressWhenOutToStdOut() const
 	{
 		return m_printProgressWhenOutToStdOut;
@@ -91,6 +97,11 @@ public:
 		return m_flushOutput;
 	}
 
+	bool getUnorderedOutput() const
+	{
+		return m_unorderedOutput;
+	}
+
 	bool getOutputFilename() const
 	{
 		return m_outputFilename;
@@ -136,9 +147,24 @@ public:
 		return m_matchItemAndSeperatorChar;
 	}
 	
-	const std::string& getShortCircuitString() const
+	bool getCountAllOccurrences() const
 	{
-		return m_shortCircuitString;
+		return m_countAllOccurrences;
+	}
+
+	bool getRegexSearch() const
+	{
+		return m_regexSearch;
+	}
+
+	bool getCaseInsensitive() const
+	{
+		return m_caseInsensitive;
+	}
+
+	const std::vector<std::string>& getShortCircuitStrings() const
+	{
+		return m_shortCircuitStrings;
 	}
 	
 	const std::string& getLogTimestampFormat() const
@@ -151,6 +177,47 @@ public:
 		return m_fileReadBufferSize;
 	}
 
+	bool getMemoryMapFiles() const
+	{
+		return m_memoryMapFiles;
+	}
+
+	unsigned int getIoUringQueueDepth() const
+	{
+		return m_ioUringQueueDepth;
+	}
+
+	unsigned int getPrefetchFiles() const
+	{
+		return m_prefetchFiles;
+	}
+
+	unsigned int getReadBufferMemoryLimit() const
+	{
+		return m_readBufferMemoryLimit;
+	}
+
+	bool getReadBufferHugePages() const
+	{
+		return m_readBufferHugePages;
+	}
+
+	unsigned int getFollowPollInterval() const
+	{
+		return m_followPollInterval;
+	}
+
+	unsigned int getFollowRescanInterval() const
+	{
+		return m_followRescanInterval;
+	}
+
+	// for modes which can't support everything
+	void setOutputLineNumbers(bool outputLineNumbers)
+	{
+		m_outputLineNumbers = outputLineNumbers;
+	}
+
 	void printFullOptions() const;
 
 private:
@@ -171,6 +238,7 @@ private:
 
 	unsigned int	m_findThreads;
 	unsigned int	m_grepThreads;
+	unsigned int	m_chunkedFileMinSize; // with multiple grep threads, files at least this size (in MB) are processed in parallel chunks
 
 	bool			m_printProgressWhenOutToStdOut; // if we think stdout is not a tty (so being piped), print progress via stderr
 
@@ -186,6 +254,7 @@ private:
 	int				m_matchCount;
 
 	bool			m_flushOutput; // flush output after each atomic print item (i.e. file)
+	bool			m_unorderedOutput; // when processing files in parallel, output files as they finish, rather than in order
 
 	bool			m_outputFilename; // TODO: relative / absolute options as well?
 	bool			m_outputRelativeFilename; // TODO: for the moment, do relative this way, but...
@@ -203,11 +272,25 @@ private:
 	char			m_matchItemOrSeperatorChar; //
 	char			m_matchItemAndSeperatorChar; //
 
+	bool			m_countAllOccurrences; // in count mode, count every occurrence rather than the number of matching lines
+
+	bool			m_regexSearch; // grep, count and match strings are regular expressions
+
+	bool			m_caseInsensitive; // grep, count and match strings match either case of ASCII letters
+
 	std::string		m_logTimestampFormat;
 	
-	unsigned int	m_fileReadBufferSize; // buffer size to use for fstream backing (in KB)
+	unsigned int	m_fileReadBufferSize; // block size to use for reading files (in KB)
+	bool			m_memoryMapFiles; // memory map files on local file systems, rather than reading them
+	unsigned int	m_ioUringQueueDepth; // if non-zero, read files with io_uring, with this many reads in flight per grep thread
+	unsigned int	m_prefetchFiles; // how many files to open (and start reading) ahead of them being processed
+	unsigned int	m_readBufferMemoryLimit; // in MB, for all the read buffers together, 0 for no limit
+	bool			m_readBufferHugePages; // allocate read buffers in huge page sized slabs
+
+	unsigned int	m_followPollInterval; // in follow mode, how often to check files inotify can't watch (in seconds)
+	unsigned int	m_followRescanInterval; // in follow mode, how often to look for new files (in seconds)
 	
-	std::string		m_shortCircuitString;
+	std::vector<std::string>	m_shortCircuitStrings; // processing of a file stops after the first line containing any of these
 
 //	std::string		m_outputToFile; // if non-empty, write output to this file
 };
@@ -0,0 +1,722 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "file_content_processor.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utils/system_helpers.h"
+
+#include "config.h"
+
+// how many files can be in progress or waiting to be output at once for each thread
+static const unsigned int kOutputWindowFilesPerThread = 4;
+
+// large files are processed in chunks of roughly this size (they're extended to the next line boundary)
+static const uint64_t kFileChunkSize = 32 * 1024 * 1024;
+// how many chunks of a file can be processed ahead of the ones which have been combined, per thread,
+// which bounds the amount of memory used for chunk results waiting to be combined
+static const unsigned int kMaxChunksAheadPerThread = 2;
+
+// how often to print progress while files are still being found
+static const size_t kProgressFileCountInterval = 100;
+
+FileContentProcessor::FileContentProcessor(const Config& config) : m_config(config),
+	m_operation(eOperationGrep),
+	m_timeDeltaMicroseconds(0),
+	m_timeWindow(false),
+	m_timeWindowStart(0),
+	m_timeWindowEnd(0),
+	m_outputMerger(config),
+	m_pFoundFileQueue(nullptr),
+	m_prefetchLength(0),
+	m_processFilesInChunks(false),
+	m_chunkedFileMinSize(0),
+	m_maxChunksAhead(0),
+	m_numThreads(0),
+	m_threadsOutOfFiles(0),
+	m_foundCount(0),
+	m_printProgress(false),
+	m_progressDescription(""),
+	m_fileCount(0),
+	m_lastPercentage(101)
+{
+	// each thread gets its own grepper, as they have their own read and before lines buffers
+	unsigned int numGreppers = std::max(m_config.getGrepThreads(), 1u);
+	for (unsigned int i = 0; i < numGreppers; i++)
+	{
+		FileGrepper* pNewGrepper = new FileGrepper(m_config);
+		pNewGrepper->setOutputMerger(&m_outputMerger);
+		m_aGreppers.emplace_back(pNewGrepper);
+	}
+}
+
+FileContentProcessor::~FileContentProcessor()
+{
+	for (FileGrepper* pGrepper : m_aGreppers)
+	{
+		delete pGrepper;
+	}
+	m_aGreppers.clear();
+}
+
+bool FileContentProcessor::configureGrep(const std::string& contentsPattern, std::string& errorMessage)
+{
+	m_operation = eOperationGrep;
+	m_progressDescription = "Grepping files for content";
+
+	// work out everything we need for searching for the string once up-front, so it can be re-used for all files.
+	// Each grepper has its own copy, as regex searchers build their DFA as they search.
+	for (FileGrepper* pGrepper : m_aGreppers)
+	{
+		if (!pGrepper->initSearch(contentsPattern, errorMessage))
+			return false;
+	}
+
+	return true;
+}
+
+bool FileContentProcessor::configureCount(const std::string& contentsPattern, std::string& errorMessage)
+{
+	m_operation = eOperationCount;
+	m_progressDescription = "Searching files for content counts";
+
+	for (FileGrepper* pGrepper : m_aGreppers)
+	{
+		if (!pGrepper->initSearch(contentsPattern, errorMessage))
+			return false;
+	}
+
+	return true;
+}
+
+bool FileContentProcessor::configureGrepLast(const std::string& contentsPattern, std::string& errorMessage)
+{
+	m_operation = eOperationGrepLast;
+	m_progressDescription = "Grepping files for last content";
+
+	for (FileGrepper* pGrepper : m_aGreppers)
+	{
+		if (!pGrepper->initSearch(contentsPattern, errorMessage))
+			return false;
+	}
+
+	return true;
+}
+
+bool FileContentProcessor::configureMatch(const std::string& matchString, std::string& errorMessage)
+{
+	m_operation = eOperationMatch;
+	m_progressDescription = "Searching files for match content";
+
+	for (FileGrepper* pGrepper : m_aGreppers)
+	{
+		if (!pGrepper->initMatch(matchString, errorMessage))
+			return false;
+	}
+
+	return true;
+}
+
+void FileContentProcessor::configureTimestampDelta(uint64_t timeDeltaMicroseconds)
+{
+	m_operation = eOperationTimestampDelta;
+	m_progressDescription = "Searching files for timestamp delta diff";
+
+	m_timeDeltaMicroseconds = timeDeltaMicroseconds;
+}
+
+void FileContentProcessor::configureOutputLines()
+{
+	m_operation = eOperationOutputLines;
+	m_progressDescription = "Outputting lines within time window";
+}
+
+bool FileContentProcessor::configureTimeWindow(const std::string& windowStart, const std::string& windowEnd, std::string& errorMessage)
+{
+	// the format's already been checked by Config
+	TimestampParser timestampParser;
+	timestampParser.init(m_config.getLogTimestampFormat(), errorMessage);
+
+	if (!timestampParser.parseTimeString(windowStart, m_timeWindowStart))
+	{
+		errorMessage = "invalid window start time: " + windowStart;
+		return false;
+	}
+
+	if (!timestampParser.parseTimeString(windowEnd, m_timeWindowEnd))
+	{
+		errorMessage = "invalid window end time: " + windowEnd;
+		return false;
+	}
+
+	m_timeWindow = true;
+
+	return true;
+}
+
+size_t FileContentProcessor::processFiles(FoundFileQueue& foundFiles)
+{
+	m_pFoundFileQueue = &foundFiles;
+
+	m_printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
+
+	m_foundCount = 0;
+
+	m_fileCount = 0;
+	m_lastPercentage = 101;
+
+	if (m_printProgress)
+	{
+		fprintf(stderr, "%s...", m_progressDescription);
+	}
+
+	unsigned int threads = m_aGreppers.size();
+
+	// with one thread, files always finish in order anyway
+	bool orderedOutput = threads <= 1 || !m_config.getUnorderedOutput();
+	m_outputMerger.init(orderedOutput, threads * kOutputWindowFilesPerThread);
+
+	// chunks can only be combined for operations where each line can be processed on its own
+	bool canCombineChunks = m_operation == eOperationCount ||
+			(m_operation == eOperationGrep && m_config.getBeforeLines() == 0 && m_config.getAfterLines() == 0) ||
+			(m_operation == eOperationMatch && m_aGreppers[0]->isOrMatch() && m_config.getBeforeLines() == 0 &&
+			 m_config.getAfterLines() == 0);
+
+	m_processFilesInChunks = threads > 1 && m_config.getChunkedFileMinSize() > 0 && canCombineChunks;
+	m_chunkedFileMinSize = (uint64_t)m_config.getChunkedFileMinSize() * 1024 * 1024;
+	m_maxChunksAhead = threads * kMaxChunksAheadPerThread;
+	m_numThreads = threads;
+	m_threadsOutOfFiles = 0;
+
+	size_t readBufferMemoryLimit = (size_t)m_config.getReadBufferMemoryLimit() * 1024 * 1024;
+	m_readBufferPool.init(m_aGreppers[0]->getReadBufferSize(), readBufferMemoryLimit, m_config.getReadBufferHugePages());
+
+	// each grepper's io_uring buffers are its own (as they're in use for as long as the grepper is), but they're
+	// still read buffers, so they count towards the limit
+	for (FileGrepper* pGrepper : m_aGreppers)
+	{
+		m_readBufferPool.reserveMemory(pGrepper->getIoUringBufferMemory());
+	}
+
+	// open the next few files (and start reading them in) on another thread while the current ones are being processed,
+	// so that the time taken to open them (which over NFS is a round trip each) overlaps with the processing.
+	// This is done with a single thread, as it's mostly for when processing's single threaded.
+	std::thread prefetchThread;
+	if (m_config.getPrefetchFiles() > 0)
+	{
+		m_prefetchLength = (uint64_t)std::max(m_config.getFileReadBufferSize(), 1u) * 1024;
+
+		foundFiles.enablePrefetching(m_config.getPrefetchFiles());
+		prefetchThread = std::thread(&FileContentProcessor::prefetchQueuedFiles, this);
+	}
+
+	if (threads <= 1)
+	{
+		// just process them on this thread
+		processQueuedFiles(*m_aGreppers[0]);
+	}
+	else
+	{
+		// each worker takes files off the queue until there aren't any more
+		for (unsigned int i = 0; i < threads; i++)
+		{
+			addTask(new Task());
+		}
+
+		start(threads);
+
+		// start() doesn't clean these up itself
+		m_aWorkerThreads.clear();
+	}
+
+	// it finishes once all the files have been taken off the queue
+	if (prefetchThread.joinable())
+	{
+		prefetchThread.join();
+	}
+
+	m_pFoundFileQueue = nullptr;
+
+	return m_foundCount;
+}
+
+void FileContentProcessor::prefetchQueuedFiles()
+{
+	std::string filename;
+	uint64_t fileSize;
+	size_t fileIndex;
+
+	while (m_pFoundFileQueue->getNextFileToPrefetch(filename, fileSize, fileIndex))
+	{
+		int fileDescriptor = open(filename.c_str(), O_RDONLY);
+		if (fileDescriptor == -1)
+			continue;
+
+		// if the finder didn't know the size, find it out now, so that the thread processing it doesn't have to
+		if (fileSize == kUnknownFileSize)
+		{
+			struct stat statState;
+			if (fstat(fileDescriptor, &statState) == 0 && S_ISREG(statState.st_mode))
+			{
+				fileSize = statState.st_size;
+			}
+		}
+
+#ifdef POSIX_FADV_WILLNEED
+		// start reading in the first block (which for small files is all of it), without waiting for it
+		posix_fadvise(fileDescriptor, 0, std::min(fileSize, m_prefetchLength), POSIX_FADV_WILLNEED);
+#endif
+
+		m_pFoundFileQueue->setPrefetchedFile(fileIndex, fileDescriptor, fileSize);
+	}
+}
+
+void FileContentProcessor::processTask(Task* pTask, unsigned int threadIndex)
+{
+	processQueuedFiles(*m_aGreppers[threadIndex]);
+
+	delete pTask;
+}
+
+void FileContentProcessor::processQueuedFiles(FileGrepper& grepper)
+{
+	FoundFile file("", kUnknownFileSize);
+	size_t fileIndex;
+
+	bool moreFiles = true;
+
+	while (true)
+	{
+		// the buffer has to be taken before the file (or chunk), so that whichever file's earliest always has one
+		// and can finish, however many buffers the memory limit allows. It's given back at the end of each iteration,
+		// and mustn't be held while waiting for anything which other threads need a buffer to make happen.
+		ScopedReadBuffer readBuffer(m_readBufferPool);
+		grepper.setReadBuffer(readBuffer.getBuffer());
+
+		// this has to be got before checking for chunks, so that we can't miss being woken up for new ones
+		size_t wakeCount = m_pFoundFileQueue->getWakeCount();
+
+		if (m_processFilesInChunks)
+		{
+			// help out with any large files other threads are processing in chunks first
+			if (processNextAvailableChunk(grepper))
+				continue;
+
+			if (!moreFiles)
+			{
+				// this waits for all the other threads to run out of files, so a buffer mustn't be held while waiting,
+				// as they might be waiting for it
+				grepper.setReadBuffer(nullptr);
+				readBuffer.returnBuffer();
+
+				if (!waitForChunks())
+					break;
+
+				continue;
+			}
+		}
+
+		FoundFileQueue::NextFileResult result = m_pFoundFileQueue->getNextFile(file, fileIndex, wakeCount);
+		if (result == FoundFileQueue::eNextFileWoken)
+			continue;
+
+		if (result == FoundFileQueue::eNextFileNoMoreFiles)
+		{
+			if (!m_processFilesInChunks)
+				break;
+
+			// there might still be chunks to help with
+			moreFiles = false;
+
+			std::unique_lock<std::mutex> lock(m_chunksLock);
+			m_threadsOutOfFiles++;
+			m_chunksEvent.notify_all();
+			continue;
+		}
+
+		// don't get too far ahead of the files which are still to be output (but help out with any chunks while waiting)
+		while (true)
+		{
+			size_t outputWakeCount = m_outputMerger.getWakeCount();
+
+			if (m_processFilesInChunks && processNextAvailableChunk(grepper))
+				continue;
+
+			if (m_outputMerger.waitToStartFile(fileIndex, outputWakeCount))
+				break;
+		}
+
+		bool foundInFile = processFile(grepper, fileIndex, file);
+
+		std::unique_lock<std::mutex> lock(m_progressLock);
+
+		if (foundInFile)
+		{
+			m_foundCount++;
+		}
+
+		if (m_printProgress)
+		{
+			m_fileCount++;
+			printProgress();
+		}
+	}
+
+	// the last buffer's been given back
+	grepper.setReadBuffer(nullptr);
+}
+
+bool FileContentProcessor::processFile(FileGrepper& grepper, size_t fileIndex, const FoundFile& file)
+{
+	const std::string& filename = file.filename;
+
+	grepper.startOutputFile(fileIndex);
+
+	// the grepper owns the prefetched file (if there is one) from here on
+	grepper.setFileDetails(filename, file.fileDescriptor, file.fileSize);
+
+	uint64_t rangeStart = 0;
+	uint64_t rangeLength = UINT64_MAX;
+	if (m_timeWindow && !grepper.findTimeWindowRange(filename, m_timeWindowStart, m_timeWindowEnd, rangeStart, rangeLength))
+	{
+		// there's nothing within the window
+		grepper.clearFileDetails();
+		grepper.finishOutputFile();
+		return false;
+	}
+
+	bool foundInFile = false;
+	if (m_processFilesInChunks && canProcessInChunks(filename, file.fileSize, rangeLength))
+	{
+		// the chunks are opened separately (and by any thread), so the file descriptor's no use for them
+		grepper.clearFileDetails();
+
+		foundInFile = processChunkedFile(grepper, filename, rangeStart, rangeLength);
+	}
+	else
+	{
+		grepper.setReadRange(rangeStart, rangeLength);
+		foundInFile = runOperation(grepper, filename);
+		grepper.setReadRange(0, UINT64_MAX);
+
+		grepper.clearFileDetails();
+	}
+
+	grepper.finishOutputFile();
+
+	return foundInFile;
+}
+
+bool FileContentProcessor::runOperation(FileGrepper& grepper, const std::string& filename)
+{
+	// the grepper itself does any printing...
+	bool foundInFile = false;
+	switch (m_operation)
+	{
+		case eOperationGrep:
+			foundInFile = grepper.grepBasic(filename);
+			break;
+		case eOperationCount:
+			foundInFile = grepper.countBasic(filename);
+			break;
+		case eOperationGrepLast:
+			foundInFile = grepper.grepLast(filename);
+			break;
+		case eOperationMatch:
+			foundInFile = grepper.matchBasic(filename);
+			break;
+		case eOperationTimestampDelta:
+			foundInFile = grepper.findTimestampDelta(filename, m_timeDeltaMicroseconds);
+			break;
+		case eOperationOutputLines:
+			foundInFile = grepper.outputLines(filename);
+			break;
+		default:
+			break;
+	}
+
+	return foundInFile;
+}
+
+bool FileContentProcessor::canProcessInChunks(const std::string& filename, uint64_t fileSize, uint64_t rangeLength) const
+{
+	if (rangeLength == UINT64_MAX && fileSize != kUnknownFileSize)
+	{
+		rangeLength = fileSize;
+	}
+	else if (rangeLength == UINT64_MAX)
+	{
+		struct stat statState;
+		if (stat(filename.c_str(), &statState) != 0)
+			return false;
+
+		rangeLength = statState.st_size;
+	}
+
+	// it's not worth it unless there are going to be enough chunks for each thread to do at least a couple
+	return rangeLength >= std::max(m_chunkedFileMinSize, kFileChunkSize * 2);
+}
+
+bool FileContentProcessor::splitFileIntoChunks(const std::string& filename, uint64_t rangeStart, uint64_t rangeLength,
+											   std::vector<FileChunk>& aChunks) const
+{
+	int fileDescriptor = open(filename.c_str(), O_RDONLY);
+	if (fileDescriptor == -1)
+		return false;
+
+	struct stat statState;
+	if (fstat(fileDescriptor, &statState) != 0)
+	{
+		close(fileDescriptor);
+		return false;
+	}
+
+	// the end of the range, which for the whole file is just where it currently ends
+	const bool wholeFile = rangeLength == UINT64_MAX;
+	uint64_t rangeEnd = wholeFile ? statState.st_size : std::min(rangeStart + rangeLength, (uint64_t)statState.st_size);
+
+	char buffer[16 * 1024];
+
+	uint64_t chunkStart = rangeStart;
+	while (true)
+	{
+		// move the end of the chunk on to the start of the next line, so that chunks always start on a new line
+		// (if the byte before the nominal end is a '\n', it's already there)
+		uint64_t chunkEnd = chunkStart + kFileChunkSize;
+		bool foundLineEnd = false;
+
+		if (chunkEnd < rangeEnd)
+		{
+			uint64_t searchPos = chunkEnd - 1;
+			while (!foundLineEnd)
+			{
+				ssize_t readAmount = pread(fileDescriptor, buffer, sizeof(buffer), searchPos);
+				if (readAmount <= 0)
+					break;
+
+				const char* newLine = (const char*)memchr(buffer, '\n', readAmount);
+				if (newLine)
+				{
+					chunkEnd = searchPos + (newLine - buffer) + 1;
+					foundLineEnd = true;
+				}
+				else
+				{
+					searchPos += readAmount;
+				}
+			}
+		}
+
+		if (!foundLineEnd || chunkEnd >= rangeEnd)
+		{
+			// for the whole file, the last chunk just reads to the end of the file, like processing the whole file
+			// would (in case it's been added to since)
+			aChunks.emplace_back(FileChunk(chunkStart, wholeFile ? UINT64_MAX : rangeEnd - chunkStart));
+			break;
+		}
+
+		aChunks.emplace_back(FileChunk(chunkStart, chunkEnd - chunkStart));
+		chunkStart = chunkEnd;
+	}
+
+	close(fileDescriptor);
+
+	return true;
+}
+
+bool FileContentProcessor::processChunkedFile(FileGrepper& grepper, const std::string& filename, uint64_t rangeStart,
+											  uint64_t rangeLength)
+{
+	ChunkedFile chunkedFile;
+	chunkedFile.filename = filename;
+
+	if (!splitFileIntoChunks(filename, rangeStart, rangeLength, chunkedFile.aChunks))
+		return false;
+
+	size_t numChunks = chunkedFile.aChunks.size();
+	chunkedFile.aChunkFinished.resize(numChunks, false);
+
+	std::unique_lock<std::mutex> lock(m_chunksLock);
+
+	m_aChunkedFiles.emplace_back(&chunkedFile);
+	notifyChunksAvailable();
+
+	// we combine the results of the chunks in order as they finish, while also processing chunks ourself
+	FileChunkTotals totals;
+	bool needMoreChunks = true;
+
+	while (needMoreChunks && chunkedFile.nextChunkToCombine < numChunks)
+	{
+		size_t chunkIndex = chunkedFile.nextChunkToCombine;
+		if (chunkedFile.aChunkFinished[chunkIndex])
+		{
+			// we don't want to hold the lock while outputting, as that can block
+			lock.unlock();
+
+			FileChunk& chunk = chunkedFile.aChunks[chunkIndex];
+			if (m_operation == eOperationCount)
+			{
+				needMoreChunks = grepper.combineChunkCount(chunk, totals);
+			}
+			else
+			{
+				needMoreChunks = grepper.combineChunkContentLines(filename, chunk, m_operation == eOperationGrep, totals);
+			}
+
+			lock.lock();
+
+			chunkedFile.nextChunkToCombine++;
+
+			// which might mean more chunks can be processed
+			notifyChunksAvailable();
+			continue;
+		}
+
+		if (takeNextChunk(chunkedFile, chunkIndex))
+		{
+			processChunk(grepper, chunkedFile, chunkIndex, lock);
+			continue;
+		}
+
+		// otherwise wait for other threads to finish the next chunk
+		m_chunksEvent.wait(lock);
+	}
+
+	// make sure nothing else starts any more chunks, and wait for any still being processed
+	chunkedFile.abandoned = true;
+
+	while (chunkedFile.numChunksProcessing > 0)
+	{
+		m_chunksEvent.wait(lock);
+	}
+
+	m_aChunkedFiles.erase(std::find(m_aChunkedFiles.begin(), m_aChunkedFiles.end(), &chunkedFile));
+
+	lock.unlock();
+
+	return grepper.finishChunkedFile(filename, m_operation == eOperationCount, totals);
+}
+
+void FileContentProcessor::notifyChunksAvailable()
+{
+	m_chunksEvent.notify_all();
+
+	// as well as any threads waiting for more files to be found, or to be able to start their next file
+	m_pFoundFileQueue->wakeWaiting();
+	m_outputMerger.wakeWaiting();
+}
+
+bool FileContentProcessor::takeNextChunk(ChunkedFile& chunkedFile, size_t& chunkIndex)
+{
+	if (!isChunkAvailable(chunkedFile))
+		return false;
+
+	chunkIndex = chunkedFile.nextChunkToProcess++;
+	chunkedFile.numChunksProcessing++;
+
+	return true;
+}
+
+bool FileContentProcessor::haveChunkAvailable() const
+{
+	for (const ChunkedFile* pChunkedFile : m_aChunkedFiles)
+	{
+		if (isChunkAvailable(*pChunkedFile))
+			return true;
+	}
+
+	return false;
+}
+
+void FileContentProcessor::processChunk(FileGrepper& grepper, ChunkedFile& chunkedFile, size_t chunkIndex, std::unique_lock<std::mutex>& lock)
+{
+	lock.unlock();
+
+	grepper.setChunk(&chunkedFile.aChunks[chunkIndex]);
+	runOperation(grepper, chunkedFile.filename);
+	grepper.setChunk(nullptr);
+
+	lock.lock();
+
+	chunkedFile.aChunkFinished[chunkIndex] = true;
+	chunkedFile.numChunksProcessing--;
+
+	m_chunksEvent.notify_all();
+}
+
+bool FileContentProcessor::processNextAvailableChunk(FileGrepper& grepper)
+{
+	std::unique_lock<std::mutex> lock(m_chunksLock);
+
+	for (ChunkedFile* pChunkedFile : m_aChunkedFiles)
+	{
+		size_t chunkIndex;
+		if (takeNextChunk(*pChunkedFile, chunkIndex))
+		{
+			processChunk(grepper, *pChunkedFile, chunkIndex, lock);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FileContentProcessor::waitForChunks()
+{
+	std::unique_lock<std::mutex> lock(m_chunksLock);
+
+	// until all threads have run out of files, they could still start processing a large file in chunks
+	while (!haveChunkAvailable() && m_threadsOutOfFiles < m_numThreads)
+	{
+		m_chunksEvent.wait(lock);
+	}
+
+	return haveChunkAvailable();
+}
+
+void FileContentProcessor::printProgress()
+{
+	bool finishedFinding = false;
+	size_t totalFiles = m_pFoundFileQueue->getAddedCount(finishedFinding);
+
+	if (!finishedFinding)
+	{
+		// we don't know how many files there are in total yet
+		if (m_fileCount % kProgressFileCountInterval == 0)
+		{
+			fprintf(stderr, "\r%s - %zu files processed so far...", m_progressDescription, m_fileCount);
+		}
+		return;
+	}
+
+	size_t thisPercentage = (m_fileCount * 100) / totalFiles;
+	if (thisPercentage != m_lastPercentage)
+	{
+		fprintf(stderr, "\r%s - %zu%% complete...", m_progressDescription, thisPercentage);
+		m_lastPercentage = thisPercentage;
+	}
+}
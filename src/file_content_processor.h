@@ -0,0 +1,185 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef FILE_CONTENT_PROCESSOR_H
+#define FILE_CONTENT_PROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include <stdint.h>
+
+#include "file_grepper.h"
+#include "output_merger.h"
+#include "found_files.h"
+
+#include "utils/read_buffer_pool.h"
+#include "utils/threaded_task_pool.h"
+
+class Config;
+
+// Runs one of the content operations (grep, count, match, timestamp delta) on each of a list of found files.
+// With more than one grep thread configured, the files are processed in parallel, with each worker thread
+// having its own FileGrepper (and so its own before lines buffer), and read buffers being taken from a shared pool,
+// which can have a limit on the memory used. A thread takes a buffer before it takes a file (or a chunk), so every
+// file in progress has one, and the earliest one can always finish, whatever the limit. Output goes through
+// an OutputMerger, so that output from different files never interleaves, and is in the same order as the
+// files were found in (unless unordered output is configured).
+// Large files can also be split into chunks (at line boundaries) which are processed in parallel by any threads
+// which are free, for the operations where the results of the chunks can be combined afterwards (count, grep and
+// "or" match without context lines). The thread which took the file combines the chunk results in order as
+// they finish, fixing up line numbers by the number of lines in the previous chunks.
+
+class FileContentProcessor : public ThreadedTaskPool
+{
+public:
+	FileContentProcessor(const Config& config);
+	virtual ~FileContentProcessor();
+
+	// these return false if the pattern / match string was invalid, with errorMessage set if there's
+	// anything more specific to say than that (e.g. what's wrong with a regex)
+	bool configureGrep(const std::string& contentsPattern, std::string& errorMessage);
+	bool configureCount(const std::string& contentsPattern, std::string& errorMessage);
+	// for just the last matches in each file
+	bool configureGrepLast(const std::string& contentsPattern, std::string& errorMessage);
+	bool configureMatch(const std::string& matchString, std::string& errorMessage);
+	void configureTimestampDelta(uint64_t timeDeltaMicroseconds);
+	// just outputs the lines of each file (for time windows)
+	void configureOutputLines();
+
+	// can be configured in addition to any of the operations, so they only process the part of each file with timestamps
+	// within the window, which is found by binary searching the file. The times can be in the logTimestampFormat, or
+	// "YYYY-MM-DD[ HH:MM[:SS]]". Returns false with errorMessage set if either time is invalid.
+	bool configureTimeWindow(const std::string& windowStart, const std::string& windowEnd, std::string& errorMessage);
+
+	// processes files from the queue with the configured operation as they're added to it, until it's finished,
+	// printing progress to stderr if configured to, and returns the number of files in which something was found.
+	size_t processFiles(FoundFileQueue& foundFiles);
+
+protected:
+	enum Operation
+	{
+		eOperationGrep,
+		eOperationCount,
+		eOperationGrepLast,
+		eOperationMatch,
+		eOperationTimestampDelta,
+		eOperationOutputLines
+	};
+
+	// a large file being processed in chunks
+	struct ChunkedFile
+	{
+		ChunkedFile() : nextChunkToProcess(0), nextChunkToCombine(0), numChunksProcessing(0), abandoned(false)
+		{
+		}
+
+		std::string				filename;
+		std::vector<FileChunk>	aChunks;
+		std::vector<bool>		aChunkFinished;
+
+		size_t					nextChunkToProcess;
+		size_t					nextChunkToCombine;
+		unsigned int			numChunksProcessing;
+		bool					abandoned; // nothing's needed from any more chunks
+	};
+
+	virtual void processTask(Task* pTask, unsigned int threadIndex) override;
+
+	void processQueuedFiles(FileGrepper& grepper);
+
+	// opens files on the queue ahead of them being processed, until there are no more
+	void prefetchQueuedFiles();
+
+	bool processFile(FileGrepper& grepper, size_t fileIndex, const FoundFile& file);
+
+	// runs the operation on the whole file, or just the chunk set on the grepper
+	bool runOperation(FileGrepper& grepper, const std::string& filename);
+
+	// rangeLength is UINT64_MAX for the whole file, and fileSize is kUnknownFileSize if the finder didn't know it
+	bool canProcessInChunks(const std::string& filename, uint64_t fileSize, uint64_t rangeLength) const;
+	bool splitFileIntoChunks(const std::string& filename, uint64_t rangeStart, uint64_t rangeLength,
+							 std::vector<FileChunk>& aChunks) const;
+
+	bool processChunkedFile(FileGrepper& grepper, const std::string& filename, uint64_t rangeStart, uint64_t rangeLength);
+
+	// these need m_chunksLock to be held
+	bool isChunkAvailable(const ChunkedFile& chunkedFile) const
+	{
+		return !chunkedFile.abandoned && chunkedFile.nextChunkToProcess < chunkedFile.aChunks.size() &&
+				chunkedFile.nextChunkToProcess < chunkedFile.nextChunkToCombine + m_maxChunksAhead;
+	}
+	bool takeNextChunk(ChunkedFile& chunkedFile, size_t& chunkIndex);
+	// wakes up anything which could help with them
+	void notifyChunksAvailable();
+	bool haveChunkAvailable() const;
+	// unlocks the lock while the chunk's being processed
+	void processChunk(FileGrepper& grepper, ChunkedFile& chunkedFile, size_t chunkIndex, std::unique_lock<std::mutex>& lock);
+
+	// processes a chunk of any file which has one available, returning false if there wasn't one
+	bool processNextAvailableChunk(FileGrepper& grepper);
+	// for once there are no more files - waits until there are chunks available to help with, returning false
+	// if there won't be any more
+	bool waitForChunks();
+
+	void printProgress();
+
+protected:
+	const Config&				m_config;
+
+	// one per thread
+	std::vector<FileGrepper*>	m_aGreppers;
+
+	Operation					m_operation;
+	uint64_t					m_timeDeltaMicroseconds;
+
+	bool						m_timeWindow;
+	int64_t						m_timeWindowStart;
+	int64_t						m_timeWindowEnd;
+
+	OutputMerger				m_outputMerger;
+
+	// shared between all the threads, which take a buffer from it for each file (or chunk) they process
+	ReadBufferPool				m_readBufferPool;
+
+	FoundFileQueue*				m_pFoundFileQueue;
+	uint64_t					m_prefetchLength; // how much of each prefetched file to start reading in
+
+	// for processing large files in chunks
+	bool						m_processFilesInChunks;
+	uint64_t					m_chunkedFileMinSize;
+	unsigned int				m_maxChunksAhead; // how far ahead of the combined chunks chunks can be processed
+	std::mutex					m_chunksLock;
+	std::condition_variable		m_chunksEvent;
+	std::vector<ChunkedFile*>	m_aChunkedFiles; // in progress
+	unsigned int				m_numThreads;
+	unsigned int				m_threadsOutOfFiles; // once all threads are, nothing else can be split into chunks
+
+	// for the found count and progress, which are shared between threads
+	std::mutex					m_progressLock;
+	size_t						m_foundCount;
+
+	bool						m_printProgress;
+	const char*					m_progressDescription;
+	size_t						m_fileCount;
+	size_t						m_lastPercentage;
+};
+
+#endif // FILE_CONTENT_PROCESSOR_H
@@ -53,7 +53,7 @@ void FileFinder::setFilterParameters(const FilterParameters& filterParams)
 }
 
 bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchDirectoryPath, const std::string& relativeDirectoryPath,
-													unsigned int currentDepth, std::vector<std::string>& files) const
+													unsigned int currentDepth, FoundFileSink& files) const
 {
 	// Note: opendir() is used on purpose here, as scandir() and lsstat() don't reliably support S_ISLNK on symlinks over NFS,
 	//       whereas opendir() allows this robustly with d_type (in most cases). opendir() is also more efficient when operating on items one at a time...
@@ -65,6 +65,8 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 	struct dirent* dirEnt = NULL;
 	char tempBuffer[4096];
 
+	bool foundAnyFiles = false;
+
 	while ((dirEnt = readdir(dir)) != NULL)
 	{
 		if (dirEnt->d_type == DT_DIR)
@@ -84,7 +86,7 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 			// build up next directory level relative path
 			std::string newFullDirPath = FileHelpers::combinePaths(searchDirectoryPath, dirEnt->d_name);
 			std::string newRelativeDirPath = FileHelpers::combinePaths(relativeDirectoryPath, dirEnt->d_name);
-			getRelativeFilesInDirectoryRecursive(newFullDirPath, newRelativeDirPath, currentDepth + 1, files);
+			foundAnyFiles |= getRelativeFilesInDirectoryRecursive(newFullDirPath, newRelativeDirPath, currentDepth + 1, files);
 		}
 		else if (dirEnt->d_type == DT_LNK && m_config.getFollowSymlinks())
 		{
@@ -138,7 +140,7 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 					// build up next directory level relative path
 					std::string newFullDirPath = tempBuffer;
 					std::string newRelativeDirPath = FileHelpers::combinePaths(relativeDirectoryPath, dirEnt->d_name);
-					getRelativeFilesInDirectoryRecursive(newFullDirPath, newRelativeDirPath, currentDepth + 1, files);
+					foundAnyFiles |= getRelativeFilesInDirectoryRecursive(newFullDirPath, newRelativeDirPath, currentDepth + 1, files);
 				}
 				else if (S_ISREG(statState.st_mode))
 				{
@@ -173,7 +175,8 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 					if (m_pFilenameMatcher->doesMatch(dirEnt->d_name))
 					{
 						std::string fullRelativePath = FileHelpers::combinePaths(relativeDirectoryPath, dirEnt->d_name);
-						files.push_back(fullRelativePath);
+						files.addFoundFile(fullRelativePath, statState.st_size);
+						foundAnyFiles = true;
 					}
 				}
 				else
@@ -197,6 +200,9 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 			if (!m_pFilenameMatcher->doesMatch(dirEnt->d_name))
 				continue;
 
+			// we only know this if we stat() it for the filters
+			uint64_t fileSize = kUnknownFileSize;
+
 			if (m_filter.getFilterTypeFlags() != 0)
 			{
 				// if we need to do filtering, we need to stat the file to get the full details...
@@ -232,10 +238,13 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 				{
 					continue;
 				}
+
+				fileSize = statState.st_size;
 			}
 
 			std::string fullRelativePath = FileHelpers::combinePaths(relativeDirectoryPath, dirEnt->d_name);
-			files.push_back(fullRelativePath);
+			files.addFoundFile(fullRelativePath, fileSize);
+			foundAnyFiles = true;
 		}
 		else if (dirEnt->d_type == DT_UNKNOWN)
 		{
@@ -298,7 +307,8 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 				if (m_pFilenameMatcher->doesMatch(dirEnt->d_name))
 				{
 					std::string fullRelativePath = FileHelpers::combinePaths(relativeDirectoryPath, dirEnt->d_name);
-					files.push_back(fullRelativePath);
+					files.addFoundFile(fullRelativePath, statState.st_size);
+					foundAnyFiles = true;
 				}
 			}
 			else if (S_ISDIR(statState.st_mode))
@@ -312,7 +322,7 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 					continue;
 
 				// TODO: not sure this is right...
-				getRelativeFilesInDirectoryRecursive(newRelativePath, newRelativePath, currentDepth + 1, files);
+				foundAnyFiles |= getRelativeFilesInDirectoryRecursive(newRelativePath, newRelativePath, currentDepth + 1, files);
 			}
 			else
 			{
@@ -327,7 +337,7 @@ bool FileFinder::getRelativeFilesInDirectoryRecursive(const std::string& searchD
 
 	closedir(dir);
 
-	return !files.empty();
+	return foundAnyFiles;
 }
 
 //
@@ -340,21 +350,10 @@ FileFinderBasicRecursive::FileFinderBasicRecursive(const Config& config,
 	
 }
 
-bool FileFinderBasicRecursive::findFiles(std::vector<std::string>& foundFiles)
+bool FileFinderBasicRecursive::findFiles(FoundFileSink& foundFiles)
 {
-	bool foundOK = getRelativeFilesInDirectoryRecursive(m_patternSearch.baseSearchPath, "", 0, foundFiles);
-
-	if (foundOK)
-	{
-		// the results of the above are relative, so add the base search path
-
-		for (std::string& item : foundFiles)
-		{
-			item = FileHelpers::combinePaths(m_patternSearch.baseSearchPath, item);
-		}
-	}
-
-	return foundOK;
+	// use the base search path as the relative path as well, so the found paths are absolute
+	return getRelativeFilesInDirectoryRecursive(m_patternSearch.baseSearchPath, m_patternSearch.baseSearchPath, 0, foundFiles);
 }
 
 //
@@ -367,7 +366,7 @@ FileFinderBasicRecursiveDirectoryWildcard::FileFinderBasicRecursiveDirectoryWild
 	
 }
 
-bool FileFinderBasicRecursiveDirectoryWildcard::findFiles(std::vector<std::string>& foundFiles)
+bool FileFinderBasicRecursiveDirectoryWildcard::findFiles(FoundFileSink& foundFiles)
 {
 	// for this type of search, we look for directories matching the wildcard (currently just *) as a first step
 
@@ -441,12 +440,15 @@ bool FileFinderBasicRecursiveDirectoryWildcard::findFiles(std::vector<std::strin
 FileFinderBasicRecursiveDirectoryWildcardParallel::FileFinderBasicRecursiveDirectoryWildcardParallel(const Config& config,
 								const FilenameMatcher* pFilenameMatcher,
 								const PatternSearch& patternSearch) :
-										FileFinder(config, pFilenameMatcher, patternSearch)
+										FileFinder(config, pFilenameMatcher, patternSearch),
+	m_pFoundFiles(nullptr),
+	m_nextTaskToPassOn(0),
+	m_numFoundFiles(0)
 {
 	
 }
 
-bool FileFinderBasicRecursiveDirectoryWildcardParallel::findFiles(std::vector<std::string>& foundFiles)
+bool FileFinderBasicRecursiveDirectoryWildcardParallel::findFiles(FoundFileSink& foundFiles)
 {
 	// for this type of search, we look for directories matching the wildcard (currently just *) as a first step
 
@@ -458,33 +460,35 @@ bool FileFinderBasicRecursiveDirectoryWildcardParallel::findFiles(std::vector<st
 	
 	unsigned int threads = std::min(m_config.getFindThreads(), (unsigned int)wildCardDirs.size());
 	
-	std::vector<std::vector<std::string> > aThreadFoundFiles;
-	// one std::vector<std::string> per subdir/task
+	m_pFoundFiles = &foundFiles;
+
+	// one std::vector<FoundFile> per subdir/task
 	// TODO: might be worth thinking about making these per-thread instead, but doing it this way will likely
 	//       be useful in the future for custom file output to files named based on first-level subdirectories.
-	aThreadFoundFiles.resize(wildCardDirs.size());
+	m_aTaskFoundFiles.clear();
+	m_aTaskFoundFiles.resize(wildCardDirs.size());
+	m_aTaskFinished.assign(wildCardDirs.size(), false);
+	m_nextTaskToPassOn = 0;
+	m_numFoundFiles = 0;
 
 	// we have some first level directories where the wildcard is, so for each of those try and find remainder directories within each
-	unsigned int count = 0;
+	size_t count = 0;
 	for (const std::string& wildcardDir : wildCardDirs)
 	{
-		WildcardDirTask* pNewTask = new WildcardDirTask(wildcardDir, aThreadFoundFiles[count++]);
+		WildcardDirTask* pNewTask = new WildcardDirTask(wildcardDir, count++);
 		
 		addTask(pNewTask);
 	}
 	
 	start(threads);
-		
-	// now add
-	for (const std::vector<std::string>& threadResults : aThreadFoundFiles)
-	{
-		foundFiles.insert(foundFiles.end(), threadResults.begin(), threadResults.end());
-	}
 
-	return !foundFiles.empty();
+	m_aWorkerThreads.clear();
+	m_pFoundFiles = nullptr;
+
+	return m_numFoundFiles > 0;
 }
 
-void FileFinderBasicRecursiveDirectoryWildcardParallel::processTask(Task* pTask)
+void FileFinderBasicRecursiveDirectoryWildcardParallel::processTask(Task* pTask, unsigned int /*threadIndex*/)
 {
 	WildcardDirTask* pWildcardTask = static_cast<WildcardDirTask*>(pTask);
 	
@@ -530,9 +534,35 @@ void FileFinderBasicRecursiveDirectoryWildcardParallel::processTask(Task* pTask)
 		// otherwise, we should have a final directory matching the pattern, including the directory wildcard.
 		// so now do a file search at that level
 		
-		std::vector<std::string>& foundFiles = pWildcardTask->m_foundFiles;
+		FoundFileDetailsList foundFiles(m_aTaskFoundFiles[pWildcardTask->m_taskIndex]);
 		getRelativeFilesInDirectoryRecursive(remainderFullDir, remainderFullDir, 0, foundFiles);
 	}
 
+	{
+		std::unique_lock<std::mutex> lock(m_foundFilesLock);
+
+		m_aTaskFinished[pWildcardTask->m_taskIndex] = true;
+		passOnFinishedTaskFoundFiles();
+	}
+
 	delete pWildcardTask;
 }
+
+void FileFinderBasicRecursiveDirectoryWildcardParallel::passOnFinishedTaskFoundFiles()
+{
+	while (m_nextTaskToPassOn < m_aTaskFinished.size() && m_aTaskFinished[m_nextTaskToPassOn])
+	{
+		std::vector<FoundFile>& taskFoundFiles = m_aTaskFoundFiles[m_nextTaskToPassOn];
+		for (const FoundFile& foundFile : taskFoundFiles)
+		{
+			m_pFoundFiles->addFoundFile(foundFile.filename, foundFile.fileSize);
+		}
+
+		m_numFoundFiles += taskFoundFiles.size();
+
+		// we don't need these any more
+		std::vector<FoundFile>().swap(taskFoundFiles);
+
+		m_nextTaskToPassOn++;
+	}
+}
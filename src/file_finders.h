@@ -21,8 +21,10 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
 
 #include "file_filters.h"
+#include "found_files.h"
 
 #include "utils/threaded_task_pool.h"
 
@@ -42,9 +44,11 @@ public:
 	void setFilterParameters(const FilterParameters& filterParams);
 	
 	bool getRelativeFilesInDirectoryRecursive(const std::string& searchDirectoryPath, const std::string& relativeDirectoryPath,
-											  unsigned int currentDepth, std::vector<std::string>& files) const;
+											  unsigned int currentDepth, FoundFileSink& files) const;
 	
-	virtual bool findFiles(std::vector<std::string>& foundFiles) = 0;	
+	// found files are added to foundFiles as they're found, so they can be processed while finding continues.
+	// returns false if no files were found.
+	virtual bool findFiles(FoundFileSink& foundFiles) = 0;	
 	
 protected:
 	const Config&			m_config;
@@ -63,7 +67,7 @@ public:
 							 const FilenameMatcher* pFilenameMatcher,
 							 const PatternSearch& patternSearch);
 	
-	virtual bool findFiles(std::vector<std::string>& foundFiles) override;
+	virtual bool findFiles(FoundFileSink& foundFiles) override;
 };
 
 //
@@ -75,7 +79,7 @@ public:
 											  const FilenameMatcher* pFilenameMatcher,
 											  const PatternSearch& patternSearch);
 	
-	virtual bool findFiles(std::vector<std::string>& foundFiles) override;
+	virtual bool findFiles(FoundFileSink& foundFiles) override;
 };
 
 //
@@ -87,24 +91,37 @@ public:
 													  const FilenameMatcher* pFilenameMatcher,
 													  const PatternSearch& patternSearch);
 	
-	virtual bool findFiles(std::vector<std::string>& foundFiles) override;
+	virtual bool findFiles(FoundFileSink& foundFiles) override;
 	
-	virtual void processTask(Task* pTask) override;
+	virtual void processTask(Task* pTask, unsigned int threadIndex) override;
 	
 	class WildcardDirTask : public Task
 	{
 	public:
-		WildcardDirTask(const std::string& dir, std::vector<std::string>& foundFiles) : m_dirItem(dir),
-			m_foundFiles(foundFiles)
+		WildcardDirTask(const std::string& dir, size_t taskIndex) : m_dirItem(dir),
+			m_taskIndex(taskIndex)
 		{
 			
 		}
 		
 		std::string		m_dirItem;
-		std::vector<std::string>& m_foundFiles;
+		size_t			m_taskIndex;
 	};
 	
 protected:
+	// passes on the found files of any tasks which have finished in order - m_foundFilesLock must be held
+	void passOnFinishedTaskFoundFiles();
+
+protected:
+	FoundFileSink*						m_pFoundFiles;
+
+	// one list per subdir/task, so that the found files can be passed on in the same order as if
+	// the subdirs were searched one after the other.
+	std::vector<std::vector<FoundFile> >	m_aTaskFoundFiles;
+	std::vector<bool>					m_aTaskFinished;
+	size_t								m_nextTaskToPassOn;
+	size_t								m_numFoundFiles;
+	std::mutex							m_foundFilesLock;
 };
 
 #endif // FILE_FINDERS_H
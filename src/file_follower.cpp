@@ -0,0 +1,423 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "file_follower.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "utils/file_helpers.h"
+
+#include "config.h"
+
+// the minimum time between processing changed files, so that files which are being written to constantly get
+// processed in batches of lines, rather than a line at a time (in milliseconds)
+static const uint64_t kMinProcessInterval = 250;
+
+static const uint32_t kInotifyWatchEvents = IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+
+FileFollower::FileFollower(const Config& config) : m_config(config),
+	m_grepper(config),
+	m_countMode(false),
+	m_initialFilesFound(false),
+	m_haveChangedFiles(false),
+	m_inotifyFD(-1),
+	m_printedWatchLimitWarning(false),
+	m_pollInterval((uint64_t)std::max(config.getFollowPollInterval(), 1u) * 1000),
+	m_rescanInterval((uint64_t)config.getFollowRescanInterval() * 1000),
+	m_lastPollTime(0),
+	m_lastRescanTime(0),
+	m_lastProcessTime(0),
+	m_rescanWanted(false)
+{
+	// the files being followed are being written to, and are quite likely to be truncated when they're rotated,
+	// and the appended parts are usually small anyway, so they're always just read
+	m_grepper.setAllowMemoryMapping(false);
+
+	m_inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotifyFD == -1)
+	{
+		fprintf(stderr, "Warning: inotify isn't available, so files will be polled for changes instead.\n");
+	}
+}
+
+FileFollower::~FileFollower()
+{
+	if (m_inotifyFD != -1)
+	{
+		// this removes all the watches as well
+		close(m_inotifyFD);
+		m_inotifyFD = -1;
+	}
+}
+
+bool FileFollower::initGrep(const std::string& contentsPattern, bool countMode, std::string& errorMessage)
+{
+	m_countMode = countMode;
+
+	return m_grepper.initSearch(contentsPattern, errorMessage);
+}
+
+void FileFollower::addFoundFile(const std::string& filename, uint64_t /*fileSize*/)
+{
+	if (m_fileIndices.find(filename) != m_fileIndices.end())
+		return;
+
+	FollowedFile newFile(filename);
+
+	// the directory needs watching before we look at the file, so that nothing written after that can be missed
+	newFile.polled = !watchFileDirectory(filename);
+
+	int fileDescriptor = open(filename.c_str(), O_RDONLY);
+	if (fileDescriptor != -1)
+	{
+		struct stat statState;
+		if (fstat(fileDescriptor, &statState) == 0)
+		{
+			newFile.device = statState.st_dev;
+			newFile.inode = statState.st_ino;
+			newFile.size = statState.st_size;
+			newFile.modifiedTime = statState.st_mtime;
+
+			// files which existed to start with are followed from the end of their last complete line, but files
+			// found after that are new, so everything in them is processed
+			if (!m_initialFilesFound)
+			{
+				newFile.offset = findLastLineEnd(fileDescriptor, 0, newFile.size);
+			}
+		}
+
+		close(fileDescriptor);
+	}
+
+	if (m_initialFilesFound)
+	{
+		newFile.changed = true;
+		m_haveChangedFiles = true;
+	}
+
+	m_fileIndices[filename] = m_aFiles.size();
+	m_aFiles.emplace_back(newFile);
+}
+
+void FileFollower::setInitialFilesFound()
+{
+	m_initialFilesFound = true;
+
+	uint64_t currentTime = getCurrentTime();
+	m_lastPollTime = currentTime;
+	m_lastRescanTime = currentTime;
+}
+
+bool FileFollower::waitForChanges()
+{
+	while (true)
+	{
+		uint64_t currentTime = getCurrentTime();
+
+		// new files created in the directories we're watching are looked for straight away (but not more often than
+		// we'd poll), otherwise we only look every so often, for ones in new directories
+		bool rescanDue = m_rescanInterval > 0 && currentTime >= m_lastRescanTime + m_rescanInterval;
+		if (rescanDue || (m_rescanWanted && currentTime >= m_lastRescanTime + m_pollInterval))
+		{
+			m_lastRescanTime = currentTime;
+			m_rescanWanted = false;
+			return true;
+		}
+
+		if (currentTime >= m_lastPollTime + m_pollInterval)
+		{
+			m_lastPollTime = currentTime;
+			pollFiles();
+		}
+
+		uint64_t waitUntil = m_lastPollTime + m_pollInterval;
+
+		if (m_haveChangedFiles)
+		{
+			if (currentTime >= m_lastProcessTime + kMinProcessInterval)
+				return false;
+
+			waitUntil = std::min(waitUntil, m_lastProcessTime + kMinProcessInterval);
+		}
+
+		int waitTime = (int)(waitUntil - currentTime);
+
+		if (m_inotifyFD == -1)
+		{
+			usleep(waitTime * 1000);
+			continue;
+		}
+
+		struct pollfd pollState;
+		pollState.fd = m_inotifyFD;
+		pollState.events = POLLIN;
+		pollState.revents = 0;
+
+		if (poll(&pollState, 1, waitTime) > 0)
+		{
+			readInotifyEvents();
+		}
+	}
+}
+
+void FileFollower::processChangedFiles()
+{
+	if (!m_haveChangedFiles)
+		return;
+
+	m_haveChangedFiles = false;
+
+	for (FollowedFile& file : m_aFiles)
+	{
+		if (file.changed)
+		{
+			processFile(file);
+		}
+	}
+
+	fflush(stdout);
+
+	m_lastProcessTime = getCurrentTime();
+}
+
+bool FileFollower::watchFileDirectory(const std::string& filename)
+{
+	// files are looked up by their directory and name from the watch events, so the directory has to be exactly
+	// the same as it is in the filename
+	std::string directory = FileHelpers::getFileDirectory(filename);
+
+	std::map<std::string, bool>::const_iterator itDirectory = m_directoryWatched.find(directory);
+	if (itDirectory != m_directoryWatched.end())
+		return itDirectory->second;
+
+	const std::string directoryPath = directory.empty() ? "." : directory;
+
+	bool watched = false;
+
+	// changes made on other machines aren't seen by inotify on network file systems
+	if (m_inotifyFD != -1 && !FileHelpers::isNetworkFileSystem(directoryPath))
+	{
+		int watchDescriptor = inotify_add_watch(m_inotifyFD, directoryPath.c_str(), kInotifyWatchEvents);
+		if (watchDescriptor != -1)
+		{
+			m_watchedDirectories[watchDescriptor] = directory;
+			watched = true;
+		}
+		else if (errno == ENOSPC && !m_printedWatchLimitWarning)
+		{
+			fprintf(stderr, "Warning: ran out of inotify watches (see /proc/sys/fs/inotify/max_user_watches), so any further "
+							"directories will be polled for changes instead.\n");
+			m_printedWatchLimitWarning = true;
+		}
+	}
+
+	m_directoryWatched[directory] = watched;
+
+	return watched;
+}
+
+void FileFollower::readInotifyEvents()
+{
+	char buffer[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (true)
+	{
+		ssize_t readAmount = read(m_inotifyFD, buffer, sizeof(buffer));
+		if (readAmount <= 0)
+			break;
+
+		const char* pos = buffer;
+		const char* end = buffer + readAmount;
+
+		while (pos < end)
+		{
+			const struct inotify_event* pEvent = (const struct inotify_event*)pos;
+			pos += sizeof(struct inotify_event) + pEvent->len;
+
+			if (pEvent->mask & IN_Q_OVERFLOW)
+			{
+				// events have been lost, so we don't know what's changed
+				for (FollowedFile& file : m_aFiles)
+				{
+					file.changed = true;
+				}
+				m_haveChangedFiles = true;
+				m_rescanWanted = true;
+				continue;
+			}
+
+			std::map<int, std::string>::iterator itDirectory = m_watchedDirectories.find(pEvent->wd);
+			if (itDirectory == m_watchedDirectories.end())
+				continue;
+
+			if (pEvent->mask & IN_IGNORED)
+			{
+				// the directory's gone (or been unmounted), so the files in it will have to be polled from now on
+				const std::string& directory = itDirectory->second;
+				for (FollowedFile& file : m_aFiles)
+				{
+					if (!file.polled && FileHelpers::getFileDirectory(file.filename) == directory)
+					{
+						file.polled = true;
+					}
+				}
+
+				m_directoryWatched[directory] = false;
+				m_watchedDirectories.erase(itDirectory);
+				continue;
+			}
+
+			if (pEvent->len == 0)
+				continue;
+
+			std::string path = FileHelpers::combinePaths(itDirectory->second, pEvent->name);
+			std::map<std::string, size_t>::const_iterator itFile = m_fileIndices.find(path);
+			if (itFile != m_fileIndices.end())
+			{
+				m_aFiles[itFile->second].changed = true;
+				m_haveChangedFiles = true;
+			}
+			else if (pEvent->mask & (IN_CREATE | IN_MOVED_TO))
+			{
+				m_rescanWanted = true;
+			}
+		}
+	}
+}
+
+void FileFollower::pollFiles()
+{
+	for (FollowedFile& file : m_aFiles)
+	{
+		if (!file.polled || file.changed)
+			continue;
+
+		struct stat statState;
+		if (stat(file.filename.c_str(), &statState) != 0)
+			continue;
+
+		if ((uint64_t)statState.st_size != file.size || statState.st_mtime != file.modifiedTime ||
+			(uint64_t)statState.st_ino != file.inode || (uint64_t)statState.st_dev != file.device)
+		{
+			file.changed = true;
+			m_haveChangedFiles = true;
+		}
+	}
+}
+
+void FileFollower::processFile(FollowedFile& file)
+{
+	file.changed = false;
+
+	// if it's been deleted, a replacement will have a different inode, so will be processed from the start
+	int fileDescriptor = open(file.filename.c_str(), O_RDONLY);
+	if (fileDescriptor == -1)
+		return;
+
+	struct stat statState;
+	if (fstat(fileDescriptor, &statState) != 0)
+	{
+		close(fileDescriptor);
+		return;
+	}
+
+	if ((uint64_t)statState.st_ino != file.inode || (uint64_t)statState.st_dev != file.device)
+	{
+		// it's been replaced (e.g. by log rotation), so it's a new file
+		file.device = statState.st_dev;
+		file.inode = statState.st_ino;
+		file.offset = 0;
+	}
+	else if ((uint64_t)statState.st_size < file.offset)
+	{
+		// it's been truncated, so start again from the beginning
+		file.offset = 0;
+	}
+
+	file.size = statState.st_size;
+	file.modifiedTime = statState.st_mtime;
+
+	// only complete lines are processed - any line still being written is done next time
+	uint64_t linesEnd = file.offset;
+	if (file.size > file.offset)
+	{
+		linesEnd = findLastLineEnd(fileDescriptor, file.offset, file.size);
+	}
+
+	close(fileDescriptor);
+
+	if (linesEnd == file.offset)
+		return;
+
+	m_grepper.setReadRange(file.offset, linesEnd - file.offset);
+
+	if (m_countMode)
+	{
+		m_grepper.countBasic(file.filename);
+	}
+	else
+	{
+		m_grepper.grepBasic(file.filename);
+	}
+
+	m_grepper.setReadRange(0, UINT64_MAX);
+
+	file.offset = linesEnd;
+}
+
+uint64_t FileFollower::findLastLineEnd(int fileDescriptor, uint64_t rangeStart, uint64_t rangeEnd)
+{
+	char buffer[4096];
+
+	uint64_t searchEnd = rangeEnd;
+	while (searchEnd > rangeStart)
+	{
+		size_t readSize = (size_t)std::min((uint64_t)sizeof(buffer), searchEnd - rangeStart);
+		uint64_t readStart = searchEnd - readSize;
+
+		ssize_t readAmount = pread(fileDescriptor, buffer, readSize, readStart);
+		if (readAmount != (ssize_t)readSize)
+			break;
+
+		const char* newLine = (const char*)memrchr(buffer, '\n', readSize);
+		if (newLine)
+			return readStart + (newLine - buffer) + 1;
+
+		searchEnd = readStart;
+	}
+
+	return rangeStart;
+}
+
+uint64_t FileFollower::getCurrentTime()
+{
+	struct timespec currentTime;
+	clock_gettime(CLOCK_MONOTONIC, &currentTime);
+
+	return (uint64_t)currentTime.tv_sec * 1000 + currentTime.tv_nsec / 1000000;
+}
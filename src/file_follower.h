@@ -0,0 +1,130 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef FILE_FOLLOWER_H
+#define FILE_FOLLOWER_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "file_grepper.h"
+#include "found_files.h"
+
+class Config;
+
+// Keeps following a set of files as they grow, running grep or count on just the lines appended to each file
+// since it was last processed, so that it's cheap to keep watching lots of active logs.
+// Found files are added to it (by the file finder, which can be re-run to pick up any new files), with files from
+// the first find being followed from their current end, and files found after that from their start.
+// Changes are waited for with inotify watches on the directories the files are in, other than for files on network
+// file systems (where inotify doesn't see changes made by other machines), or if inotify isn't available, in which
+// case their size and modification time are polled instead.
+// Only complete lines are processed, so a line which is still being written is processed once its end is written.
+
+class FileFollower : public FoundFileSink
+{
+public:
+	FileFollower(const Config& config);
+	virtual ~FileFollower();
+
+	// returns false if the pattern was invalid, with errorMessage set if there's anything more specific to say
+	bool initGrep(const std::string& contentsPattern, bool countMode, std::string& errorMessage);
+
+	virtual void addFoundFile(const std::string& filename, uint64_t fileSize) override;
+
+	// files found from now on are processed from their start, as they're new
+	void setInitialFilesFound();
+
+	size_t getFileCount() const
+	{
+		return m_aFiles.size();
+	}
+
+	// waits until some files have changed, or it's time to look for new files, in which case it returns true
+	bool waitForChanges();
+
+	// processes the lines appended to any files which have changed
+	void processChangedFiles();
+
+protected:
+	struct FollowedFile
+	{
+		FollowedFile(const std::string& fileFilename) : filename(fileFilename), offset(0), device(0), inode(0),
+			size(0), modifiedTime(0), polled(false), changed(false)
+		{
+		}
+
+		std::string		filename;
+		uint64_t		offset;		// of the next line to process
+
+		// so that we can tell if the file's been replaced (e.g. by log rotation)
+		uint64_t		device;
+		uint64_t		inode;
+
+		// for polling, the last size and modification time seen
+		uint64_t		size;
+		time_t			modifiedTime;
+
+		bool			polled;		// whether changes need polling for, rather than coming from inotify
+		bool			changed;
+	};
+
+	// returns false if it couldn't be watched (so needs polling)
+	bool watchFileDirectory(const std::string& filename);
+
+	void readInotifyEvents();
+	void pollFiles();
+
+	void processFile(FollowedFile& file);
+
+	// returns the offset after the last '\n' within the range of the file, or rangeStart if there isn't one
+	static uint64_t findLastLineEnd(int fileDescriptor, uint64_t rangeStart, uint64_t rangeEnd);
+
+	// in milliseconds
+	static uint64_t getCurrentTime();
+
+protected:
+	const Config&					m_config;
+
+	FileGrepper						m_grepper;
+	bool							m_countMode;
+
+	std::vector<FollowedFile>		m_aFiles;
+	std::map<std::string, size_t>	m_fileIndices;
+	bool							m_initialFilesFound;
+	bool							m_haveChangedFiles;
+
+	int								m_inotifyFD;
+	std::map<int, std::string>		m_watchedDirectories;	// the directory for each inotify watch
+	std::map<std::string, bool>		m_directoryWatched;		// whether each directory could be watched
+	bool							m_printedWatchLimitWarning;
+
+	uint64_t						m_pollInterval;		// both in milliseconds
+	uint64_t						m_rescanInterval;
+	uint64_t						m_lastPollTime;
+	uint64_t						m_lastRescanTime;
+	uint64_t						m_lastProcessTime;
+	// a file's been created within a watched directory which we don't know about, which could be a new file to follow
+	bool							m_rescanWanted;
+};
+
+#endif // FILE_FOLLOWER_H
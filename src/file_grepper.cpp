@@ -21,348 +21,554 @@
 #include <cstring>
 #include <ctime>
 
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "utils/string_helpers.h"
 
 #include "config.h"
+#include "output_merger.h"
 
-// somewhat arbitrary, and obviously not perfect, but good enough for now...
-static const unsigned int kStringLength = 2048;
+static const unsigned int kMinReadBlockSizeKB = 4;
 
-//static const unsigned int kNumDaysInMonths[12] =			{ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-//static const unsigned int kNumDaysInMonthsLeapYear[12] =	{ 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+// the size of each read while binary searching for time windows
+static const size_t kTimeWindowProbeSize = 4 * 1024;
 
-// pre-calculated totals for numbers of days from start of year for each month
-static const unsigned int kCumulativeDaysInYearForMonth[12] =			{ 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
-static const unsigned int kCumulativeDaysInYearForMonthLeapYear[12] =	{ 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 };
+// how much output to buffer up before trying to pass it on to the output merger
+static const size_t kOutputBufferPassOnSize = 64 * 1024;
 
 FileGrepper::FileGrepper(const Config& config) : m_config(config),
-	m_readBufferSize(8192),
-	m_pReadBuffer(nullptr),
-	m_cacheBeforeLines(false),
+	m_trackLineNumbers(false),
+	m_outputBeforeLines(false),
+	m_lastOutputContentLine(0),
+	m_combineShortCircuit(false),
+	m_matchType(eMatchTypeOr),
+	m_matchRegex(false),
 	m_shortCircuit(false),
-	m_logTimestampSurround(true),
-	m_logTimestampBeforeChar('['),
-	m_logTimestampAfterChar(']'),
-	m_logTimestampMinLineLength(0)
-{
-	// default on Linux is 8192, but increasing this gives a bit of a performance boost, especially
-	// for reading files across a network...
-	m_readBufferSize = config.getFileReadBufferSize() * 1024;
-	m_pReadBuffer = new char[m_readBufferSize];
-
-	// disable C++ sync with stdio (C) - this can speed up getline() quite a bit...
-	// we can do this as we only use C++ stuff for file reading (currently),
-	// and C stuff for output, so we don't care about synchronisation between the two
-	
-	// Note: valgrind and heaptrack show a "leak" from this, but it's not really a leak,
-	//       it's an implementation detail...
-	std::ios::sync_with_stdio(false);
-	
-	if (m_config.getBeforeLines() > 0)
+	m_maxShortCircuitStringLength(0),
+	m_pChunk(nullptr),
+	m_readRangeStart(0),
+	m_readRangeLength(UINT64_MAX),
+	m_pOutputMerger(nullptr),
+	m_outputFileIndex(0),
+	m_outputBufferPassOnSize(kOutputBufferPassOnSize),
+	m_outputWantsFileSeparator(false)
+{
+	// larger blocks mean fewer read() calls and less per-block overhead, which is especially
+	// worthwhile when reading files across a network...
+	size_t blockSize = std::max(config.getFileReadBufferSize(), kMinReadBlockSizeKB) * 1024;
+	m_blockReader.init(blockSize);
+	m_blockReader.setAllowMemoryMapping(config.getMemoryMapFiles());
+
+	if (config.getIoUringQueueDepth() > 0 && !m_blockReader.enableIoUring(config.getIoUringQueueDepth()))
 	{
-		m_cacheBeforeLines = true;
-		// allocate one extra, as otherwise we can overwrite a previous line we need as the current line
-		// we're processing currently occupies one buffer slot
-		m_stringBuffer.init(m_config.getBeforeLines() + 1, kStringLength);
+		// greppers are all created up-front on the main thread, so this only needs printing once
+		static bool printedWarning = false;
+		if (!printedWarning)
+		{
+			fprintf(stderr, "Warning: io_uring isn't available, so files will be read normally.\n");
+			printedWarning = true;
+		}
 	}
 	
-	if (!m_config.getShortCircuitString().empty())
-	{
-		m_shortCircuit = true;
-		m_shortCircuitString = m_config.getShortCircuitString();
-	}
+	m_outputBeforeLines = m_config.getBeforeLines() > 0;
+
+	m_trackLineNumbers = m_config.getOutputLineNumbers() || m_outputBeforeLines;
 	
-	size_t timestampFind = m_config.getLogTimestampFormat().find("%ts%");
-	if (timestampFind != std::string::npos)
+	if (!m_config.getShortCircuitStrings().empty())
 	{
-		if (timestampFind == 0 && m_config.getLogTimestampFormat().size() == 4)
-		{
-			m_logTimestampSurround = false; // no surrounding lines, just the timestamp on its own
-			m_logTimestampMinLineLength = 19;
-		}
-		else if (timestampFind == 1 && m_config.getLogTimestampFormat().size() == 6)
-		{
-			m_logTimestampSurround = true;
-			m_logTimestampMinLineLength = 21;
-			m_logTimestampBeforeChar = m_config.getLogTimestampFormat()[0];
-			m_logTimestampAfterChar = m_config.getLogTimestampFormat()[m_config.getLogTimestampFormat().size() - 1];
-		}
-		else
+		m_shortCircuit = m_shortCircuitSearcher.init(m_config.getShortCircuitStrings());
+
+		for (const std::string& shortCircuitString : m_config.getShortCircuitStrings())
 		{
-			// not supported
+			m_maxShortCircuitStringLength = std::max(m_maxShortCircuitStringLength, shortCircuitString.size());
 		}
 	}
+	
+	// the format's already been checked by Config
+	std::string errorMessage;
+	m_timestampParser.init(m_config.getLogTimestampFormat(), errorMessage);
 }
 
 FileGrepper::~FileGrepper()
 {
-	if (m_pReadBuffer)
+
+}
+
+bool FileGrepper::initSearch(const std::string& searchString, std::string& errorMessage)
+{
+	const bool caseInsensitive = m_config.getCaseInsensitive();
+
+	if (m_config.getRegexSearch())
+	{
+		// the short circuit strings can't be searched for in the same pass as a regex, so they're
+		// searched for separately for each block instead
+		m_combineShortCircuit = false;
+		return m_searcher.initRegex(searchString, errorMessage, caseInsensitive);
+	}
+
+	m_searcher.init(searchString, Searcher::eAlgorithmAuto, caseInsensitive);
+
+	// similarly, the short circuit strings are case sensitive, so can't be searched for in the same pass
+	// as a case insensitive search string
+	m_combineShortCircuit = m_shortCircuit && !m_searcher.isCaseInsensitive();
+	if (m_combineShortCircuit)
 	{
-		delete m_pReadBuffer;
-		m_pReadBuffer = nullptr;
+		initCombinedSearcher(m_searchCombinedSearcher, std::vector<std::string>(1, searchString));
 	}
+
+	return true;
 }
 
-bool FileGrepper::initMatch(const std::string& matchString)
+bool FileGrepper::initMatch(const std::string& matchString, std::string& errorMessage)
 {
 	// currently the assumption is all operators are the same, but in the future this could be extended
 	// to support different ones and parentheses.
 	
+	std::vector<std::string> matchItemStrings;
+
 	if (matchString.find(m_config.getMatchItemOrSeperatorChar()) != std::string::npos)
 	{
 		m_matchType = eMatchTypeOr;
 		std::string matchChar = "|";
 		matchChar[0] = m_config.getMatchItemOrSeperatorChar();
-		StringHelpers::split(matchString, m_aMatchItems, matchChar);
+		StringHelpers::split(matchString, matchItemStrings, matchChar);
 	}
 	else if (matchString.find(m_config.getMatchItemAndSeperatorChar()) != std::string::npos)
 	{
 		m_matchType = eMatchTypeAnd;
 		std::string matchChar = "&";
 		matchChar[0] = m_config.getMatchItemAndSeperatorChar();
-		StringHelpers::split(matchString, m_aMatchItems, matchChar);
+		StringHelpers::split(matchString, matchItemStrings, matchChar);
 	}
 	else
 	{
 		return false;
 	}
 	
-	if (m_aMatchItems.empty())
+	if (matchItemStrings.empty())
 		return false;
+
+	m_matchRegex = m_config.getRegexSearch();
+	const bool caseInsensitive = m_config.getCaseInsensitive();
+
+	// the short circuit strings can't be searched for in the same pass as regexes or case insensitive items
+	m_combineShortCircuit = m_shortCircuit && !m_matchRegex && !caseInsensitive;
+
+	if (m_matchRegex)
+	{
+		// check each item on its own first, so that any error is for the item with the problem
+		Searcher itemSearcher;
+		for (const std::string& matchItemString : matchItemStrings)
+		{
+			if (!itemSearcher.initRegex(matchItemString, errorMessage, caseInsensitive))
+				return false;
+		}
+	}
+
+	if (m_matchType == eMatchTypeOr)
+	{
+		if (m_matchRegex)
+		{
+			// all the items are searched for together in one pass, as alternatives of a single regex
+			std::string combinedPattern;
+			for (const std::string& matchItemString : matchItemStrings)
+			{
+				if (!combinedPattern.empty())
+				{
+					combinedPattern += "|";
+				}
+				combinedPattern += "(?:" + matchItemString + ")";
+			}
+
+			return m_matchOrRegexSearcher.initRegex(combinedPattern, errorMessage, caseInsensitive);
+		}
+
+		// all the items are searched for together in one pass
+		if (!m_matchOrSearcher.init(matchItemStrings, caseInsensitive))
+			return false;
+
+		if (m_combineShortCircuit)
+		{
+			initCombinedSearcher(m_matchOrCombinedSearcher, matchItemStrings);
+		}
+
+		return true;
+	}
+
+	m_aMatchItems.clear();
+	m_aMatchAndCombinedSearchers.clear();
+	for (const std::string& matchItemString : matchItemStrings)
+	{
+		m_aMatchItems.emplace_back(Searcher());
+
+		if (m_matchRegex)
+		{
+			m_aMatchItems.back().initRegex(matchItemString, errorMessage, caseInsensitive);
+			continue;
+		}
+
+		m_aMatchItems.back().init(matchItemString, Searcher::eAlgorithmAuto, caseInsensitive);
+
+		if (m_combineShortCircuit)
+		{
+			m_aMatchAndCombinedSearchers.emplace_back(CombinedSearcher());
+			initCombinedSearcher(m_aMatchAndCombinedSearchers.back(), std::vector<std::string>(1, matchItemString));
+		}
+	}
 		
 	return true;
 }
 
-bool FileGrepper::grepBasic(const std::string& filename, const std::string& searchString, bool foundPreviousFile)
+
+bool FileGrepper::grepBasic(const std::string& filename, bool limitToMatchCount)
 {
-	// slow and basic search...
-	std::fstream fileStream;
-	if (!openFileStream(filename, fileStream))
+	if (!openFile(filename))
 		return false;
 
 	int foundCount = 0;
 
 	unsigned int afterLinesToPrint = 0;
 
-	char buf[kStringLength];
-
 	unsigned int lineIndex = 1; // start at one as this value is only used for printing line number purposes
 
 	bool shouldShortCircuit = false;
 
-	// make a note of the list line we printed output lines for so we can prevent outputting lines multiple times
-	// when context (before and after) content line output is enabled.
-	unsigned int lastOutputContentLine = 0;
+	// once we've found enough items, we only continue to print any remaining after lines for the last one
+	bool haveFoundEnoughItems = false;
+	bool finished = false;
+
+	const Searcher& searcher = m_searcher;
 
-	while (fileStream.getline(buf, kStringLength))
+	const CombinedSearcher* pCombinedSearcher = m_combineShortCircuit ? &m_searchCombinedSearcher : nullptr;
+
+	resetContextLines();
+
+	while (!finished && !shouldShortCircuit && m_blockReader.readNextBlock())
 	{
-		if (m_cacheBeforeLines)
+		const char* pos = m_blockReader.getBlockStart();
+		// if we find a short circuit string, this gets moved back to the end of its line, as we only need to
+		// process up to (and including) that line
+		const char* scanEnd = m_blockReader.getBlockEnd();
+
+		if (m_shortCircuit && !pCombinedSearcher)
 		{
-			char* nextBeforeBuffer = m_stringBuffer.getNextBuffer();
-			// TODO: we could get rid of this strcpy() if we did the fileStream.getline() directly into the nextBeforeBuffer itself...
-			strcpy(nextBeforeBuffer, buf);
+			limitToShortCircuitLine(pos, scanEnd, shouldShortCircuit);
 		}
 
-		const char* findI = strstr(buf, searchString.c_str());
-
-		if (m_shortCircuit && !shouldShortCircuit)
+		while (pos < scanEnd)
 		{
-			const char* findSCI = strstr(buf, m_shortCircuitString.c_str());
-			if (findSCI != nullptr)
+			const char* lineStart = pos;
+			const char* lineEnd = nullptr;
+			bool lineMatches = false;
+
+			if (afterLinesToPrint > 0)
 			{
-				shouldShortCircuit = true;
+				// we need to go line-by-line while printing after lines, as we need to print the next lines
+				// whether they match or not
+				lineEnd = BlockReader::findLineEnd(pos, scanEnd);
+				lineMatches = !haveFoundEnoughItems &&
+						searcher.find(lineStart, lineEnd) != nullptr;
+
+				checkLineForShortCircuit(lineStart, lineEnd, scanEnd, shouldShortCircuit);
 			}
-		}
-		
-		if (findI != nullptr)
-		{
-			// we found the string
-			
-			if (m_config.getOutputFilename())
+			else
 			{
-				if (m_config.getOutputContentLines())
+				// search the remainder of the block in one go
+				const char* found = pCombinedSearcher ? findWithShortCircuit(*pCombinedSearcher, pos, scanEnd, shouldShortCircuit) :
+														searcher.find(pos, scanEnd);
+				if (found == nullptr)
 				{
-					// the filename if it's the first time for this file
-					if (foundCount == 0)
+					if (m_trackLineNumbers)
+					{
+						lineIndex += BlockReader::countLines(pos, scanEnd);
+					}
+					break;
+				}
+
+				lineStart = BlockReader::findLineStart(pos, found);
+				lineEnd = BlockReader::findLineEnd(found, scanEnd);
+				lineMatches = true;
+
+				if (m_trackLineNumbers)
+				{
+					lineIndex += BlockReader::countLines(pos, lineStart);
+				}
+			}
+
+			pos = lineEnd + 1;
+
+			if (lineMatches)
+			{
+				// we found the string
+
+				if (m_config.getOutputFilename())
+				{
+					if (m_config.getOutputContentLines())
 					{
-						if (foundPreviousFile && m_config.getBlankLinesBetweenFiles())
+						// the filename if it's the first time for this file
+						if (foundCount == 0)
 						{
-							fprintf(stdout, "\n");
+							outputFileSeparator();
+							outputFilename(filename);
 						}
-						fprintf(stdout, "%s :\n", filename.c_str());
-
-						foundCount = 1;
 					}
 					else
-					{
-						foundCount ++;
-					}
-					
-					// as we found the item, reset the after line content count item
-					afterLinesToPrint = m_config.getAfterLines();
-				}
-				else
-				{
-					if (foundCount == 0)
 					{
 						// technically, we should do a new line if asked, but doesn't seem worth it if we're not outputting
 						// the contents...
 
 						// just the filename
-						fprintf(stdout, "%s\n", filename.c_str());
+						outputFilename(filename);
 
 						foundCount = 1;
 
 						// we don't want the content lines, so we can just break out as we don't need to do anything else...
+						finished = true;
 						break;
 					}
-					else
-					{
-						foundCount ++;
-					}
 				}
-			}
-			else
-			{
+
 				foundCount ++;
-			}
 
-			if (m_config.getOutputContentLines())
-			{
-				// see if we need to output before lines first
-				if (m_cacheBeforeLines)
+				if (m_config.getOutputContentLines())
 				{
-					unsigned int minLine = lineIndex - 1; // lineIndex starts at 1, so can't be 0
-					// check lastOutputContentLine to make sure we don't output lines multiple times
-					unsigned int lastOutputLineDiff = minLine - lastOutputContentLine;
-					minLine = std::min(minLine, lastOutputLineDiff);
-					unsigned int beforeLinesToPrint = std::min(m_config.getBeforeLines(), minLine);
-
-					for (unsigned int i = beforeLinesToPrint; i > 0; i--)
-					{
-						const char* prevBuffer = m_stringBuffer.getPreviousBuffer(i);
-
-						if (m_config.getOutputLineNumbers())
-						{
-							fprintf(stdout, "%u: %s\n", lineIndex - i, prevBuffer);
-						}
-						else
-						{
-							fprintf(stdout, "%s\n", prevBuffer);
-						}
-					}
-				}
+					outputMatchingLine(m_blockReader.getBlockStart(), lineIndex, lineStart, lineEnd);
 
-				if (m_config.getOutputLineNumbers())
-				{
-					fprintf(stdout, "%u: %s\n", lineIndex, buf);
+					// as we found the item, reset the after line content count item
+					afterLinesToPrint = m_config.getAfterLines();
 				}
 				else
 				{
-					fprintf(stdout, "%s\n", buf);
+					// we can break out.
+					finished = true;
+					break;
 				}
 
-				lastOutputContentLine = lineIndex;
-			}
-			
-			bool haveFoundEnoughItems = m_config.getMatchCount() != -1 && foundCount >= m_config.getMatchCount();
+				haveFoundEnoughItems = limitToMatchCount && m_config.getMatchCount() != -1 && foundCount >= m_config.getMatchCount();
 
-			if ((haveFoundEnoughItems && afterLinesToPrint == 0) || !m_config.getOutputContentLines())
+				if (haveFoundEnoughItems && afterLinesToPrint == 0)
+				{
+					finished = true;
+					break;
+				}
+			}
+			else
 			{
-				// we can break out.
-				break;
+				// otherwise, it's an after line we need to output
+				outputAfterLine(lineIndex, lineStart, lineEnd);
+
+				afterLinesToPrint--;
+
+				if (haveFoundEnoughItems && afterLinesToPrint == 0)
+				{
+					finished = true;
+					break;
+				}
 			}
+
+			lineIndex ++;
+		}
+
+		if (!finished && !shouldShortCircuit)
+		{
+			carryOverBeforeLines(m_blockReader.getBlockStart(), scanEnd);
 		}
-		else if (m_config.getOutputContentLines() && afterLinesToPrint > 0)
+	}
+
+	m_blockReader.closeFile();
+
+	setChunkResults(foundCount, lineIndex - 1, shouldShortCircuit);
+
+	if (foundCount > 0)
+	{
+		flushOutput();
+
+		return true;
+	}
+
+	return false;
+}
+
+bool FileGrepper::grepLast(const std::string& filename)
+{
+	const unsigned int numMatches = m_config.getMatchCount() > 0 ? m_config.getMatchCount() : 1;
+
+	// once we know where the last matches start (along with their before lines), we just grep forwards from there,
+	// which outputs them (and their context lines) in the normal way. This isn't limited to the match count, as
+	// any before lines of the first one might match as well.
+	uint64_t startOffset = 0;
+	if (!findLastMatchesStart(filename, numMatches, startOffset))
+		return false;
+
+	const uint64_t rangeStart = m_readRangeStart;
+	const uint64_t rangeLength = m_readRangeLength;
+
+	m_readRangeStart = startOffset;
+	m_readRangeLength = (rangeLength == UINT64_MAX) ? UINT64_MAX : rangeStart + rangeLength - startOffset;
+
+	bool foundInFile = grepBasic(filename, false);
+
+	m_readRangeStart = rangeStart;
+	m_readRangeLength = rangeLength;
+
+	return foundInFile;
+}
+
+bool FileGrepper::findLastMatchesStart(const std::string& filename, unsigned int numMatches, uint64_t& startOffset)
+{
+	if (!m_blockReader.openFileRangeReverse(filename, m_readRangeStart, m_readRangeLength))
+		return false;
+
+	unsigned int matchesFound = 0;
+	// once all the matches have been found, how many before lines we still need to go back
+	unsigned int beforeLinesNeeded = 0;
+	bool reachedStart = true;
+
+	while (m_blockReader.readPreviousBlock())
+	{
+		const char* blockStart = m_blockReader.getBlockStart();
+		const char* blockEnd = m_blockReader.getBlockEnd();
+		const char* linesEnd = blockEnd;
+
+		if (matchesFound < numMatches)
 		{
-			// if we've found it before, we need to output additional lines...
-			if (m_config.getOutputLineNumbers())
+			// the searchers only go forwards, so we find all the matching lines in the block, and take the last ones
+			m_aBlockMatchLines.clear();
+
+			const char* pos = blockStart;
+			while (pos < blockEnd)
 			{
-				fprintf(stdout, "%u: %s\n", lineIndex, buf);
+				const char* found = m_searcher.find(pos, blockEnd);
+				if (found == nullptr)
+					break;
+
+				m_aBlockMatchLines.emplace_back(BlockReader::findLineStart(pos, found));
+				pos = BlockReader::findLineEnd(found, blockEnd) + 1;
 			}
-			else
+
+			if (m_aBlockMatchLines.size() < numMatches - matchesFound)
 			{
-				fprintf(stdout, "%s\n", buf);
+				matchesFound += m_aBlockMatchLines.size();
+				continue;
 			}
 
-			lastOutputContentLine = lineIndex;
+			const char* firstMatchLine = m_aBlockMatchLines[m_aBlockMatchLines.size() - (numMatches - matchesFound)];
+			matchesFound = numMatches;
 
-			afterLinesToPrint--;
+			startOffset = m_blockReader.getBlockFileOffset() + (firstMatchLine - blockStart);
+			beforeLinesNeeded = m_config.getBeforeLines();
+			linesEnd = firstMatchLine;
 		}
 
-		if (shouldShortCircuit)
+		if (beforeLinesNeeded > 0)
 		{
-			break;
+			unsigned int numLines = beforeLinesNeeded;
+			const char* linesStart = BlockReader::findLastLinesStart(blockStart, linesEnd, numLines);
+			startOffset = m_blockReader.getBlockFileOffset() + (linesStart - blockStart);
+			beforeLinesNeeded -= numLines;
 		}
 
-		lineIndex ++;
+		if (beforeLinesNeeded == 0)
+		{
+			reachedStart = false;
+			break;
+		}
 	}
 
-	fileStream.close();
+	m_blockReader.closeFile();
 
-	if (foundCount > 0)
+	if (matchesFound > 0 && reachedStart)
 	{
-		if (m_config.getFlushOutput())
-		{
-			fflush(stdout);
-		}
-
-		return true;
+		// there weren't enough matches (or before lines for them), so it's all of them from the start
+		startOffset = m_readRangeStart;
 	}
 
-	return false;
+	return matchesFound > 0;
 }
 
-bool FileGrepper::countBasic(const std::string& filename, const std::string& searchString)
+bool FileGrepper::countBasic(const std::string& filename)
 {
-	// slow and basic search...
-	std::fstream fileStream;
-	if (!openFileStream(filename, fileStream))
+	if (!openFile(filename))
 		return false;
+
+	// this doesn't need to care about lines at all (other than for the short circuit line, and to only count
+	// each matching line once when not counting all occurrences), so the blocks are just scanned directly.
+
+	const bool countAllOccurrences = m_config.getCountAllOccurrences();
+
+	const Searcher& searcher = m_searcher;
+
+	const CombinedSearcher* pCombinedSearcher = m_combineShortCircuit ? &m_searchCombinedSearcher : nullptr;
 	
 	unsigned int foundCount = 0;
-	
-	char buf[kStringLength];
 
-	while (fileStream.getline(buf, kStringLength))
+	bool shouldShortCircuit = false;
+
+	while (!shouldShortCircuit && m_blockReader.readNextBlock())
 	{
-		const char* findI = strstr(buf, searchString.c_str());
-		
-		if (findI == nullptr)
+		const char* pos = m_blockReader.getBlockStart();
+		const char* scanEnd = m_blockReader.getBlockEnd();
+
+		if (m_shortCircuit && !pCombinedSearcher)
 		{
-			if (m_shortCircuit)
+			limitToShortCircuitLine(pos, scanEnd, shouldShortCircuit);
+		}
+
+		if (countAllOccurrences)
+		{
+			if (pCombinedSearcher)
 			{
-				findI = strstr(buf, m_shortCircuitString.c_str());
-				if (findI != nullptr)
+				// skip to the first occurrence of either the string or a short circuit string in the same pass,
+				// but as the string could be very common, rather than then going line by line, just find where the
+				// short circuit line ends (if anywhere) in the rest of the block, and count everything up to there
+				const char* found = findWithShortCircuit(*pCombinedSearcher, pos, scanEnd, shouldShortCircuit);
+				if (found == nullptr)
+					continue;
+
+				if (!shouldShortCircuit)
 				{
-					break;
+					const char* shortCircuitLine = findShortCircuitLine(getShortCircuitOverlapStart(pos, found), scanEnd);
+					if (shortCircuitLine != nullptr)
+					{
+						scanEnd = BlockReader::findLineEnd(shortCircuitLine, scanEnd);
+						shouldShortCircuit = true;
+					}
 				}
+
+				pos = found;
 			}
+
+			foundCount += countOccurrences(searcher, pos, scanEnd);
 			continue;
 		}
-		
-		// otherwise, we found the string
-		foundCount ++;
+
+		while (pos < scanEnd)
+		{
+			const char* found = pCombinedSearcher ? findWithShortCircuit(*pCombinedSearcher, pos, scanEnd, shouldShortCircuit) :
+													searcher.find(pos, scanEnd);
+			if (found == nullptr)
+				break;
+
+			// we found the string, so count it, and carry on from the next line
+			foundCount ++;
+
+			pos = BlockReader::findLineEnd(found, scanEnd) + 1;
+		}
 	}
 
-	fileStream.close();
+	m_blockReader.closeFile();
+
+	setChunkResults(foundCount, 0, shouldShortCircuit);
 
 	if (foundCount > 0)
 	{
-		// can't really think of a useful use-case where you wouldn't want the filename, but...
-		if (m_config.getOutputFilename())
-		{
-			fprintf(stdout, "%u: %s\n", foundCount, filename.c_str());
-		}
-		else
-		{
-			fprintf(stdout, "%u\n", foundCount);
-		}
-		
-		if (m_config.getFlushOutput())
-		{
-			fflush(stdout);
-		}
+		outputCount(filename, foundCount);
+
+		flushOutput();
 
 		return true;
 	}
@@ -370,22 +576,21 @@ bool FileGrepper::countBasic(const std::string& filename, const std::string& sea
 	return false;
 }
 
-bool FileGrepper::matchBasic(const std::string& filename, bool foundPreviousFile)
+bool FileGrepper::matchBasic(const std::string& filename)
 {
 	if (m_matchType == eMatchTypeOr)
 	{
-		return matchBasicOr(filename, foundPreviousFile);
+		return matchBasicOr(filename);
 	}
 	else
 	{
-		return matchBasicAnd(filename, foundPreviousFile);
+		return matchBasicAnd(filename);
 	}
 }
 
-bool FileGrepper::matchBasicOr(const std::string& filename, bool foundPreviousFile)
+bool FileGrepper::matchBasicOr(const std::string& filename)
 {
-	std::fstream fileStream;
-	if (!openFileStream(filename, fileStream))
+	if (!openFile(filename))
 		return false;
 	
 	// this "or" version basically just acts as a normal find which can look for multiple items (on different lines)
@@ -397,477 +602,1027 @@ bool FileGrepper::matchBasicOr(const std::string& filename, bool foundPreviousFi
 	unsigned int afterLinesToPrint = 0;
 
 	bool shouldShortCircuit = false;
-
-	char buf[kStringLength];
+	bool finished = false;
 
 	unsigned int lineIndex = 1; // start at one as this value is only used for printing line number purposes
 
-	while (fileStream.getline(buf, kStringLength))
-	{	
-		bool foundAString = false;
-		
-		for (const std::string& matchString : m_aMatchItems)
+	resetContextLines();
+
+	while (!finished && !shouldShortCircuit && m_blockReader.readNextBlock())
+	{
+		const char* pos = m_blockReader.getBlockStart();
+		const char* scanEnd = m_blockReader.getBlockEnd();
+
+		if (m_shortCircuit && !m_combineShortCircuit)
 		{
-			if (strstr(buf, matchString.c_str()) != nullptr)
-			{
-				foundAString = true;
-				break;
-			}
+			limitToShortCircuitLine(pos, scanEnd, shouldShortCircuit);
 		}
 
-		if (m_shortCircuit && !shouldShortCircuit)
+		while (pos < scanEnd)
 		{
-			const char* findI = strstr(buf, m_shortCircuitString.c_str());
-			if (findI != nullptr)
+			const char* lineStart = pos;
+			const char* lineEnd = nullptr;
+			bool lineMatches = false;
+
+			if (afterLinesToPrint > 0)
 			{
-				shouldShortCircuit = true;
+				lineEnd = BlockReader::findLineEnd(pos, scanEnd);
+				lineMatches = findMatchOrItem(lineStart, lineEnd) != nullptr;
+
+				checkLineForShortCircuit(lineStart, lineEnd, scanEnd, shouldShortCircuit);
 			}
-		}
-		
-		if (foundAString)
-		{
-			// we found a string
-			
-			if (m_config.getOutputFilename())
+			else
 			{
-				if (m_config.getOutputContentLines())
+				// find the first position of any of the items
+				const char* firstFound = m_combineShortCircuit ? findWithShortCircuit(m_matchOrCombinedSearcher, pos, scanEnd, shouldShortCircuit) :
+															   findMatchOrItem(pos, scanEnd);
+				if (firstFound == nullptr)
 				{
-					// the filename if it's the first time for this file
-					if (!foundSomething)
+					if (m_trackLineNumbers)
 					{
-						if (foundPreviousFile && m_config.getBlankLinesBetweenFiles())
-						{
-							fprintf(stdout, "\n");
-						}
-						fprintf(stdout, "%s :\n", filename.c_str());
+						lineIndex += BlockReader::countLines(pos, scanEnd);
 					}
-					
-					// as we found the item, reset the after line content count item
-					afterLinesToPrint = m_config.getAfterLines();
+					break;
 				}
-				else
-				{
-					if (!foundSomething)
-					{
-						// technically, we should do a new line if asked, but doesn't seem worth it if we're not outputting
-						// the contents...
-
-						// just the filename
-						fprintf(stdout, "%s\n", filename.c_str());
 
-						foundSomething = true;
+				lineStart = BlockReader::findLineStart(pos, firstFound);
+				lineEnd = BlockReader::findLineEnd(firstFound, scanEnd);
+				lineMatches = true;
 
-						// we don't want the content lines, so we can just break out as we don't need to do anything else...
-						break;
-					}
+				if (m_trackLineNumbers)
+				{
+					lineIndex += BlockReader::countLines(pos, lineStart);
 				}
 			}
 
-			foundSomething = true;
+			pos = lineEnd + 1;
 
-			if (m_config.getOutputContentLines())
+			if (lineMatches)
 			{
-				if (m_config.getOutputLineNumbers())
+				// we found a string
+
+				if (m_config.getOutputFilename())
 				{
-					fprintf(stdout, "%u: %s\n", lineIndex, buf);
+					if (m_config.getOutputContentLines())
+					{
+						// the filename if it's the first time for this file
+						if (!foundSomething)
+						{
+							outputFileSeparator();
+							outputFilename(filename);
+						}
+					}
+					else
+					{
+						// technically, we should do a new line if asked, but doesn't seem worth it if we're not outputting
+						// the contents...
+
+						// just the filename
+						outputFilename(filename);
+					}
 				}
-				else
+
+				foundSomething = true;
+
+				// TODO: work out if we want to do anything about match counts? Not really sure how it would work... Match all equal number
+				//       of times?
+
+				if (!m_config.getOutputContentLines())
 				{
-					fprintf(stdout, "%s\n", buf);
+					// we don't want the content lines, so we can just break out as we don't need to do anything else...
+					finished = true;
+					break;
 				}
-			}
-			
-			// TODO: work out if we want to do anything about match counts? Not really sure how it would work... Match all equal number
-			//       of times?
-			
-			if (!m_config.getOutputContentLines())
-			{
-				// we can break out.
-				break;
-			}
-		}
-		else if (afterLinesToPrint > 0)
-		{
-			// if we've found it before, we need to output additional lines...
-			if (m_config.getOutputLineNumbers())
-			{
-				fprintf(stdout, "%u: %s\n", lineIndex, buf);
+
+				outputMatchingLine(m_blockReader.getBlockStart(), lineIndex, lineStart, lineEnd);
+
+				// as we found the item, reset the after line content count item
+				afterLinesToPrint = m_config.getAfterLines();
 			}
 			else
 			{
-				fprintf(stdout, "%s\n", buf);
+				// if we've found it before, we need to output additional lines...
+				outputAfterLine(lineIndex, lineStart, lineEnd);
+
+				afterLinesToPrint--;
 			}
 
-			afterLinesToPrint--;
+			lineIndex ++;
 		}
 
-		if (shouldShortCircuit)
+		if (!finished && !shouldShortCircuit)
 		{
-			break;
+			carryOverBeforeLines(m_blockReader.getBlockStart(), scanEnd);
 		}
-
-		lineIndex ++;
 	}
 
-	fileStream.close();
+	m_blockReader.closeFile();
+
+	setChunkResults(foundSomething ? 1 : 0, lineIndex - 1, shouldShortCircuit);
 
 	if (foundSomething)
 	{
-		if (m_config.getFlushOutput())
-		{
-			fflush(stdout);
-		}
+		flushOutput();
 	}
 
 	return foundSomething;
 }
 
-bool FileGrepper::matchBasicAnd(const std::string& filename, bool foundPreviousFile)
+bool FileGrepper::matchBasicAnd(const std::string& filename)
 {
-	std::fstream fileStream;
-	if (!openFileStream(filename, fileStream))
+	if (!openFile(filename))
 		return false;
 	
 	// in contrast, this "and" version will only match files (and output their content) if
 	// *all* string items are found - on separate lines - in order. Context/After/Before lines are only
 	// printed for the final item.
-	// Because of this behaviour, any output has to be deferred until a full match of all items is
-	// found.
+	// Because of this behaviour, output of the items before the final one has to be deferred until a full
+	// match of all items is found.
 	
 	// The assumption here is that there will be more than one item to match - if only one is given,
 	// the code will do the wrong thing (grep type should be used instead).
 	
 	std::string finalOutput;
 	
-	char buf[kStringLength];
-	
 	bool foundAll = false;
 	
 	unsigned int afterLinesToPrint = 0;
 
 	bool shouldShortCircuit = false;
-	
-	// temp buffer for formatting output
-	char szTemp[kStringLength];
+	bool finished = false;
 	
 	unsigned int lineIndex = 1; // start at one as this value is only used for printing line number purposes
 	
 	// we start off looking for the first item...
 	unsigned int lastItemToMatchIndex = m_aMatchItems.size() - 1;
 	unsigned int itemToMatchIndex = 0;
-	std::string itemToMatch = m_aMatchItems[0];
+	const Searcher* pItemToMatch = &m_aMatchItems[0];
 
-	while (fileStream.getline(buf, kStringLength))
+	resetContextLines();
+
+	while (!finished && !shouldShortCircuit && m_blockReader.readNextBlock())
 	{
-		if (m_shortCircuit && !shouldShortCircuit)
+		const char* pos = m_blockReader.getBlockStart();
+		const char* scanEnd = m_blockReader.getBlockEnd();
+
+		if (m_shortCircuit && !m_combineShortCircuit)
 		{
-			const char* findI = strstr(buf, m_shortCircuitString.c_str());
-			if (findI != nullptr)
-			{
-				shouldShortCircuit = true;
-			}
+			limitToShortCircuitLine(pos, scanEnd, shouldShortCircuit);
 		}
 
-		if (strstr(buf, itemToMatch.c_str()) == nullptr)
+		while (pos < scanEnd)
 		{
-			if (!foundAll)
+			const char* lineStart = pos;
+			const char* lineEnd = nullptr;
+
+			if (foundAll)
 			{
-				if (shouldShortCircuit)
+				// we're just printing after lines for the last item now
+				lineEnd = BlockReader::findLineEnd(pos, scanEnd);
+
+				bool isLastItem = pItemToMatch->find(lineStart, lineEnd) != nullptr;
+				if (!isLastItem && afterLinesToPrint == 0)
 				{
+					finished = true;
 					break;
 				}
 
-				// didn't find it, and haven't found the last item yet, so continue on to the next line
+				checkLineForShortCircuit(lineStart, lineEnd, scanEnd, shouldShortCircuit);
+
+				// if it's the last item again, continue printing after lines from here
+				afterLinesToPrint = isLastItem ? m_config.getAfterLines() : afterLinesToPrint - 1;
+
+				outputAfterLine(lineIndex, lineStart, lineEnd);
+
+				pos = lineEnd + 1;
 				lineIndex ++;
 				continue;
 			}
-			else if (foundAll && afterLinesToPrint > 0)
+
+			const char* found = m_combineShortCircuit ? findWithShortCircuit(m_aMatchAndCombinedSearchers[itemToMatchIndex], pos, scanEnd, shouldShortCircuit) :
+													  pItemToMatch->find(pos, scanEnd);
+			if (found == nullptr)
 			{
-				if (m_config.getOutputLineNumbers())
-				{
-					sprintf(szTemp, "%u: %s\n", lineIndex, buf);
-				}
-				else
+				// didn't find it in the rest of this block
+				if (m_trackLineNumbers)
 				{
-					sprintf(szTemp, "%s\n", buf);
+					lineIndex += BlockReader::countLines(pos, scanEnd);
 				}
-				finalOutput.append(szTemp);
-				
-				afterLinesToPrint --;
-				lineIndex ++;
-				continue;
-			}
-			else
-			{
 				break;
 			}
-		}
-		
-		// we did find it...
-		
-		// if we've found the first item, "print" the filename if required
-		if (itemToMatchIndex == 0 && m_config.getOutputFilename())
-		{
-			if (foundPreviousFile && m_config.getBlankLinesBetweenFiles())
-			{
-				// start with a new line if it's the next file
-				finalOutput = "\n";
-			}
-			if (m_config.getOutputContentLines())
+
+			lineStart = BlockReader::findLineStart(pos, found);
+			lineEnd = BlockReader::findLineEnd(found, scanEnd);
+
+			if (m_trackLineNumbers)
 			{
-				// the filename if it's the first time for this file
-				sprintf(szTemp, "%s :\n", filename.c_str());
+				lineIndex += BlockReader::countLines(pos, lineStart);
 			}
-			else
+
+			pos = lineEnd + 1;
+
+			// we did find it...
+
+			// if we've found the first item, "print" the filename if required
+			if (itemToMatchIndex == 0 && m_config.getOutputFilename())
 			{
-				// just the filename
-				// technically, we should do a new line if asked, but doesn't seem worth it if we're not outputting
-				// the contents...
-				sprintf(szTemp, "%s\n", filename.c_str());
+				finalOutput.append(filename);
+				if (m_config.getOutputContentLines())
+				{
+					// the filename if it's the first time for this file
+					finalOutput.append(" :\n");
+				}
+				else
+				{
+					// just the filename
+					// technically, we should do a new line if asked, but doesn't seem worth it if we're not outputting
+					// the contents...
+					finalOutput.append("\n");
+				}
 			}
-			finalOutput.append(szTemp);
-		}
-		
-		// now output the item itself if required. We output the line of all items matched.
-		if (m_config.getOutputContentLines())
-		{
-			if (m_config.getOutputLineNumbers())
+
+			if (itemToMatchIndex == lastItemToMatchIndex)
 			{
-				sprintf(szTemp, "%u: %s\n", lineIndex, buf);
+				// this is the last one to look for, so we were successful in finding all items in order
+				foundAll = true;
+
+				// so we can now output everything so far, followed by the last item with its before lines
+				if (m_config.getOutputFilename())
+				{
+					// start with a new line if it's the next file
+					outputFileSeparator();
+				}
+
+				outputString(finalOutput.c_str(), finalOutput.size());
+
+				if (m_config.getOutputContentLines())
+				{
+					outputMatchingLine(m_blockReader.getBlockStart(), lineIndex, lineStart, lineEnd);
+				}
+
+				// if we're the last one, we can break out if we don't need any after lines...
+				if (m_config.getAfterLines() == 0 || !m_config.getOutputContentLines())
+				{
+					finished = true;
+					break;
+				}
+
+				// otherwise, mark how many after lines we want to do
+				afterLinesToPrint = m_config.getAfterLines();
 			}
 			else
 			{
-				sprintf(szTemp, "%s\n", buf);
-			}
-			finalOutput.append(szTemp);
-		}
-		
-		if (itemToMatchIndex == lastItemToMatchIndex)
-		{
-			// this is the last one to look for, so we were successful in finding all items in order
-			foundAll = true;
-			
-			// if we're the last one, we can break out if we don't need any after lines...
-			if (m_config.getAfterLines() == 0)
-			{
-				break;
+				// now output the item itself if required. We output the line of all items matched.
+				if (m_config.getOutputContentLines())
+				{
+					appendContentLine(finalOutput, lineIndex, lineStart, lineEnd);
+					m_lastOutputContentLine = lineIndex;
+				}
+
+				// and move on to the next item to look for
+				itemToMatchIndex ++;
+				pItemToMatch = &m_aMatchItems[itemToMatchIndex];
 			}
-			
-			// otherwise, mark how many after lines we want to do
-			afterLinesToPrint = m_config.getAfterLines();
+
+			lineIndex ++;
 		}
-		else
+
+		if (!finished && !shouldShortCircuit && !foundAll)
 		{
-			// otherwise, move on to the next item to look for
-			itemToMatchIndex ++;
-			itemToMatch = m_aMatchItems[itemToMatchIndex];
+			carryOverBeforeLines(m_blockReader.getBlockStart(), scanEnd);
 		}
-		
-		lineIndex ++;
 	}
 	
-	fileStream.close();
+	m_blockReader.closeFile();
 	
 	if (foundAll)
 	{
-		fprintf(stdout, "%s", finalOutput.c_str());
-		if (m_config.getFlushOutput())
-		{
-			fflush(stdout);
-		}
+		flushOutput();
 	}
 	
 	return foundAll;
 }
 
-bool FileGrepper::findTimestampDelta(const std::string& filename, uint64_t timeDeltaSeconds, bool foundPreviousFile)
+bool FileGrepper::findTimestampDelta(const std::string& filename, uint64_t timeDeltaMicroseconds)
 {
-	std::fstream fileStream;
-	if (!openFileStream(filename, fileStream))
+	if (!openFile(filename))
 		return false;
 
-	char buf[kStringLength];
+	unsigned int lineIndex = 0; // incremented before use, so the first line is 1, as it's only used for printing purposes
 
-	unsigned int lineIndex = 1; // start at one as this value is only used for printing line number purposes
-
-	std::string lastString; // TODO: could optimise this to not need this, and use double-buffering of actual char buffers
+	// the previous line with a timestamp - this points into the block where possible, and is only copied (into
+	// m_lastTimestampLineCarry) if it's the last one in a block, so it stays valid when the next block is read.
+	const char* lastLineStart = nullptr;
+	size_t lastLineLength = 0;
+	unsigned int lastLineIndex = 0;
+	bool lastLineInBlock = false;
 
-	uint64_t lastTime = 0;
+	int64_t lastTime = 0;
+	bool haveLastTime = false;
+	const int64_t timeDelta = (int64_t)timeDeltaMicroseconds;
 
 	// this is signed on purpose, as the default config value for matches is -1.
 	int foundCount = 0;
 
-	unsigned int currentYear = 0;
-	const unsigned int* pCumulativeDaysInMonth = nullptr;
+	bool shouldShortCircuit = false;
 
-	while (fileStream.getline(buf, kStringLength))
+	// with context lines, results are output as normal content lines (with their own line numbers) along with their
+	// before / after lines, otherwise the previous line and line after the gap are just output as a pair
+	const bool outputContext = m_config.getOutputContentLines() && (m_config.getBeforeLines() > 0 || m_config.getAfterLines() > 0);
+	unsigned int afterLinesToPrint = 0;
+	// once we've found enough items, we only continue to print any remaining after lines for the last one
+	bool haveFoundEnoughItems = false;
+	bool finished = false;
+
+	resetContextLines();
+
+	while (!finished && !shouldShortCircuit && m_blockReader.readNextBlock())
 	{
+		const char* pos = m_blockReader.getBlockStart();
+		const char* scanEnd = m_blockReader.getBlockEnd();
+
 		if (m_shortCircuit)
 		{
-			const char* findSCI = strstr(buf, m_shortCircuitString.c_str());
-			if (findSCI != nullptr)
+			const char* shortCircuitLine = findShortCircuitLine(pos, scanEnd);
+			if (shortCircuitLine != nullptr)
 			{
-				break;
+				// in this mode, we don't process the line with the short circuit string in
+				scanEnd = shortCircuitLine;
+				shouldShortCircuit = true;
 			}
 		}
 
-		if (buf[0] == 0 || (m_logTimestampSurround && buf[0] != m_logTimestampBeforeChar))
+		while (pos < scanEnd)
 		{
+			const char* lineStart = pos;
+			const char* lineEnd = BlockReader::findLineEnd(pos, scanEnd);
+			const size_t lineLength = lineEnd - lineStart;
+
+			pos = lineEnd + 1;
 			lineIndex ++;
-			continue;
-		}
 
-		std::string currentString(buf);
+			if (afterLinesToPrint > 0)
+			{
+				outputAfterLine(lineIndex, lineStart, lineEnd);
 
-		if (currentString.size() < m_logTimestampMinLineLength)
-		{
-			lineIndex ++;
-			continue;
+				afterLinesToPrint--;
+
+				if (haveFoundEnoughItems)
+				{
+					if (afterLinesToPrint == 0)
+					{
+						finished = true;
+						break;
+					}
+					continue;
+				}
+			}
+
+			int64_t currentTime = 0;
+			if (!m_timestampParser.parse(lineStart, lineEnd, currentTime))
+				continue;
+
+			// times going backwards (e.g. interleaved output from several processes) aren't gaps
+			if (haveLastTime && currentTime - lastTime >= timeDelta)
+			{
+				if (m_config.getOutputFilename() && foundCount == 0)
+				{
+					outputFileSeparator();
+					outputFilename(filename);
+				}
+
+				if (outputContext)
+				{
+					// if the line's already been output as an after line, the results just run on from each other
+					if (lineIndex != m_lastOutputContentLine)
+					{
+						// the previous line, unless it's already been output, or will be as one of the before lines
+						const bool outputLastLine = lastLineIndex > m_lastOutputContentLine &&
+													lastLineIndex + m_config.getBeforeLines() < lineIndex;
+
+						// results are separated unless they follow straight on from the previous output
+						const unsigned int firstLineIndex = outputLastLine ? lastLineIndex :
+															std::max(lineIndex - m_config.getBeforeLines(), m_lastOutputContentLine + 1);
+						if (foundCount > 0 && firstLineIndex > m_lastOutputContentLine + 1)
+						{
+							outputString("\n", 1);
+						}
+
+						if (outputLastLine)
+						{
+							outputAfterLine(lastLineIndex, lastLineStart, lastLineStart + lastLineLength);
+						}
+
+						outputMatchingLine(m_blockReader.getBlockStart(), lineIndex, lineStart, lineEnd);
+					}
+
+					afterLinesToPrint = m_config.getAfterLines();
+				}
+				else if (m_config.getOutputContentLines())
+				{
+					if (foundCount > 0)
+					{
+						outputString("\n", 1);
+					}
+
+					// the line number (if wanted) goes on the previous line
+					outputContentLine(lineIndex, lastLineStart, lastLineStart + lastLineLength);
+					outputString(lineStart, lineLength);
+					outputString("\n", 1);
+				}
+
+				foundCount += 1;
+
+				flushOutput();
+
+				haveFoundEnoughItems = m_config.getMatchCount() != -1 && foundCount >= m_config.getMatchCount();
+
+				if (haveFoundEnoughItems && afterLinesToPrint == 0)
+				{
+					finished = true;
+					break;
+				}
+			}
+
+			lastTime = currentTime;
+			haveLastTime = true;
+			lastLineStart = lineStart;
+			lastLineLength = lineLength;
+			lastLineIndex = lineIndex;
+			lastLineInBlock = true;
 		}
 
-		const size_t timestampStart = m_logTimestampSurround ? 1 : 0;
-		if (m_logTimestampSurround)
+		if (!finished && !shouldShortCircuit)
 		{
-			const size_t timestampEnd = currentString.find(m_logTimestampAfterChar, timestampStart);
-			if (timestampEnd == std::string::npos)
+			if (lastLineInBlock)
 			{
-				lineIndex ++;
-				continue;
+				m_lastTimestampLineCarry.assign(lastLineStart, lastLineLength);
+				lastLineStart = m_lastTimestampLineCarry.c_str();
+				lastLineInBlock = false;
 			}
+
+			carryOverBeforeLines(m_blockReader.getBlockStart(), scanEnd);
 		}
+	}
 
-		// this is much more efficient than using sscanf() or strptime(), due to the lack of mktime() which is slow,
-		// and is somewhat noticable even though we're normally IO-bound, so for the moment it appears to be worth
-		// doing it this way, although this is obviously more limited in terms of formats, and probably less robust, so...
+	m_blockReader.closeFile();
 
-		uint64_t yearVal = (currentString[timestampStart] - '0') * 1000;
-		yearVal += (currentString[timestampStart + 1] - '0') * 100;
-		yearVal += (currentString[timestampStart + 2] - '0') * 10;
-		yearVal += (currentString[timestampStart + 3] - '0');
+	if (foundCount > 0)
+	{
+		flushOutput();
+	}
+
+	return foundCount > 0;
+}
+
+bool FileGrepper::outputLines(const std::string& filename)
+{
+	if (!openFile(filename))
+		return false;
+
+	unsigned int lineIndex = 1;
+
+	bool foundLines = false;
+	bool shouldShortCircuit = false;
+
+	while (!shouldShortCircuit && m_blockReader.readNextBlock())
+	{
+		const char* pos = m_blockReader.getBlockStart();
+		const char* scanEnd = m_blockReader.getBlockEnd();
 
-		// we assume that for the leap-year calculation, the year doesn't change after the first log line with a timestamp in,
-		// which under the limiting assumption that any timestamp delta we're supporting will be less than a week, and the
-		// entire log duration is under 48 days (up to 28th Feb from 1st Jan) is an acceptable approximation
-		// (in which being incorrect won't matter), as we then won't be able to go from December the year before at
-		// the beginning of the log to the end of February further down and have a miss-match of Dec->Feb across a leap year, so
-		// with that restriction, this code will work.
-		if (currentYear == 0)
+		if (m_shortCircuit)
+		{
+			limitToShortCircuitLine(pos, scanEnd, shouldShortCircuit);
+		}
+
+		if (!foundLines)
 		{
-			currentYear = yearVal;
+			foundLines = true;
 
-			// exactly divisible by 400, not exactly devisible by 100
-			const bool isLeapYear = ((currentYear % 400 == 0) || (currentYear % 100 != 0)) && (currentYear % 4 == 0);
-			pCumulativeDaysInMonth = (isLeapYear) ? kCumulativeDaysInYearForMonthLeapYear : kCumulativeDaysInYearForMonth;
+			if (m_config.getOutputFilename())
+			{
+				outputFileSeparator();
+				outputFilename(filename);
+			}
+
+			if (!m_config.getOutputContentLines())
+				break;
 		}
 
-		uint64_t monthVal = (currentString[timestampStart + 5] - '0') * 10;
-		monthVal += (currentString[timestampStart + 6] - '0');
+		outputContentLines(pos, scanEnd, lineIndex);
+	}
+
+	m_blockReader.closeFile();
+
+	if (foundLines)
+	{
+		flushOutput();
+	}
 
-		uint64_t dayVal = (currentString[timestampStart + 8] - '0') * 10;
-		dayVal += (currentString[timestampStart + 9] - '0');
+	return foundLines;
+}
 
-		uint64_t hourVal = (currentString[timestampStart + 11] - '0') * 10;
-		hourVal += (currentString[timestampStart + 12] - '0');
+bool FileGrepper::findTimeWindowRange(const std::string& filename, int64_t windowStart, int64_t windowEnd, uint64_t& rangeStart,
+									  uint64_t& rangeLength) const
+{
+	int fileDescriptor = open(filename.c_str(), O_RDONLY);
+	if (fileDescriptor == -1)
+		return false;
 
-		uint64_t minuteVal = (currentString[timestampStart + 14] - '0') * 10;
-		minuteVal += (currentString[timestampStart + 15] - '0');
+	struct stat statState;
+	if (fstat(fileDescriptor, &statState) != 0)
+	{
+		close(fileDescriptor);
+		return false;
+	}
+
+	uint64_t fileSize = statState.st_size;
+
+	rangeStart = findTimeOffset(fileDescriptor, fileSize, 0, windowStart);
+	uint64_t rangeEnd = (rangeStart < fileSize && windowEnd > windowStart) ?
+							findTimeOffset(fileDescriptor, fileSize, rangeStart, windowEnd) : rangeStart;
 
-		uint64_t secondVal = (currentString[timestampStart + 17] - '0') * 10;
-		secondVal += (currentString[timestampStart + 18] - '0');
+	close(fileDescriptor);
 
-		// Note: this year/month thing is a hack, but in practice should work in all situations except for the one where the log
-		//       timestamps start in one year (i.e. December), and later on in the log reach the end of February. In this scenario,
-		//       it's possible the leap-year calculation will be wrong as it will be using the previous year to work that out.
-		//       However, with the assumption that the total log file duration is < month, this should work correctly.
+	rangeLength = rangeEnd - rangeStart;
+	return rangeLength > 0;
+}
 
-		const unsigned int numDaysSinceStartOfYearToMonth = pCumulativeDaysInMonth[monthVal - 1];
+uint64_t FileGrepper::findTimeOffset(int fileDescriptor, uint64_t fileSize, uint64_t startOffset, int64_t time) const
+{
+	// all the timestamped lines starting before low are before the time, so we narrow down the range after it by probing
+	// the first timestamped line after the middle of it, until the range is small enough to just scan through
+	uint64_t low = startOffset;
+	uint64_t high = fileSize;
 
-		uint64_t currentTime = (yearVal * 365 * 31 * 24 * 60 * 60) + (numDaysSinceStartOfYearToMonth * 24 * 60 * 60);
-		currentTime += (dayVal * 24 * 60 * 60) + (hourVal * 60 * 60) + (minuteVal * 60) + secondVal;
+	while (high - low > kTimeWindowProbeSize)
+	{
+		uint64_t middle = low + (high - low) / 2;
 
-		if (lastTime != 0 && (currentTime - lastTime >= timeDeltaSeconds))
+		uint64_t lineOffset = 0;
+		int64_t lineTime = 0;
+		if (findTimestampedLine(fileDescriptor, middle, high, INT64_MIN, lineOffset, lineTime) && lineTime < time)
 		{
-			if (m_config.getOutputFilename() && foundCount == 0)
+			// (which isn't the start of a line, but findTimestampedLine() moves on to the next one)
+			low = lineOffset + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	uint64_t lineOffset = 0;
+	int64_t lineTime = 0;
+	return findTimestampedLine(fileDescriptor, low, UINT64_MAX, time, lineOffset, lineTime) ? lineOffset : fileSize;
+}
+
+bool FileGrepper::findTimestampedLine(int fileDescriptor, uint64_t offset, uint64_t limit, int64_t minTime, uint64_t& lineOffset,
+									  int64_t& lineTime) const
+{
+	char buffer[kTimeWindowProbeSize];
+
+	// if we're not at the start of the file, we start from the char before, so that if it's a new line, we're at the
+	// start of a line already
+	bool atLineStart = offset == 0;
+	if (!atLineStart)
+	{
+		offset--;
+	}
+
+	while (offset < limit)
+	{
+		ssize_t readAmount = pread(fileDescriptor, buffer, sizeof(buffer), offset);
+		if (readAmount <= 0)
+			return false;
+
+		const char* pos = buffer;
+		const char* end = buffer + readAmount;
+		while (pos < end)
+		{
+			if (!atLineStart)
 			{
-				if (foundPreviousFile && m_config.getBlankLinesBetweenFiles())
-				{
-					fprintf(stdout, "\n");
-				}
-				if (m_config.getOutputContentLines())
-				{
-					fprintf(stdout, "%s :\n", filename.c_str());
-				}
-				else
-				{
-					fprintf(stdout, "%s\n", filename.c_str());
-				}
+				const char* newLine = (const char*)memchr(pos, '\n', end - pos);
+				pos = newLine ? newLine + 1 : end;
+				atLineStart = newLine != nullptr;
+				continue;
 			}
 
-			if (m_config.getOutputContentLines())
+			if (offset + (pos - buffer) >= limit)
+				return false;
+
+			const char* lineEnd = BlockReader::findLineEnd(pos, end);
+			if (lineEnd == end && pos > buffer && readAmount == sizeof(buffer))
 			{
-				if (foundCount > 0)
-				{
-					fprintf(stdout, "\n");
-				}
+				// the line continues on past what we've read, so read again from its start. If it's longer than the
+				// whole buffer, we just parse the start of it, which is where the timestamp is.
+				break;
+			}
 
-				if (m_config.getOutputLineNumbers())
-				{
-					fprintf(stdout, "%u: %s\n%s\n", lineIndex, lastString.c_str(), buf);
-				}
-				else
-				{
-					fprintf(stdout, "%s\n%s\n", lastString.c_str(), buf);
-				}
+			if (m_timestampParser.parse(pos, lineEnd, lineTime) && lineTime >= minTime)
+			{
+				lineOffset = offset + (pos - buffer);
+				return true;
 			}
 
-			foundCount += 1;
+			pos = lineEnd;
+			atLineStart = false;
+		}
+
+		offset += pos - buffer;
+	}
 
-			if (m_config.getFlushOutput())
+	return false;
+}
+
+bool FileGrepper::combineChunkContentLines(const std::string& filename, FileChunk& chunk, bool limitToMatchCount, FileChunkTotals& totals)
+{
+	// this mirrors what grepBasic() and matchBasicOr() output as they go for the whole file (without context lines)
+
+	bool needMoreChunks = !chunk.shortCircuited;
+
+	if (chunk.foundCount > 0)
+	{
+		if (m_config.getOutputFilename())
+		{
+			if (m_config.getOutputContentLines())
 			{
-				fflush(stdout);
+				// the filename if it's the first time for this file
+				if (totals.foundCount == 0)
+				{
+					outputFileSeparator();
+					outputFilename(filename);
+				}
 			}
+			else
+			{
+				outputFilename(filename);
+			}
+		}
+
+		if (!m_config.getOutputContentLines())
+		{
+			// that's all we need to know
+			totals.foundCount = 1;
+			return false;
+		}
 
-			bool haveFoundEnoughItems = m_config.getMatchCount() != -1 && foundCount >= m_config.getMatchCount();
+		const char* lineStart = chunk.contentLines.c_str();
+		const char* contentEnd = lineStart + chunk.contentLines.size();
+		for (unsigned int chunkLineIndex : chunk.aContentLineIndices)
+		{
+			const char* lineEnd = BlockReader::findLineEnd(lineStart, contentEnd);
+
+			outputContentLine(totals.lineCount + chunkLineIndex, lineStart, lineEnd);
+
+			lineStart = lineEnd + 1;
+
+			totals.foundCount ++;
 
-			if (haveFoundEnoughItems)
+			if (limitToMatchCount && m_config.getMatchCount() != -1 && totals.foundCount >= (unsigned int)m_config.getMatchCount())
 			{
-				fileStream.close();
-				return true;
+				needMoreChunks = false;
+				break;
 			}
 		}
+	}
 
-		lastTime = currentTime;
-		lastString = currentString;
+	totals.lineCount += chunk.lineCount;
+
+	// we don't need these any more
+	std::string().swap(chunk.contentLines);
+	std::vector<unsigned int>().swap(chunk.aContentLineIndices);
+
+	return needMoreChunks;
+}
+
+bool FileGrepper::combineChunkCount(FileChunk& chunk, FileChunkTotals& totals)
+{
+	totals.foundCount += chunk.foundCount;
+
+	return !chunk.shortCircuited;
+}
+
+bool FileGrepper::finishChunkedFile(const std::string& filename, bool countResults, const FileChunkTotals& totals)
+{
+	if (totals.foundCount == 0)
+		return false;
+
+	if (countResults)
+	{
+		outputCount(filename, totals.foundCount);
 	}
 
-	fileStream.close();
+	flushOutput();
 
-	return foundCount > 0;
+	return true;
 }
 
-bool FileGrepper::openFileStream(const std::string& filename, std::fstream& fileStream)
+void FileGrepper::initCombinedSearcher(CombinedSearcher& combinedSearcher, const std::vector<std::string>& searchStrings) const
 {
-	std::ios::openmode mode = std::ios::in;
+	std::vector<std::string> allStrings = searchStrings;
+	allStrings.insert(allStrings.end(), m_config.getShortCircuitStrings().begin(), m_config.getShortCircuitStrings().end());
+
+	combinedSearcher.searchAndShortCircuit.init(allStrings);
+	combinedSearcher.searchOnly.init(searchStrings);
+	combinedSearcher.numSearchStrings = searchStrings.size();
+}
 
-	if (m_pReadBuffer)
+const char* FileGrepper::findWithShortCircuit(const CombinedSearcher& combinedSearcher, const char* pos, const char*& scanEnd,
+											  bool& shouldShortCircuit) const
+{
+	unsigned int foundIndex = 0;
+	const char* found = combinedSearcher.searchAndShortCircuit.find(pos, scanEnd, &foundIndex);
+	if (found == nullptr)
+		return nullptr;
+
+	const char* lineEnd = BlockReader::findLineEnd(found, scanEnd);
+
+	if (foundIndex < combinedSearcher.numSearchStrings)
 	{
-		fileStream.rdbuf()->pubsetbuf(m_pReadBuffer, m_readBufferSize);
+		// we found a search string first, but the rest of its line could still contain a short circuit
+		// string (possibly overlapping what we found)
+		if (m_shortCircuitSearcher.find(getShortCircuitOverlapStart(pos, found), lineEnd) != nullptr)
+		{
+			scanEnd = lineEnd;
+			shouldShortCircuit = true;
+		}
+
+		return found;
 	}
 
-	fileStream.open(filename.c_str(), mode);
+	// otherwise we found a short circuit string first, so its line is the last one we need to look at
+	scanEnd = lineEnd;
+	shouldShortCircuit = true;
+
+	const char* lineStart = BlockReader::findLineStart(pos, found);
+	return combinedSearcher.searchOnly.find(lineStart, lineEnd);
+}
+
+unsigned int FileGrepper::countOccurrences(const Searcher& searcher, const char* start, const char* end)
+{
+	if (searcher.isRegex())
+		return searcher.getRegexSearcher().countMatches(start, end);
 
-	if (!fileStream.is_open())
+	if (searcher.getLength() == 0)
 	{
-		// for the moment, don't report any errors...
-		return false;
+		// otherwise it would be found at the same place forever
+		unsigned int lineCount = std::count(start, end, '\n');
+		if (start < end && *(end - 1) != '\n')
+		{
+			lineCount++;
+		}
+		return lineCount;
 	}
 
-	if (fileStream.fail())
+	if (searcher.getLength() == 1)
 	{
-		// for the moment, we don't want to report any errors for files we can't access (invalid permissions, etc)
-		return false;
+		const char searchChar = searcher.getSearchString()[0];
+		if (!searcher.isCaseInsensitive())
+		{
+			// std::count() is vectorised by the compiler, so this is much quicker than finding each one in turn
+			return std::count(start, end, searchChar);
+		}
+
+		// the char is a lower case letter, and ORing with 0x20 gives that for both cases (and nothing else),
+		// which the compiler can also vectorise
+		unsigned int count = 0;
+		for (const char* pos = start; pos < end; pos++)
+		{
+			count += (*pos | 0x20) == searchChar;
+		}
+		return count;
 	}
 
-	return true;
+	unsigned int count = 0;
+	
+	const char* pos = start;
+	while (pos < end)
+	{
+		const char* found = searcher.find(pos, end);
+		if (found == nullptr)
+			break;
+
+		// occurrences aren't allowed to overlap
+		count++;
+		pos = found + searcher.getLength();
+	}
+
+	return count;
+}
+
+const char* FileGrepper::findShortCircuitLine(const char* blockStart, const char* blockEnd) const
+{
+	const char* found = m_shortCircuitSearcher.find(blockStart, blockEnd);
+	if (found == nullptr)
+		return nullptr;
+
+	return BlockReader::findLineStart(blockStart, found);
+}
+
+void FileGrepper::carryOverBeforeLines(const char* blockStart, const char* blockEnd)
+{
+	if (!m_outputBeforeLines)
+		return;
+
+	const unsigned int maxLines = m_config.getBeforeLines();
+
+	unsigned int numBlockLines = maxLines;
+	const char* blockLinesStart = BlockReader::findLastLinesStart(blockStart, blockEnd, numBlockLines);
+
+	if (numBlockLines < maxLines)
+	{
+		// the block doesn't have enough lines on its own, so keep the most recent ones from before it as well
+		unsigned int numCarriedLines = maxLines - numBlockLines;
+		const char* carryStart = m_beforeLinesCarry.c_str();
+		const char* keepStart = BlockReader::findLastLinesStart(carryStart, carryStart + m_beforeLinesCarry.size(), numCarriedLines);
+		m_beforeLinesCarry.erase(0, keepStart - carryStart);
+	}
+	else
+	{
+		m_beforeLinesCarry.clear();
+	}
+
+	m_beforeLinesCarry.append(blockLinesStart, blockEnd - blockLinesStart);
+
+	// lines longer than the block size get split, in which case the block won't end with a new line
+	if (blockLinesStart < blockEnd && *(blockEnd - 1) != '\n')
+	{
+		m_beforeLinesCarry += '\n';
+	}
+}
+
+void FileGrepper::resetContextLines()
+{
+	m_beforeLinesCarry.clear();
+	m_lastOutputContentLine = 0;
+}
+
+void FileGrepper::outputMatchingLine(const char* blockStart, unsigned int lineIndex, const char* lineStart, const char* lineEnd)
+{
+	if (m_outputBeforeLines)
+	{
+		// only the lines which haven't already been output (as part of previous matches' context)
+		unsigned int numLines = std::min(m_config.getBeforeLines(), lineIndex - 1 - m_lastOutputContentLine);
+
+		// as many as possible come from the block itself, with any others from the end of previous blocks
+		unsigned int numBlockLines = numLines;
+		const char* blockLinesStart = BlockReader::findLastLinesStart(blockStart, lineStart, numBlockLines);
+
+		unsigned int numCarriedLines = numLines - numBlockLines;
+		const char* carryEnd = m_beforeLinesCarry.c_str() + m_beforeLinesCarry.size();
+		const char* carriedLinesStart = BlockReader::findLastLinesStart(m_beforeLinesCarry.c_str(), carryEnd, numCarriedLines);
+
+		unsigned int outputLineIndex = lineIndex - numBlockLines - numCarriedLines;
+		outputContentLines(carriedLinesStart, carryEnd, outputLineIndex);
+		outputContentLines(blockLinesStart, lineStart, outputLineIndex);
+	}
+
+	outputContentLine(lineIndex, lineStart, lineEnd);
+	m_lastOutputContentLine = lineIndex;
 }
 
+void FileGrepper::outputContentLines(const char* start, const char* end, unsigned int& lineIndex)
+{
+	const char* pos = start;
+	while (pos < end)
+	{
+		const char* lineEnd = BlockReader::findLineEnd(pos, end);
+		outputContentLine(lineIndex++, pos, lineEnd);
+		pos = lineEnd + 1;
+	}
+}
+
+void FileGrepper::startOutputFile(size_t fileIndex)
+{
+	m_outputFileIndex = fileIndex;
+	m_outputBuffer.clear();
+	m_outputBufferPassOnSize = kOutputBufferPassOnSize;
+	m_outputWantsFileSeparator = false;
+}
+
+void FileGrepper::finishOutputFile()
+{
+	if (m_pOutputMerger)
+	{
+		m_pOutputMerger->finishFile(m_outputFileIndex, m_outputBuffer, m_outputWantsFileSeparator);
+	}
+}
+
+void FileGrepper::outputString(const char* str, size_t length)
+{
+	if (m_pChunk)
+		return;
+
+	if (!m_pOutputMerger)
+	{
+		fwrite(str, 1, length, stdout);
+		return;
+	}
+
+	m_outputBuffer.append(str, length);
+
+	if (m_outputBuffer.size() >= m_outputBufferPassOnSize)
+	{
+		passOnOutputBuffer();
+	}
+}
+
+void FileGrepper::passOnOutputBuffer()
+{
+	if (m_pOutputMerger->addPartialFileOutput(m_outputFileIndex, m_outputBuffer, m_outputWantsFileSeparator))
+	{
+		m_outputBufferPassOnSize = kOutputBufferPassOnSize;
+	}
+	else
+	{
+		// it couldn't be written yet, so don't try again until we've got a decent amount more
+		m_outputBufferPassOnSize = m_outputBuffer.size() + kOutputBufferPassOnSize;
+	}
+}
+
+void FileGrepper::outputFilename(const std::string& filename)
+{
+	outputString(filename.c_str(), filename.size());
+
+	if (m_config.getOutputContentLines())
+	{
+		outputString(" :\n", 3);
+	}
+	else
+	{
+		outputString("\n", 1);
+	}
+}
+
+void FileGrepper::outputCount(const std::string& filename, unsigned int count)
+{
+	// can't really think of a useful use-case where you wouldn't want the filename, but...
+	std::string countLine = std::to_string(count);
+	if (m_config.getOutputFilename())
+	{
+		countLine += ": " + filename;
+	}
+	countLine += "\n";
+	outputString(countLine.c_str(), countLine.size());
+}
+
+void FileGrepper::flushOutput()
+{
+	if (!m_config.getFlushOutput() || m_pChunk)
+		return;
+
+	if (!m_pOutputMerger)
+	{
+		fflush(stdout);
+	}
+	else if (!m_outputBuffer.empty())
+	{
+		// pass on what we have so far, so it can be flushed if possible
+		passOnOutputBuffer();
+	}
+}
+
+void FileGrepper::outputContentLine(unsigned int lineIndex, const char* lineStart, const char* lineEnd)
+{
+	if (m_pChunk)
+	{
+		// the line number gets fixed up when the chunk's combined
+		m_pChunk->contentLines.append(lineStart, lineEnd - lineStart);
+		m_pChunk->contentLines.push_back('\n');
+		m_pChunk->aContentLineIndices.emplace_back(lineIndex);
+		return;
+	}
+
+	if (!m_pOutputMerger)
+	{
+		if (m_config.getOutputLineNumbers())
+		{
+			fprintf(stdout, "%u: ", lineIndex);
+		}
+
+		fwrite(lineStart, 1, lineEnd - lineStart, stdout);
+		fputc('\n', stdout);
+		return;
+	}
+
+	appendContentLine(m_outputBuffer, lineIndex, lineStart, lineEnd);
+
+	if (m_outputBuffer.size() >= m_outputBufferPassOnSize)
+	{
+		passOnOutputBuffer();
+	}
+}
+
+void FileGrepper::appendContentLine(std::string& output, unsigned int lineIndex, const char* lineStart, const char* lineEnd) const
+{
+	if (m_config.getOutputLineNumbers())
+	{
+		char szTemp[16];
+		sprintf(szTemp, "%u: ", lineIndex);
+		output.append(szTemp);
+	}
+
+	output.append(lineStart, lineEnd - lineStart);
+	output.push_back('\n');
+}
@@ -20,12 +20,50 @@
 #define FILE_GREPPER_H
 
 #include <string>
-#include <fstream>
 #include <vector>
 
-#include "utils/string_buffer.h"
+#include "searcher.h"
+#include "multi_searcher.h"
+#include "timestamp_parser.h"
+
+#include "utils/block_reader.h"
 
 class Config;
+class OutputMerger;
+
+// One part of a large file (starting and ending on line boundaries) which can be processed separately from the rest
+// of the file, so that the parts of the file can be processed in parallel, and their results combined afterwards.
+struct FileChunk
+{
+	FileChunk(uint64_t chunkStart, uint64_t chunkLength) : start(chunkStart), length(chunkLength),
+		foundCount(0), lineCount(0), shortCircuited(false)
+	{
+	}
+
+	uint64_t					start;
+	uint64_t					length;
+
+	// results
+
+	unsigned int				foundCount; // the count in count mode, otherwise non-zero if something was found
+	unsigned int				lineCount; // only valid if the whole chunk was processed and line numbers are being tracked
+	bool						shortCircuited;
+
+	// the content lines found (each followed by '\n'), and their line numbers within the chunk
+	std::string					contentLines;
+	std::vector<unsigned int>	aContentLineIndices;
+};
+
+// the results of the chunks of a file combined so far
+struct FileChunkTotals
+{
+	FileChunkTotals() : foundCount(0), lineCount(0)
+	{
+	}
+
+	unsigned int	foundCount;
+	unsigned int	lineCount;
+};
 
 class FileGrepper
 {
@@ -33,31 +71,248 @@ public:
 	FileGrepper(const Config& config);
 	~FileGrepper();
 
-	// compute cached values for matching mode
-	bool initMatch(const std::string& matchString);
+	// compute cached values for grep and count - returns false if the search string is an invalid regex
+	// (when regex searching is configured), with errorMessage set
+	bool initSearch(const std::string& searchString, std::string& errorMessage);
+
+	// compute cached values for matching mode. errorMessage is only set if an item is an invalid regex.
+	bool initMatch(const std::string& matchString, std::string& errorMessage);
 
 	
 	
 	// operations per file...
 	// TODO: abstract this to classes doing this	
 	
-	// basic ones are slow, naive versions that read files per-line using linear search
+	// these read files in large blocks and search the whole block at once, only working out
+	// line boundaries around any matches found
 	
-	// slow, basic
-	bool grepBasic(const std::string& filename, const std::string& searchString, bool foundPreviousFile);
+	// initSearch() has to have been called previously for these
+	bool grepBasic(const std::string& filename, bool limitToMatchCount = true);
 	
-	bool countBasic(const std::string& filename, const std::string& searchString);
+	bool countBasic(const std::string& filename);
+
+	// like grepBasic(), but only outputs the last matches (the match count, or just the last one if there isn't one),
+	// which are found by reading the file backwards from the end, so only the end of the file needs reading
+	bool grepLast(const std::string& filename);
 
 	// match - initMatch() has to have been called previously for this to work...
-	bool matchBasic(const std::string& filename, bool foundPreviousFile);
-	bool matchBasicOr(const std::string& filename, bool foundPreviousFile);
-	bool matchBasicAnd(const std::string& filename, bool foundPreviousFile);
+	bool matchBasic(const std::string& filename);
+	bool matchBasicOr(const std::string& filename);
+	bool matchBasicAnd(const std::string& filename);
+
+	bool findTimestampDelta(const std::string& filename, uint64_t timeDeltaMicroseconds);
+
+	// just outputs all the lines (for time windows)
+	bool outputLines(const std::string& filename);
+
+	// Finds the range of the file containing the lines with timestamps within the time window (start inclusive, end
+	// exclusive), by binary searching the file with small reads, so the file's timestamps need to be in order.
+	// Lines without timestamps are treated as part of the previous line with one. Returns false if the file couldn't be
+	// read or there's nothing within the window.
+	bool findTimeWindowRange(const std::string& filename, int64_t windowStart, int64_t windowEnd, uint64_t& rangeStart,
+							 uint64_t& rangeLength) const;
 
-	bool findTimestampDelta(const std::string& filename, uint64_t timeDeltaSeconds, bool foundPreviousFile);
+	// while a read range is set, all the operations only process that range of the file (which must start and end on
+	// line boundaries), with line numbers being from the start of it. A length of UINT64_MAX reads to the end of the file.
+	void setReadRange(uint64_t rangeStart, uint64_t rangeLength)
+	{
+		m_readRangeStart = rangeStart;
+		m_readRangeLength = rangeLength;
+	}
+
+	// the buffer files are read into (which must be at least getReadBufferSize()), which the caller owns. nullptr
+	// goes back to the grepper's own buffer.
+	void setReadBuffer(char* pBuffer)
+	{
+		m_blockReader.setBuffer(pBuffer);
+	}
+
+	size_t getReadBufferSize() const
+	{
+		return m_blockReader.getBufferSize();
+	}
 
+	size_t getIoUringBufferMemory() const
+	{
+		return m_blockReader.getIoUringBufferMemory();
+	}
+
+	// overrides the memoryMapFiles config option
+	void setAllowMemoryMapping(bool allowMemoryMapping)
+	{
+		m_blockReader.setAllowMemoryMapping(allowMemoryMapping);
+	}
+
+	// what's already known about the file, which the operations use when reading it: the file descriptor it's already
+	// been opened with (or -1), which the grepper takes ownership of, and its size (or UINT64_MAX if it's not known).
+	// clearFileDetails() closes the file descriptor if it wasn't used.
+	void setFileDetails(const std::string& filename, int fileDescriptor, uint64_t fileSize)
+	{
+		m_blockReader.setFileDetails(filename, fileDescriptor, fileSize);
+	}
+
+	void clearFileDetails()
+	{
+		m_blockReader.clearFileDetails();
+	}
+
+	bool isOrMatch() const
+	{
+		return m_matchType == eMatchTypeOr;
+	}
+
+	// while a chunk is set, grepBasic(), countBasic() and matchBasicOr() only process that chunk of the file, and
+	// put their results in it rather than outputting anything. These are then combined (with chunk line numbers
+	// fixed up to be file line numbers) and output with the functions below.
+	void setChunk(FileChunk* pChunk)
+	{
+		m_pChunk = pChunk;
+	}
+
+	// these must be called for each chunk of the file in order, and return false once nothing's needed from any
+	// later chunks. Chunk memory is freed once it's combined.
+	bool combineChunkContentLines(const std::string& filename, FileChunk& chunk, bool limitToMatchCount, FileChunkTotals& totals);
+	bool combineChunkCount(FileChunk& chunk, FileChunkTotals& totals);
+
+	// outputs anything remaining once all the chunks needed have been combined, and returns whether anything was found
+	bool finishChunkedFile(const std::string& filename, bool countResults, const FileChunkTotals& totals);
+
+	// if an output merger is set, output is buffered up and passed to it (so that output from files processed in parallel
+	// doesn't interleave), otherwise it's written directly to stdout (without blank lines between files).
+	// startOutputFile() and finishOutputFile() must be called before and after processing each file when using one.
+	void setOutputMerger(OutputMerger* pOutputMerger)
+	{
+		m_pOutputMerger = pOutputMerger;
+	}
+
+	void startOutputFile(size_t fileIndex);
+	void finishOutputFile();
+
+	// returns the number of non-overlapping occurrences of the search string within the range (of complete lines).
+	// An empty search string counts once per line, as it matches every line but can't be found more than once in one.
+	static unsigned int countOccurrences(const Searcher& searcher, const char* start, const char* end);
 
 private:
-	bool openFileStream(const std::string& filename, std::fstream& fileStream);
+	// search strings combined with the short circuit strings, so they can both be searched for in a single pass
+	struct CombinedSearcher
+	{
+		CombinedSearcher() : numSearchStrings(0)
+		{
+		}
+
+		// the search strings, followed by the short circuit strings
+		MultiSearcher	searchAndShortCircuit;
+		// just the search strings
+		MultiSearcher	searchOnly;
+		unsigned int	numSearchStrings;
+	};
+
+	bool openFile(const std::string& filename)
+	{
+		return m_pChunk ? m_blockReader.openFileRange(filename, m_pChunk->start, m_pChunk->length) :
+						  m_blockReader.openFileRange(filename, m_readRangeStart, m_readRangeLength);
+	}
+
+	// for grepLast() - finds the offset the last matches (along with their before lines) start at, returning false
+	// if there aren't any
+	bool findLastMatchesStart(const std::string& filename, unsigned int numMatches, uint64_t& startOffset);
+
+	// for time windows - returns the offset of the first line at or after startOffset with a timestamp at or after the
+	// time (or the file size if there isn't one)
+	uint64_t findTimeOffset(int fileDescriptor, uint64_t fileSize, uint64_t startOffset, int64_t time) const;
+	// finds the first line starting within the range (or at the start of the next line if offset isn't the start of one)
+	// with a timestamp at or after minTime, returning false if there isn't one
+	bool findTimestampedLine(int fileDescriptor, uint64_t offset, uint64_t limit, int64_t minTime, uint64_t& lineOffset,
+							 int64_t& lineTime) const;
+
+	// for chunks, keeps track of the results of the processing
+	void setChunkResults(unsigned int foundCount, unsigned int lineCount, bool shortCircuited)
+	{
+		if (m_pChunk)
+		{
+			m_pChunk->foundCount = foundCount;
+			m_pChunk->lineCount = lineCount;
+			m_pChunk->shortCircuited = shortCircuited;
+		}
+	}
+
+	void initCombinedSearcher(CombinedSearcher& combinedSearcher, const std::vector<std::string>& searchStrings) const;
+
+	// finds the first search string within the range, also looking for the short circuit strings in the same pass.
+	// If a short circuit string is found in the same line as the search string or before it, scanEnd is moved back
+	// to the end of that line and shouldShortCircuit is set.
+	const char* findWithShortCircuit(const CombinedSearcher& combinedSearcher, const char* pos, const char*& scanEnd,
+									 bool& shouldShortCircuit) const;
+
+	// for regex searches, which can't be combined with the short circuit strings - if there's a short circuit
+	// string within the range, scanEnd is moved back to the end of its line and shouldShortCircuit is set
+	void limitToShortCircuitLine(const char* pos, const char*& scanEnd, bool& shouldShortCircuit) const
+	{
+		const char* shortCircuitLine = findShortCircuitLine(pos, scanEnd);
+		if (shortCircuitLine != nullptr)
+		{
+			scanEnd = BlockReader::findLineEnd(shortCircuitLine, scanEnd);
+			shouldShortCircuit = true;
+		}
+	}
+
+	const char* findMatchOrItem(const char* start, const char* end) const
+	{
+		return m_matchRegex ? m_matchOrRegexSearcher.find(start, end) : m_matchOrSearcher.find(start, end);
+	}
+
+	// returns the first position a short circuit string overlapping with something found at the given position could start
+	const char* getShortCircuitOverlapStart(const char* pos, const char* found) const
+	{
+		return ((size_t)(found - pos) >= m_maxShortCircuitStringLength) ? found + 1 - m_maxShortCircuitStringLength : pos;
+	}
+
+	// for lines which are being processed individually, rather than with findWithShortCircuit()
+	void checkLineForShortCircuit(const char* lineStart, const char* lineEnd, const char*& scanEnd, bool& shouldShortCircuit) const
+	{
+		if (m_shortCircuit && m_shortCircuitSearcher.find(lineStart, lineEnd) != nullptr)
+		{
+			scanEnd = lineEnd;
+			shouldShortCircuit = true;
+		}
+	}
+
+	// returns the start of the first line within the block containing a short circuit string, or nullptr
+	const char* findShortCircuitLine(const char* blockStart, const char* blockEnd) const;
+
+	// Context lines, shared by all the modes which output content lines.
+	// Before lines are found by going backwards from the matching line within the block, so nothing needs to be done
+	// for lines which don't match, other than copying the last few lines of each block (for matches near the start
+	// of the next block). After lines are output by each mode as it gets to them.
+	void resetContextLines();
+	// needs calling at the end of each block which was completely processed
+	void carryOverBeforeLines(const char* blockStart, const char* blockEnd);
+	// outputs the line, along with any of its before lines which haven't already been output
+	void outputMatchingLine(const char* blockStart, unsigned int lineIndex, const char* lineStart, const char* lineEnd);
+	void outputAfterLine(unsigned int lineIndex, const char* lineStart, const char* lineEnd)
+	{
+		outputContentLine(lineIndex, lineStart, lineEnd);
+		m_lastOutputContentLine = lineIndex;
+	}
+	// outputs each line in the range, incrementing lineIndex for each one
+	void outputContentLines(const char* start, const char* end, unsigned int& lineIndex);
+
+	void outputString(const char* str, size_t length);
+	// marks that this file's output should be separated from the previous file's (if configured to)
+	void outputFileSeparator()
+	{
+		if (!m_pChunk)
+		{
+			m_outputWantsFileSeparator = true;
+		}
+	}
+	void outputFilename(const std::string& filename);
+	void outputCount(const std::string& filename, unsigned int count);
+	void flushOutput();
+	void passOnOutputBuffer();
+
+	void outputContentLine(unsigned int lineIndex, const char* lineStart, const char* lineEnd);
+	void appendContentLine(std::string& output, unsigned int lineIndex, const char* lineStart, const char* lineEnd) const;
 	
 private:
 	const Config&	m_config;
@@ -69,23 +324,61 @@ private:
 	};
 
 	// cached stuff
-	unsigned int		m_readBufferSize;
-	char*				m_pReadBuffer;
+	BlockReader			m_blockReader;
+
+	// whether we need to keep track of line numbers as we go
+	bool				m_trackLineNumbers;
 	
-	bool				m_cacheBeforeLines;
-	StringBuffer		m_stringBuffer;
+	bool				m_outputBeforeLines;
+	// the last lines (up to the number of before lines) from before the current block, each ending with a new line
+	std::string			m_beforeLinesCarry;
+	// the last line output, so that context lines aren't output more than once
+	unsigned int		m_lastOutputContentLine;
+
+	// for grepLast(), the matching lines found within the current block
+	std::vector<const char*>	m_aBlockMatchLines;
+
+	// for tsdelta mode, the last line with a timestamp in from the previous block
+	std::string			m_lastTimestampLineCarry;
 	
+	// for grep and count
+	Searcher			m_searcher;
+
+	// whether the short circuit strings are searched for in the same pass as the search string / match items
+	// (which can't be done for regexes or case insensitive searches)
+	bool				m_combineShortCircuit;
+
 	// match items
 	MatchType			m_matchType;
-	std::vector<std::string>	m_aMatchItems;
+	bool				m_matchRegex;
+	// for And matching
+	std::vector<Searcher>		m_aMatchItems;
+	// for Or matching
+	MultiSearcher				m_matchOrSearcher;
+	Searcher					m_matchOrRegexSearcher; // all the items as alternatives of one regex
 	
 	bool				m_shortCircuit;
-	std::string			m_shortCircuitString;
+	MultiSearcher		m_shortCircuitSearcher;
+	size_t				m_maxShortCircuitStringLength;
+
+	// combined searchers for searching for the short circuit strings in the same pass (not used for regexes)
+	CombinedSearcher	m_searchCombinedSearcher;
+	CombinedSearcher	m_matchOrCombinedSearcher;
+	std::vector<CombinedSearcher>	m_aMatchAndCombinedSearchers; // one for each item
 	
-	bool				m_logTimestampSurround;
-	char				m_logTimestampBeforeChar;
-	char				m_logTimestampAfterChar;
-	unsigned int		m_logTimestampMinLineLength;
+	TimestampParser		m_timestampParser;
+
+	FileChunk*			m_pChunk;
+
+	uint64_t			m_readRangeStart;
+	uint64_t			m_readRangeLength;
+
+	OutputMerger*		m_pOutputMerger;
+	size_t				m_outputFileIndex;
+	std::string			m_outputBuffer;
+	// the size at which we next try and pass the buffered output on to the output merger
+	size_t				m_outputBufferPassOnSize;
+	bool				m_outputWantsFileSeparator;
 };
 
 #endif // FILE_GREPPER_H
@@ -0,0 +1,175 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "found_files.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+FoundFileQueue::FoundFileQueue(size_t maxQueuedFiles) :
+	m_maxQueuedFiles(maxQueuedFiles),
+	m_addedCount(0),
+	m_takenCount(0),
+	m_finished(false),
+	m_wakeCount(0),
+	m_maxPrefetchAhead(0),
+	m_prefetchIndex(0)
+{
+
+}
+
+FoundFileQueue::~FoundFileQueue()
+{
+	// close any prefetched files which never got taken
+	for (FoundFile& file : m_aFiles)
+	{
+		if (file.fileDescriptor != -1)
+		{
+			close(file.fileDescriptor);
+		}
+	}
+}
+
+void FoundFileQueue::addFoundFile(const std::string& filename, uint64_t fileSize)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (m_aFiles.size() >= m_maxQueuedFiles)
+	{
+		m_fileTakenEvent.wait(lock);
+	}
+
+	m_aFiles.emplace_back(FoundFile(filename, fileSize));
+	m_addedCount++;
+
+	m_fileAddedEvent.notify_one();
+	m_prefetchEvent.notify_one();
+}
+
+void FoundFileQueue::setFinished()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_finished = true;
+
+	m_fileAddedEvent.notify_all();
+	m_prefetchEvent.notify_all();
+}
+
+FoundFileQueue::NextFileResult FoundFileQueue::getNextFile(FoundFile& file, size_t& fileIndex, size_t wakeCount)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (m_aFiles.empty())
+	{
+		if (m_finished)
+			return eNextFileNoMoreFiles;
+
+		if (m_wakeCount != wakeCount)
+			return eNextFileWoken;
+
+		m_fileAddedEvent.wait(lock);
+	}
+
+	FoundFile& nextFile = m_aFiles.front();
+	file.filename.swap(nextFile.filename);
+	file.fileSize = nextFile.fileSize;
+	file.fileDescriptor = nextFile.fileDescriptor;
+	m_aFiles.pop_front();
+	fileIndex = m_takenCount++;
+
+	m_fileTakenEvent.notify_one();
+	// there's room for another file to be prefetched
+	m_prefetchEvent.notify_one();
+
+	return eNextFileFound;
+}
+
+size_t FoundFileQueue::getWakeCount()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	return m_wakeCount;
+}
+
+void FoundFileQueue::wakeWaiting()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_wakeCount++;
+
+	m_fileAddedEvent.notify_all();
+}
+
+size_t FoundFileQueue::getAddedCount(bool& finished)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	finished = m_finished;
+	return m_addedCount;
+}
+
+void FoundFileQueue::enablePrefetching(size_t maxFilesAhead)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_maxPrefetchAhead = maxFilesAhead;
+}
+
+bool FoundFileQueue::getNextFileToPrefetch(std::string& filename, uint64_t& fileSize, size_t& fileIndex)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (true)
+	{
+		// any files which got taken before we got to them are skipped
+		m_prefetchIndex = std::max(m_prefetchIndex, m_takenCount);
+
+		size_t queuePosition = m_prefetchIndex - m_takenCount;
+		if (queuePosition < m_aFiles.size() && queuePosition < m_maxPrefetchAhead)
+		{
+			filename = m_aFiles[queuePosition].filename;
+			fileSize = m_aFiles[queuePosition].fileSize;
+			fileIndex = m_prefetchIndex++;
+			return true;
+		}
+
+		if (m_finished && m_prefetchIndex >= m_addedCount)
+			return false;
+
+		m_prefetchEvent.wait(lock);
+	}
+}
+
+void FoundFileQueue::setPrefetchedFile(size_t fileIndex, int fileDescriptor, uint64_t fileSize)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	if (fileIndex >= m_takenCount)
+	{
+		FoundFile& file = m_aFiles[fileIndex - m_takenCount];
+		file.fileDescriptor = fileDescriptor;
+		file.fileSize = fileSize;
+	}
+	else
+	{
+		// it's already being processed, which will have opened it itself
+		close(fileDescriptor);
+	}
+}
@@ -0,0 +1,165 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef FOUND_FILES_H
+#define FOUND_FILES_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include <stdint.h>
+
+// for when the finder didn't need to stat() the file, so doesn't know its size
+static const uint64_t kUnknownFileSize = UINT64_MAX;
+
+// a found file, along with what's known about it so far
+struct FoundFile
+{
+	FoundFile(const std::string& foundFilename, uint64_t foundFileSize) : filename(foundFilename), fileSize(foundFileSize),
+		fileDescriptor(-1)
+	{
+	}
+
+	std::string		filename;
+	uint64_t		fileSize;		// when it was found, or kUnknownFileSize
+	int				fileDescriptor;	// if it's been opened ahead of time by prefetching
+};
+
+// Where FileFinders put the files they find. If the finder stat()ed the file (for filtering, or to work out what it is),
+// it passes on its size, so that it can be used to work out how best to read the file, otherwise it's kUnknownFileSize.
+
+class FoundFileSink
+{
+public:
+	FoundFileSink()
+	{
+	}
+
+	virtual ~FoundFileSink()
+	{
+	}
+
+	virtual void addFoundFile(const std::string& filename, uint64_t fileSize) = 0;
+};
+
+// just collects them in a list
+
+class FoundFileList : public FoundFileSink
+{
+public:
+	FoundFileList(std::vector<std::string>& files) : m_files(files)
+	{
+	}
+
+	virtual void addFoundFile(const std::string& filename, uint64_t /*fileSize*/) override
+	{
+		m_files.emplace_back(filename);
+	}
+
+protected:
+	std::vector<std::string>&	m_files;
+};
+
+// collects them in a list, along with their sizes
+
+class FoundFileDetailsList : public FoundFileSink
+{
+public:
+	FoundFileDetailsList(std::vector<FoundFile>& files) : m_files(files)
+	{
+	}
+
+	virtual void addFoundFile(const std::string& filename, uint64_t fileSize) override
+	{
+		m_files.emplace_back(FoundFile(filename, fileSize));
+	}
+
+protected:
+	std::vector<FoundFile>&		m_files;
+};
+
+// Bounded queue of found files, so that files can be processed (by multiple threads) while the finder is still
+// finding more, without the finder being able to get too far ahead. Each file is given an index in the order it
+// was added, which is the order they're taken off the queue in.
+// Prefetching can also be enabled, in which case a prefetching thread opens the next few files ahead of them being
+// taken off the queue (and starts reading them in), with the open file descriptor being handed on with the file.
+
+class FoundFileQueue : public FoundFileSink
+{
+public:
+	FoundFileQueue(size_t maxQueuedFiles);
+	~FoundFileQueue();
+
+	// blocks while the queue is full
+	virtual void addFoundFile(const std::string& filename, uint64_t fileSize) override;
+
+	// called once there won't be any more files added
+	void setFinished();
+
+	enum NextFileResult
+	{
+		eNextFileFound,
+		eNextFileNoMoreFiles, // the queue is finished and there are no more files
+		eNextFileWoken // wakeWaiting() was called
+	};
+
+	// blocks until there's a file available, the queue is finished, or wakeWaiting() has been called since wakeCount
+	// was got from getWakeCount() (so that a caller which checked for other work first can't miss being woken for it).
+	// the file's fileDescriptor is the file already opened by prefetching, or -1 if it hasn't been, and the caller owns it.
+	NextFileResult getNextFile(FoundFile& file, size_t& fileIndex, size_t wakeCount);
+
+	size_t getWakeCount();
+	// wakes up anything waiting in getNextFile(), so it can do something else
+	void wakeWaiting();
+
+	// the number of files added so far, and whether that's all there will be
+	size_t getAddedCount(bool& finished);
+
+	// for prefetching, which needs enabling before any files are taken off the queue. maxFilesAhead is how many of
+	// the files waiting on the queue can be prefetched at once.
+	void enablePrefetching(size_t maxFilesAhead);
+
+	// blocks until there's a file which needs prefetching, returning false once there won't be any more
+	bool getNextFileToPrefetch(std::string& filename, uint64_t& fileSize, size_t& fileIndex);
+	// hands over the open file descriptor for the file (and its size, if it was found out), which is closed if the file's
+	// already been taken
+	void setPrefetchedFile(size_t fileIndex, int fileDescriptor, uint64_t fileSize);
+
+protected:
+	std::mutex					m_lock;
+	std::condition_variable		m_fileAddedEvent;
+	std::condition_variable		m_fileTakenEvent;
+
+	std::deque<FoundFile>		m_aFiles;
+	size_t						m_maxQueuedFiles;
+
+	size_t						m_addedCount;
+	size_t						m_takenCount;
+	bool						m_finished;
+
+	size_t						m_wakeCount;
+
+	std::condition_variable		m_prefetchEvent;
+	size_t						m_maxPrefetchAhead; // 0 if prefetching isn't enabled
+	size_t						m_prefetchIndex; // the index of the next file to prefetch
+};
+
+#endif // FOUND_FILES_H
@@ -19,6 +19,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 
 #include <string>
 
@@ -30,9 +31,45 @@
 #include "tests/tests.h"
 #endif
 
+// parses a time delta value with an optional unit postfix ("us", "ms", "s", "m", "h" or "d"), with the value being
+// in minutes if there isn't one. Returns the delta in microseconds.
+static bool parseTimeDelta(const std::string& deltaString, uint64_t& microseconds)
+{
+	size_t unitPos = 0;
+	while (unitPos < deltaString.size() && isdigit(deltaString[unitPos]))
+	{
+		unitPos++;
+	}
+
+	if (unitPos == 0)
+		return false;
+
+	const uint64_t value = strtoull(deltaString.c_str(), nullptr, 10);
+	const std::string unit = deltaString.substr(unitPos);
+
+	uint64_t unitMicroseconds = 0;
+	if (unit == "us")
+		unitMicroseconds = 1;
+	else if (unit == "ms")
+		unitMicroseconds = 1000;
+	else if (unit == "s")
+		unitMicroseconds = 1000000ULL;
+	else if (unit.empty() || unit == "m")
+		unitMicroseconds = 60 * 1000000ULL;
+	else if (unit == "h")
+		unitMicroseconds = 60 * 60 * 1000000ULL;
+	else if (unit == "d")
+		unitMicroseconds = 24 * 60 * 60 * 1000000ULL;
+	else
+		return false;
+
+	microseconds = value * unitMicroseconds;
+	return true;
+}
+
 static void printHelp(bool fullOptions)
 {
-	fprintf(stderr, "Sniffle version 0.6.3. Copyright 2018-2022 Peter Pearson.\n");
+	fprintf(stderr, "Sniffle version 0.7. Copyright 2018-2022 Peter Pearson.\n");
 	fprintf(stderr, "Usage:\n");
 	fprintf(stderr, "sniffle [options] find <\"/path/to/search/*.log\">\n");
 	fprintf(stderr, "sniffle [options] find <\"/path/to/*/search/*.log\">\n");
@@ -40,9 +77,13 @@ static void printHelp(bool fullOptions)
 	fprintf(stderr, "sniffle [options] grep <stringToFind> <\"/path/to/search/*.log\">\n");
 	fprintf(stderr, "sniffle [options] [filter] grep <stringToFind> <\"/path/to/*/search/*.log\">\n");
 	fprintf(stderr, "sniffle [options] count <stringToFind>  <\"/path/to/*/search/*.log\">\n");
+	fprintf(stderr, "sniffle [options] tail <stringToFind> <\"/path/to/search/*.log\">    last match (or -m count matches) in each file.\n");
 	fprintf(stderr, "sniffle [options] match <tokens|to|find> <\"/path/to/search/*.log\">\n");
 	fprintf(stderr, "sniffle [options] match <tokens&to&find> <\"/path/to/*/search/*.log\">\n");
-	fprintf(stderr, "sniffle [options] tsdelta <mins> <\"/path/to/search/*.log\">\n");
+	fprintf(stderr, "sniffle [options] tsdelta <delta[us|ms|s|m|h|d]> <\"/path/to/search/*.log\">\n");
+	fprintf(stderr, "sniffle [options] window <start> <end> <\"/path/to/search/*.log\">\n");
+	fprintf(stderr, "sniffle [options] window <start> <end> grep|count|tail|match|tsdelta <args> <\"/path/to/search/*.log\">\n");
+	fprintf(stderr, "sniffle [options] follow grep|count <stringToFind> <\"/path/to/*/search/*.log\">    keep processing lines added to files.\n");
 	fprintf(stderr, "sniffle [options] debug <args>...    print args received.\n");
 	fprintf(stderr, "\nNote: in most shells, a path with wildcards in will likely have to be escaped/quoted to prevent auto-completed arguments being given to Sniffle.\n");
 	
@@ -52,10 +93,14 @@ static void printHelp(bool fullOptions)
 		fprintf(stderr, " -firstOnly\t\t\tMatch only the first item in each file.\n");
 		fprintf(stderr, " -m <count>\t\t\tMatch count.\n");
 		fprintf(stderr, " -ft <thread_count>\t\tNumber of threads to use to find files.\n");
-//		fprintf(stderr, " -gt <thread_count>\t\t\tNumber of threads to use to grep/process files.\n");
+		fprintf(stderr, " -gt <thread_count>\t\tNumber of threads to use to grep/process files.\n");
+		fprintf(stderr, " --unordered\t\t\tWith multiple grep threads, output files as they finish, rather than in order.\n");
 		fprintf(stderr, " -n\t\t\t\tOutput line numbers alongside content.\n");
 		fprintf(stderr, " -rd <limit>\t\t\tDirectory recursion depth limit.\n");
-		fprintf(stderr, " -sc <string>\t\t\tShort Circuit string.\n");
+		fprintf(stderr, " -sc <string>\t\t\tShort Circuit string (can be specified multiple times).\n");
+		fprintf(stderr, " -co\t\t\t\tCount all occurrences in count mode, rather than matching lines.\n");
+		fprintf(stderr, " -E\t\t\t\tSearch strings (and match items) are regular expressions.\n");
+		fprintf(stderr, " -i\t\t\t\tCase insensitive search (ASCII letters only).\n");
 		fprintf(stderr, " -C <line_count>\t\tContext lines to print either side of match.\n");
 		fprintf(stderr, " -B <line_count>\t\tContext lines to print before match.\n");
 		fprintf(stderr, " -A <line_count>\t\tContext lines to print after match.\n");
@@ -73,7 +118,9 @@ int main(int argc, char** argv)
 {
 #if RUN_TESTS
 	SniffleTests tests;
-	if (tests.testFilenameMatchers())
+	if (tests.testFilenameMatchers() && tests.testSearchKernels() && tests.testSearchers() && tests.testMultiSearcher() && tests.testCaseInsensitiveSearch() &&
+		tests.testRegexSearcher() && tests.testTimestampParser() && tests.testCountOccurrences() &&
+		tests.testIoUringReader())
 	{
 		fprintf(stderr, "Tests ran okay.\n");
 	}
@@ -147,6 +194,32 @@ int main(int argc, char** argv)
 	}
 
 	std::string mainCommand = argv[nextArg];
+
+	// a time window can be given before the content commands, so they only process the part of each file within it,
+	// otherwise the lines within it are just output
+	if (mainCommand == "window")
+	{
+		if (commandArgs < 4)
+		{
+			fprintf(stderr, "Error: Insufficient number of arguments for 'window' command.\n");
+			return -1;
+		}
+
+		sniffle.setTimeWindow(argv[nextArg + 1], argv[nextArg + 2]);
+
+		nextArg += 3;
+		commandArgs -= 3;
+		mainCommand = argv[nextArg];
+
+		if (mainCommand != "grep" && mainCommand != "count" && mainCommand != "tail" && mainCommand != "match" &&
+			mainCommand != "tsdelta")
+		{
+			std::string filePattern = argv[nextArg];
+
+			sniffle.runTimeWindow(filePattern);
+			return 0;
+		}
+	}
 	
 	if (mainCommand == "find")
 	{
@@ -186,6 +259,19 @@ int main(int argc, char** argv)
 		
 		sniffle.runCount(filePattern, contentsPattern);
 	}
+	else if (mainCommand == "tail")
+	{
+		if (commandArgs < 3)
+		{
+			fprintf(stderr, "Error: Insufficient number of arguments for 'tail' command.\n");
+			return -1;
+		}
+
+		std::string contentsPattern = argv[nextArg + 1];
+		std::string filePattern = argv[nextArg + 2];
+
+		sniffle.runTail(filePattern, contentsPattern);
+	}
 	else if (mainCommand == "match")
 	{
 		if (commandArgs < 3)
@@ -207,34 +293,36 @@ int main(int argc, char** argv)
 			return -1;
 		}
 
-		std::string tsDeltaParams = argv[nextArg + 1];
+		uint64_t tsDelta = 0;
+		if (!parseTimeDelta(argv[nextArg + 1], tsDelta))
+		{
+			fprintf(stderr, "Error: Invalid time delta specified for 'tsdelta' command: %s\n", argv[nextArg + 1]);
+			return -1;
+		}
 
-		uint64_t tsDelta = 0; // in minutes by default
+		std::string filePattern = argv[nextArg + 2];
 
-		// see if we have non-numeric char at the end
-		if (!isdigit(tsDeltaParams[tsDeltaParams.size() - 1]))
+		sniffle.runTimestampDeltaFind(filePattern, tsDelta);
+	}
+	else if (mainCommand == "follow")
+	{
+		if (commandArgs < 4)
 		{
-			char postFixChar = tsDeltaParams[tsDeltaParams.size() - 1];
-			std::string valueString = tsDeltaParams.substr(0, tsDeltaParams.size() - 1);
-			tsDelta = atoi(valueString.c_str());
-
-			if (postFixChar == 'h')
-			{
-				tsDelta *= 60;
-			}
-			else if (postFixChar == 'd')
-			{
-				tsDelta *= 60 * 24;
-			}
+			fprintf(stderr, "Error: Insufficient number of arguments for 'follow' command.\n");
+			return -1;
 		}
-		else
+
+		std::string followCommand = argv[nextArg + 1];
+		if (followCommand != "grep" && followCommand != "count")
 		{
-			tsDelta = atoi(tsDeltaParams.c_str());
+			fprintf(stderr, "Error: 'follow' command only supports grep and count.\n");
+			return -1;
 		}
 
-		std::string filePattern = argv[nextArg + 2];
+		std::string contentsPattern = argv[nextArg + 2];
+		std::string filePattern = argv[nextArg + 3];
 
-		sniffle.runTimestampDeltaFind(filePattern, tsDelta * 60);
+		sniffle.runFollow(filePattern, contentsPattern, followCommand == "count");
 	}
 
 	return 0;
@@ -0,0 +1,323 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "multi_searcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <cctype>
+
+#include "utils/string_helpers.h"
+
+static const unsigned int kNoSearchString = (unsigned int)-1;
+
+MultiSearcher::MultiSearcher() :
+	m_useStringsKernel(false),
+	m_caseInsensitive(false),
+	m_numStartChars(0),
+	m_numByteClasses(0),
+	m_firstMatchStateOffset(0)
+{
+	memset(m_byteClasses, 0, sizeof(m_byteClasses));
+}
+
+bool MultiSearcher::init(const std::vector<std::string>& searchStrings, bool caseInsensitive)
+{
+	m_aTransitions.clear();
+	m_aMatchStateSearchStrings.clear();
+	m_aSearchStringLengths.clear();
+	m_numStartChars = 0;
+
+	if (searchStrings.empty())
+		return false;
+
+	for (const std::string& searchString : searchStrings)
+	{
+		if (searchString.empty())
+			return false;
+
+		m_aSearchStringLengths.emplace_back(searchString.size());
+	}
+
+	m_aSearchStrings = searchStrings;
+	m_caseInsensitive = false;
+
+	if (caseInsensitive)
+	{
+		for (std::string& searchString : m_aSearchStrings)
+		{
+			StringHelpers::toLower(searchString);
+			m_caseInsensitive |= StringHelpers::containsLetters(searchString);
+		}
+	}
+
+	m_useStringsKernel = searchStrings.size() <= SearchKernels::kMaxFindStringsNeedles;
+	if (m_useStringsKernel)
+		return true;
+
+	return initDFA(m_aSearchStrings);
+}
+
+bool MultiSearcher::initDFA(const std::vector<std::string>& searchStrings)
+{
+	// work out the byte classes - each byte used in any of the search strings gets its own class,
+	// and everything else shares class 0.
+	memset(m_byteClasses, 0, sizeof(m_byteClasses));
+	m_numByteClasses = 1;
+	for (const std::string& searchString : searchStrings)
+	{
+		for (unsigned char c : searchString)
+		{
+			if (m_byteClasses[c] == 0)
+			{
+				m_byteClasses[c] = m_numByteClasses++;
+			}
+		}
+	}
+
+	if (m_caseInsensitive)
+	{
+		// the search strings are lower case, so upper case letters just need to go to the same classes
+		for (unsigned int c = 'A'; c <= 'Z'; c++)
+		{
+			m_byteClasses[c] = m_byteClasses[tolower(c)];
+		}
+	}
+
+	// build the trie of all the search strings, with state 0 being the start state
+	const unsigned int numClasses = m_numByteClasses;
+	const int kNoState = -1;
+
+	std::vector<int> aTrieNext(numClasses, kNoState);
+	std::vector<unsigned int> aStateSearchString(1, kNoSearchString);
+
+	for (unsigned int i = 0; i < searchStrings.size(); i++)
+	{
+		int state = 0;
+		for (unsigned char c : searchStrings[i])
+		{
+			const size_t nextIndex = state * numClasses + m_byteClasses[c];
+			if (aTrieNext[nextIndex] == kNoState)
+			{
+				aTrieNext[nextIndex] = (int)aStateSearchString.size();
+				aStateSearchString.emplace_back(kNoSearchString);
+				aTrieNext.resize(aTrieNext.size() + numClasses, kNoState);
+			}
+			state = aTrieNext[nextIndex];
+		}
+
+		// if the same string is given more than once, keep the first index
+		aStateSearchString[state] = std::min(aStateSearchString[state], i);
+	}
+
+	const unsigned int numStates = aStateSearchString.size();
+
+	// now turn the trie into a full DFA by filling in the missing transitions via the failure links,
+	// processing states in breadth-first order so the failure state's transitions are always complete first.
+	// Outputs are also propagated along failure links, as if a state matches, all the states whose strings
+	// are suffixes of it do as well.
+	std::vector<unsigned int> aDFANext(numStates * numClasses, 0);
+	std::vector<unsigned int> aFailure(numStates, 0);
+	std::deque<unsigned int> stateQueue;
+
+	for (unsigned int c = 0; c < numClasses; c++)
+	{
+		int next = aTrieNext[c];
+		if (next != kNoState)
+		{
+			aDFANext[c] = next;
+			aFailure[next] = 0;
+			stateQueue.push_back(next);
+		}
+	}
+
+	while (!stateQueue.empty())
+	{
+		const unsigned int state = stateQueue.front();
+		stateQueue.pop_front();
+
+		const unsigned int failureState = aFailure[state];
+		aStateSearchString[state] = std::min(aStateSearchString[state], aStateSearchString[failureState]);
+
+		for (unsigned int c = 0; c < numClasses; c++)
+		{
+			int next = aTrieNext[state * numClasses + c];
+			if (next != kNoState)
+			{
+				aDFANext[state * numClasses + c] = next;
+				aFailure[next] = aDFANext[failureState * numClasses + c];
+				stateQueue.push_back(next);
+			}
+			else
+			{
+				aDFANext[state * numClasses + c] = aDFANext[failureState * numClasses + c];
+			}
+		}
+	}
+
+	// re-number the states so that all the match states are at the end, keeping the start state as 0
+	std::vector<unsigned int> aNewStateIndices(numStates);
+	unsigned int newStateIndex = 0;
+	for (unsigned int i = 0; i < numStates; i++)
+	{
+		if (aStateSearchString[i] == kNoSearchString)
+		{
+			aNewStateIndices[i] = newStateIndex++;
+		}
+	}
+
+	const unsigned int firstMatchState = newStateIndex;
+	m_aMatchStateSearchStrings.resize(numStates - firstMatchState);
+
+	for (unsigned int i = 0; i < numStates; i++)
+	{
+		if (aStateSearchString[i] != kNoSearchString)
+		{
+			m_aMatchStateSearchStrings[newStateIndex - firstMatchState] = aStateSearchString[i];
+			aNewStateIndices[i] = newStateIndex++;
+		}
+	}
+
+	m_firstMatchStateOffset = firstMatchState * numClasses;
+
+	m_aTransitions.resize(numStates * numClasses);
+	for (unsigned int i = 0; i < numStates; i++)
+	{
+		uint32_t* pNewRow = &m_aTransitions[aNewStateIndices[i] * numClasses];
+		for (unsigned int c = 0; c < numClasses; c++)
+		{
+			pNewRow[c] = aNewStateIndices[aDFANext[i * numClasses + c]] * numClasses;
+		}
+	}
+
+	// see if there are few enough different first chars to make skipping ahead in the start state worthwhile
+	std::vector<char> aStartChars;
+	for (const std::string& searchString : searchStrings)
+	{
+		aStartChars.emplace_back(searchString[0]);
+		if (m_caseInsensitive)
+		{
+			aStartChars.emplace_back(toupper(searchString[0]));
+		}
+	}
+
+	for (char startChar : aStartChars)
+	{
+		if (std::find(m_startChars, m_startChars + m_numStartChars, startChar) != m_startChars + m_numStartChars)
+			continue;
+
+		if (m_numStartChars == SearchKernels::kMaxFindFirstOfChars)
+		{
+			m_numStartChars = 0;
+			break;
+		}
+
+		m_startChars[m_numStartChars++] = startChar;
+	}
+
+	return true;
+}
+
+const char* MultiSearcher::find(const char* start, const char* end, unsigned int* pSearchStringIndex) const
+{
+	if (m_useStringsKernel)
+	{
+		const unsigned int numSearchStrings = m_aSearchStrings.size();
+		const char* searchStringPointers[SearchKernels::kMaxFindStringsNeedles];
+		for (unsigned int i = 0; i < numSearchStrings; i++)
+		{
+			searchStringPointers[i] = m_aSearchStrings[i].c_str();
+		}
+
+		unsigned int searchStringIndex = 0;
+		const char* found = nullptr;
+		if (m_caseInsensitive)
+		{
+			found = SearchKernels::findStringsCaseInsensitive(start, end - start, searchStringPointers, m_aSearchStringLengths.data(),
+															  numSearchStrings, searchStringIndex);
+		}
+		else
+		{
+			found = SearchKernels::findStrings(start, end - start, searchStringPointers, m_aSearchStringLengths.data(),
+											   numSearchStrings, searchStringIndex);
+		}
+		if (found != nullptr && pSearchStringIndex)
+		{
+			*pSearchStringIndex = searchStringIndex;
+		}
+
+		return found;
+	}
+
+	return findDFA(start, end, pSearchStringIndex);
+}
+
+const char* MultiSearcher::findDFA(const char* start, const char* end, unsigned int* pSearchStringIndex) const
+{
+	const uint32_t* pTransitions = m_aTransitions.data();
+	const unsigned char* pos = (const unsigned char*)start;
+	const unsigned char* pEnd = (const unsigned char*)end;
+
+	uint32_t stateOffset = 0;
+
+	if (m_numStartChars > 0)
+	{
+		while (pos < pEnd)
+		{
+			if (stateOffset == 0)
+			{
+				pos = (const unsigned char*)SearchKernels::findFirstOf((const char*)pos, pEnd - pos, m_startChars, m_numStartChars);
+				if (pos == nullptr)
+					return nullptr;
+			}
+
+			stateOffset = pTransitions[stateOffset + m_byteClasses[*pos]];
+			if (stateOffset >= m_firstMatchStateOffset)
+				return getMatchStart(pos, stateOffset, pSearchStringIndex);
+
+			pos++;
+		}
+	}
+	else
+	{
+		// keep this loop as simple as possible, as it's limited by the latency of each transition lookup
+		const uint32_t firstMatchStateOffset = m_firstMatchStateOffset;
+		while (pos < pEnd)
+		{
+			stateOffset = pTransitions[stateOffset + m_byteClasses[*pos]];
+			if (stateOffset >= firstMatchStateOffset)
+				return getMatchStart(pos, stateOffset, pSearchStringIndex);
+
+			pos++;
+		}
+	}
+
+	return nullptr;
+}
+
+const char* MultiSearcher::getMatchStart(const unsigned char* matchLastChar, uint32_t stateOffset, unsigned int* pSearchStringIndex) const
+{
+	unsigned int searchStringIndex = m_aMatchStateSearchStrings[(stateOffset - m_firstMatchStateOffset) / m_numByteClasses];
+	if (pSearchStringIndex)
+	{
+		*pSearchStringIndex = searchStringIndex;
+	}
+
+	return (const char*)matchLastChar + 1 - m_aSearchStringLengths[searchStringIndex];
+}
@@ -0,0 +1,92 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef MULTI_SEARCHER_H
+#define MULTI_SEARCHER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "utils/search_kernels.h"
+
+// Searches for multiple literal strings at once in a single pass over the content.
+// For a small number of search strings, the SearchKernels vectorised multiple string search is used,
+// otherwise an Aho-Corasick automaton compiled down to a dense DFA is used.
+// For the DFA, bytes which don't appear in any of the search strings all share the same byte class, so the
+// transition table only needs a column for each distinct byte in the search strings, which
+// keeps it small enough to stay in cache for typical numbers of search strings. For case insensitive searches,
+// both cases of each letter just share the same byte class.
+
+class MultiSearcher
+{
+public:
+	MultiSearcher();
+
+	// returns false if there were no search strings, or any were empty.
+	// If caseInsensitive is set, ASCII letters in the search strings match either case.
+	bool init(const std::vector<std::string>& searchStrings, bool caseInsensitive = false);
+
+	// returns the start position of the first match of any of the search strings within the range, or nullptr
+	// if none were found. Depending on the method used, the first match is either the one which starts first or
+	// the one which ends first, but either way no other match lies completely before it (so as long as the
+	// search strings don't contain newlines, it's always within the first line with a match).
+	// If pSearchStringIndex is provided, it's set to the index of the search string which matched.
+	const char* find(const char* start, const char* end, unsigned int* pSearchStringIndex = nullptr) const;
+
+	size_t getSearchStringCount() const
+	{
+		return m_aSearchStringLengths.size();
+	}
+
+	const char* getMatchStart(const unsigned char* matchLastChar, uint32_t stateOffset, unsigned int* pSearchStringIndex) const;
+
+private:
+	bool initDFA(const std::vector<std::string>& searchStrings);
+
+	const char* findDFA(const char* start, const char* end, unsigned int* pSearchStringIndex) const;
+
+private:
+	// for small numbers of search strings
+	bool						m_useStringsKernel;
+	bool						m_caseInsensitive;
+	std::vector<std::string>	m_aSearchStrings; // lower case if case insensitive
+
+	// when all search strings start with one of a small number of chars, we can skip quickly to
+	// the next occurrence of one of these when we're in the start state
+	unsigned int				m_numStartChars;
+	char						m_startChars[SearchKernels::kMaxFindFirstOfChars];
+
+	unsigned int				m_numByteClasses;
+	uint32_t					m_byteClasses[256];
+
+	// next state for each state and byte class. The stored values are pre-multiplied by the number of byte
+	// classes, so they can be used directly as the row offset for the next lookup.
+	std::vector<uint32_t>		m_aTransitions;
+
+	// states are ordered so that all states which are the end of at least one search string are last,
+	// so only one comparison is needed to check for a match.
+	uint32_t					m_firstMatchStateOffset;
+
+	// search string index matched for each match state (the lowest index, if more than one match there)
+	std::vector<unsigned int>	m_aMatchStateSearchStrings;
+
+	std::vector<size_t>			m_aSearchStringLengths;
+};
+
+#endif // MULTI_SEARCHER_H
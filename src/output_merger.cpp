@@ -0,0 +1,182 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "output_merger.h"
+
+#include <cstdio>
+
+#include <algorithm>
+
+#include "config.h"
+
+// above this, output from a file which can't be written yet isn't held back any longer, and the file's
+// processing waits until it can be written instead
+static const size_t kMaxHeldFileOutputSize = 4 * 1024 * 1024;
+
+OutputMerger::OutputMerger(const Config& config) : m_config(config),
+	m_ordered(true),
+	m_windowSize(1),
+	m_nextFileIndex(0),
+	m_writingFileIndex(kNoFile),
+	m_writtenAnyOutput(false),
+	m_wakeCount(0)
+{
+
+}
+
+void OutputMerger::init(bool ordered, unsigned int windowSize)
+{
+	m_ordered = ordered;
+	m_windowSize = std::max(windowSize, 1u);
+
+	m_nextFileIndex = 0;
+	m_heldFileOutputs.clear();
+	m_writingFileIndex = kNoFile;
+	m_writtenAnyOutput = false;
+}
+
+bool OutputMerger::waitToStartFile(size_t fileIndex, size_t wakeCount)
+{
+	if (!m_ordered)
+		return true;
+
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (fileIndex >= m_nextFileIndex + m_windowSize)
+	{
+		if (m_wakeCount != wakeCount)
+			return false;
+
+		m_outputWrittenEvent.wait(lock);
+	}
+
+	return true;
+}
+
+size_t OutputMerger::getWakeCount()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	return m_wakeCount;
+}
+
+void OutputMerger::wakeWaiting()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_wakeCount++;
+
+	m_outputWrittenEvent.notify_all();
+}
+
+bool OutputMerger::addPartialFileOutput(size_t fileIndex, std::string& output, bool wantsSeparator)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	if (!canWriteFileOutput(fileIndex))
+	{
+		if (output.size() < kMaxHeldFileOutputSize)
+			return false;
+
+		while (!canWriteFileOutput(fileIndex))
+		{
+			m_outputWrittenEvent.wait(lock);
+		}
+	}
+
+	writeFileOutput(fileIndex, output, wantsSeparator);
+	output.clear();
+
+	return true;
+}
+
+void OutputMerger::finishFile(size_t fileIndex, std::string& output, bool wantsSeparator)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	if (!m_ordered)
+	{
+		// we can't write anything out while another file's part-way through being written
+		while (!canWriteFileOutput(fileIndex))
+		{
+			m_outputWrittenEvent.wait(lock);
+		}
+
+		writeFileOutput(fileIndex, output, wantsSeparator);
+		output.clear();
+
+		m_writingFileIndex = kNoFile;
+		m_outputWrittenEvent.notify_all();
+		return;
+	}
+
+	if (fileIndex != m_nextFileIndex)
+	{
+		// hold it back until it's its turn
+		HeldFileOutput& heldOutput = m_heldFileOutputs[fileIndex];
+		heldOutput.output.swap(output);
+		heldOutput.wantsSeparator = wantsSeparator;
+		output.clear();
+		return;
+	}
+
+	writeFileOutput(fileIndex, output, wantsSeparator);
+	output.clear();
+
+	m_writingFileIndex = kNoFile;
+	m_nextFileIndex++;
+
+	// and now write out any following files which have already finished
+	std::map<size_t, HeldFileOutput>::iterator itHeld = m_heldFileOutputs.begin();
+	while (itHeld != m_heldFileOutputs.end() && itHeld->first == m_nextFileIndex)
+	{
+		writeFileOutput(itHeld->first, itHeld->second.output, itHeld->second.wantsSeparator);
+
+		m_writingFileIndex = kNoFile;
+		m_nextFileIndex++;
+
+		itHeld = m_heldFileOutputs.erase(itHeld);
+	}
+
+	m_outputWrittenEvent.notify_all();
+}
+
+void OutputMerger::writeFileOutput(size_t fileIndex, const std::string& output, bool wantsSeparator)
+{
+	if (output.empty())
+		return;
+
+	if (m_writingFileIndex != fileIndex)
+	{
+		// it's the start of this file's output
+		if (m_writtenAnyOutput && wantsSeparator && m_config.getBlankLinesBetweenFiles())
+		{
+			fputc('\n', stdout);
+		}
+
+		m_writingFileIndex = fileIndex;
+		m_writtenAnyOutput = true;
+	}
+
+	fwrite(output.c_str(), 1, output.size(), stdout);
+
+	if (m_config.getFlushOutput())
+	{
+		fflush(stdout);
+	}
+}
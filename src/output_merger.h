@@ -0,0 +1,110 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef OUTPUT_MERGER_H
+#define OUTPUT_MERGER_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+class Config;
+
+// Takes the output for each file being processed (possibly in parallel, so finishing out of order), and writes it
+// out to stdout so that output from different files never interleaves.
+// In ordered mode, files are output in the order of their file indices. The file at the head of that order can
+// write its output out as it goes, while the output of files which finish before it is held back until it's their
+// turn. To bound the memory used for that, files can only be started within a window of the head file, and a file
+// which builds up too much output waits until it becomes the head.
+// In unordered mode, each file's output is written out as soon as the file's finished (or as it goes for files
+// with a lot of output, as long as no other file is part-way through being written).
+// This is also where blank lines between files are written, as it's the only place which knows whether
+// a previous file had any output.
+
+class OutputMerger
+{
+public:
+	OutputMerger(const Config& config);
+
+	// window size is the max number of files (from the head file) which can be in progress or held back at once
+	void init(bool ordered, unsigned int windowSize);
+
+	// blocks until the file is within the window, so can be started, returning true, or until wakeWaiting() has been
+	// called since wakeCount was got from getWakeCount(), returning false.
+	bool waitToStartFile(size_t fileIndex, size_t wakeCount);
+
+	size_t getWakeCount();
+	// wakes up anything waiting in waitToStartFile(), so it can do something else
+	void wakeWaiting();
+
+	// for output from a file which is still being processed. If it can be written out now, it is and output is
+	// cleared, otherwise the caller should keep it and carry on adding to it. If there's too much output to keep
+	// holding back, this waits until it can be written.
+	// wantsSeparator is whether the file's output should be separated from any previous file's by a blank line.
+	// Returns whether the output was written.
+	bool addPartialFileOutput(size_t fileIndex, std::string& output, bool wantsSeparator);
+
+	// for the remaining output of a file which has finished (which might be empty, but this still needs
+	// to be called for every file in ordered mode). Output is cleared.
+	void finishFile(size_t fileIndex, std::string& output, bool wantsSeparator);
+
+protected:
+	bool canWriteFileOutput(size_t fileIndex) const
+	{
+		if (m_ordered)
+			return fileIndex == m_nextFileIndex;
+
+		return m_writingFileIndex == kNoFile || m_writingFileIndex == fileIndex;
+	}
+
+	// m_lock must be held
+	void writeFileOutput(size_t fileIndex, const std::string& output, bool wantsSeparator);
+
+protected:
+	static const size_t			kNoFile = (size_t)-1;
+
+	struct HeldFileOutput
+	{
+		std::string		output;
+		bool			wantsSeparator;
+	};
+
+	const Config&				m_config;
+
+	bool						m_ordered;
+	unsigned int				m_windowSize;
+
+	std::mutex					m_lock;
+	std::condition_variable		m_outputWrittenEvent;
+
+	// for ordered mode, the next file to be output
+	size_t						m_nextFileIndex;
+	// finished files waiting for their turn to be output in ordered mode
+	std::map<size_t, HeldFileOutput>	m_heldFileOutputs;
+
+	// the file which has been part-written, so nothing else can be written until it finishes
+	size_t						m_writingFileIndex;
+
+	// whether any file has had output written yet
+	bool						m_writtenAnyOutput;
+
+	size_t						m_wakeCount;
+};
+
+#endif // OUTPUT_MERGER_H
@@ -0,0 +1,1309 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "regex_searcher.h"
+
+#include <cstring>
+#include <cctype>
+
+#include <algorithm>
+
+#include "utils/block_reader.h"
+
+static const unsigned int kRepeatUnlimited = (unsigned int)-1;
+// {n,m} repeats get expanded out to copies of what's repeated, so this needs limiting
+static const unsigned int kMaxRepeatCount = 1000;
+
+static const size_t kMaxNFAStates = 50000;
+
+// once the DFA cache gets to this many states it's thrown away and started again, which keeps
+// the memory use bounded for pathological patterns (the transition table is at most 4 MB)
+static const size_t kMaxDFAStates = 4096;
+
+// more than this many alternative literals isn't worth searching for first
+static const size_t kMaxRequiredLiterals = 16;
+static const size_t kMaxRepeatedLiteralLength = 64;
+
+uint32_t RegexNFA::addState(State::Type type, uint32_t out, uint32_t out1, uint32_t charSet)
+{
+	if (aStates.size() >= kMaxNFAStates)
+	{
+		// we keep going (without adding anything), and it gets reported as an error afterwards
+		tooLarge = true;
+		return out;
+	}
+
+	aStates.emplace_back(State(type, out, out1, charSet));
+	return aStates.size() - 1;
+}
+
+const int32_t RegexDFA::kUnknown;
+const int32_t RegexDFA::kMatch;
+
+RegexDFA::RegexDFA() :
+	m_unanchored(true),
+	m_stopAtMatch(true),
+	m_numByteClasses(1),
+	m_newLineByteClass(0),
+	m_lineStartRow(0),
+	m_midLineStartRow(0),
+	m_closureMark(0)
+{
+	memset(m_byteClasses, 0, sizeof(m_byteClasses));
+	memset(m_byteClassChars, 0, sizeof(m_byteClassChars));
+}
+
+void RegexDFA::init(const RegexNFA& nfa, bool unanchored, bool stopAtMatch)
+{
+	m_nfa = nfa;
+	m_unanchored = unanchored;
+	m_stopAtMatch = stopAtMatch;
+
+	// start off with everything in the same class apart from '\n', and then split the classes by each char set
+	memset(m_byteClasses, 0, sizeof(m_byteClasses));
+	m_byteClasses[(unsigned char)'\n'] = 1;
+	m_numByteClasses = 2;
+
+	for (const RegexNFA::CharSet& charSet : m_nfa.aCharSets)
+	{
+		// the new class for each existing class, for chars in and out of the set
+		int newClasses[256][2];
+		memset(newClasses, -1, sizeof(newClasses));
+
+		unsigned int numNewClasses = 0;
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			int& newClass = newClasses[m_byteClasses[i]][charSet.test(i) ? 1 : 0];
+			if (newClass == -1)
+			{
+				newClass = numNewClasses++;
+			}
+			m_byteClasses[i] = newClass;
+		}
+
+		m_numByteClasses = numNewClasses;
+	}
+
+	m_newLineByteClass = m_byteClasses[(unsigned char)'\n'];
+
+	for (unsigned int i = 0; i < 256; i++)
+	{
+		m_byteClassChars[m_byteClasses[i]] = (unsigned char)i;
+	}
+
+	m_aClosureMarks.assign(m_nfa.aStates.size(), 0);
+	m_closureMark = 0;
+
+	resetCache();
+}
+
+const char* RegexDFA::findMatchingLine(const char* start, const char* end) const
+{
+	// '\n' transitions go back to the line start state (or are a match for patterns ending with '$'), so
+	// the whole range can be scanned in one go
+	int32_t row = m_lineStartRow;
+
+	for (const char* pos = start; pos < end; pos++)
+	{
+		int32_t nextRow = getNextRow(row, (unsigned char)*pos);
+		if (nextRow == kMatch)
+			return pos;
+
+		row = nextRow;
+	}
+
+	// the last line might not have a '\n' at the end
+	if (end > start && end[-1] != '\n' && isMatchAtLineEnd(row))
+		return end - 1;
+
+	return nullptr;
+}
+
+void RegexDFA::startClosure() const
+{
+	m_closureMark++;
+	if (m_closureMark == 0)
+	{
+		// it's wrapped around, so old marks could look current
+		std::fill(m_aClosureMarks.begin(), m_aClosureMarks.end(), 0);
+		m_closureMark = 1;
+	}
+}
+
+void RegexDFA::addToClosure(uint32_t nfaState, bool atLineStart, std::vector<uint32_t>& aClosure) const
+{
+	m_aClosureStack.clear();
+	m_aClosureStack.emplace_back(nfaState);
+
+	while (!m_aClosureStack.empty())
+	{
+		uint32_t state = m_aClosureStack.back();
+		m_aClosureStack.pop_back();
+
+		if (m_aClosureMarks[state] == m_closureMark)
+			continue;
+
+		m_aClosureMarks[state] = m_closureMark;
+
+		const RegexNFA::State& nfaState = m_nfa.aStates[state];
+		switch (nfaState.type)
+		{
+			case RegexNFA::State::eTypeChars:
+			case RegexNFA::State::eTypeMatch:
+			case RegexNFA::State::eTypeLineEnd: // resolved once we get to the end of the line
+				aClosure.emplace_back(state);
+				break;
+			case RegexNFA::State::eTypeSplit:
+				m_aClosureStack.emplace_back(nfaState.out1);
+				m_aClosureStack.emplace_back(nfaState.out);
+				break;
+			case RegexNFA::State::eTypeLineStart:
+				if (atLineStart)
+				{
+					m_aClosureStack.emplace_back(nfaState.out);
+				}
+				break;
+		}
+	}
+}
+
+bool RegexDFA::isMatchAtLineEnd(const std::vector<uint32_t>& aNFAStates) const
+{
+	startClosure();
+
+	m_aClosureStack.clear();
+	for (uint32_t state : aNFAStates)
+	{
+		const RegexNFA::State& nfaState = m_nfa.aStates[state];
+		if (nfaState.type == RegexNFA::State::eTypeMatch)
+			return true;
+
+		if (nfaState.type == RegexNFA::State::eTypeLineEnd)
+		{
+			m_aClosureStack.emplace_back(nfaState.out);
+		}
+	}
+
+	while (!m_aClosureStack.empty())
+	{
+		uint32_t state = m_aClosureStack.back();
+		m_aClosureStack.pop_back();
+
+		if (m_aClosureMarks[state] == m_closureMark)
+			continue;
+
+		m_aClosureMarks[state] = m_closureMark;
+
+		const RegexNFA::State& nfaState = m_nfa.aStates[state];
+		switch (nfaState.type)
+		{
+			case RegexNFA::State::eTypeMatch:
+				return true;
+			case RegexNFA::State::eTypeSplit:
+				m_aClosureStack.emplace_back(nfaState.out1);
+				m_aClosureStack.emplace_back(nfaState.out);
+				break;
+			case RegexNFA::State::eTypeLineEnd:
+				m_aClosureStack.emplace_back(nfaState.out);
+				break;
+			default:
+				// anything else needs another char
+				break;
+		}
+	}
+
+	return false;
+}
+
+void RegexDFA::resetCache() const
+{
+	m_aStates.clear();
+	m_stateRows.clear();
+	m_aTransitions.clear();
+
+	std::vector<uint32_t> aStartStates;
+
+	startClosure();
+	addToClosure(m_nfa.start, true, aStartStates);
+	m_lineStartRow = getStateRow(aStartStates);
+
+	aStartStates.clear();
+	startClosure();
+	addToClosure(m_nfa.start, false, aStartStates);
+	m_midLineStartRow = getStateRow(aStartStates);
+}
+
+int32_t RegexDFA::getStateRow(std::vector<uint32_t>& aNFAStates) const
+{
+	std::sort(aNFAStates.begin(), aNFAStates.end());
+
+	std::map<std::vector<uint32_t>, int32_t>::const_iterator itFind = m_stateRows.find(aNFAStates);
+	if (itFind != m_stateRows.end())
+		return itFind->second;
+
+	if (m_aStates.size() >= kMaxDFAStates)
+	{
+		// start again, with just the start states and this one
+		std::vector<uint32_t> aKeepStates;
+		aKeepStates.swap(aNFAStates);
+		resetCache();
+		aNFAStates.swap(aKeepStates);
+
+		itFind = m_stateRows.find(aNFAStates);
+		if (itFind != m_stateRows.end())
+			return itFind->second;
+	}
+
+	int32_t row = m_aStates.size() * m_numByteClasses;
+
+	m_aStates.emplace_back(State());
+	State& newState = m_aStates.back();
+	newState.aNFAStates = aNFAStates;
+	newState.isMatch = std::binary_search(aNFAStates.begin(), aNFAStates.end(), m_nfa.match);
+	newState.isMatchAtLineEnd = isMatchAtLineEnd(aNFAStates);
+
+	m_stateRows[aNFAStates] = row;
+	m_aTransitions.resize(m_aTransitions.size() + m_numByteClasses, kUnknown);
+
+	return row;
+}
+
+int32_t RegexDFA::computeTransition(int32_t fromRow, unsigned int byteClass) const
+{
+	const State& fromState = m_aStates[fromRow / m_numByteClasses];
+
+	if (byteClass == m_newLineByteClass)
+	{
+		// the end of the line, so we either matched, or start again at the start of the next line
+		int32_t nextRow = (m_stopAtMatch && fromState.isMatchAtLineEnd) ? kMatch : m_lineStartRow;
+		m_aTransitions[fromRow + byteClass] = nextRow;
+		return nextRow;
+	}
+
+	const unsigned char c = m_byteClassChars[byteClass];
+
+	m_aNextNFAStates.clear();
+	startClosure();
+
+	for (uint32_t state : fromState.aNFAStates)
+	{
+		const RegexNFA::State& nfaState = m_nfa.aStates[state];
+		if (nfaState.type == RegexNFA::State::eTypeChars && m_nfa.aCharSets[nfaState.charSet].test(c))
+		{
+			addToClosure(nfaState.out, false, m_aNextNFAStates);
+		}
+	}
+
+	if (m_unanchored)
+	{
+		// a match can start at any position
+		addToClosure(m_nfa.start, false, m_aNextNFAStates);
+	}
+
+	if (m_stopAtMatch && m_aClosureMarks[m_nfa.match] == m_closureMark)
+	{
+		m_aTransitions[fromRow + byteClass] = kMatch;
+		return kMatch;
+	}
+
+	size_t numStates = m_aStates.size();
+	int32_t nextRow = getStateRow(m_aNextNFAStates);
+
+	// if the cache was reset to make room, the state we came from doesn't exist any more
+	if (m_aStates.size() >= numStates)
+	{
+		m_aTransitions[fromRow + byteClass] = nextRow;
+	}
+
+	return nextRow;
+}
+
+RegexSearcher::RegexSearcher() :
+	m_lineStartIsMatch(false)
+{
+
+}
+
+bool RegexSearcher::init(const std::string& pattern, std::string& errorMessage, bool caseInsensitive)
+{
+	ParseState parseState(pattern, caseInsensitive);
+
+	unsigned int rootNode = 0;
+	if (!parseAlternation(parseState, rootNode))
+	{
+		errorMessage = parseState.errorMessage;
+		return false;
+	}
+
+	if (parseState.pos < pattern.size())
+	{
+		// the only thing which can stop the top level alternation early is an unmatched ')'
+		errorMessage = "unmatched ')'";
+		return false;
+	}
+
+	// work out the literals to search for first
+
+	LiteralInfo literalInfo;
+	getLiteralInfo(parseState.aNodes, rootNode, caseInsensitive, literalInfo);
+	m_aRequiredLiterals = literalInfo.aRequired;
+
+	if (!m_aRequiredLiterals.empty())
+	{
+		// if case insensitive, the literals are lower case
+		m_requiredLiteralsSearcher.init(m_aRequiredLiterals, caseInsensitive);
+	}
+
+	// build the NFAs
+
+	RegexNFA forwardNFA;
+	forwardNFA.match = forwardNFA.addState(RegexNFA::State::eTypeMatch, 0);
+	forwardNFA.start = compileNode(parseState.aNodes, rootNode, false, forwardNFA.match, forwardNFA);
+
+	RegexNFA reverseNFA;
+	reverseNFA.match = reverseNFA.addState(RegexNFA::State::eTypeMatch, 0);
+	reverseNFA.start = compileNode(parseState.aNodes, rootNode, true, reverseNFA.match, reverseNFA);
+
+	if (forwardNFA.tooLarge || reverseNFA.tooLarge)
+	{
+		errorMessage = "pattern is too large";
+		return false;
+	}
+
+	m_searchDFA.init(forwardNFA, true, true);
+	m_reverseDFA.init(reverseNFA, true, false);
+	m_anchoredDFA.init(forwardNFA, false, false);
+
+	m_lineStartIsMatch = m_anchoredDFA.isMatch(m_anchoredDFA.getStartRow(true));
+
+	return true;
+}
+
+const char* RegexSearcher::find(const char* start, const char* end) const
+{
+	if (start >= end)
+		return nullptr;
+
+	if (m_lineStartIsMatch)
+		return start;
+
+	if (m_aRequiredLiterals.empty())
+		return m_searchDFA.findMatchingLine(start, end);
+
+	// only lines which contain one of the required literals can match, so we can skip to those, and just
+	// run the DFA on them
+	const char* pos = start;
+	while (pos < end)
+	{
+		const char* found = m_requiredLiteralsSearcher.find(pos, end);
+		if (found == nullptr)
+			return nullptr;
+
+		const char* lineStart = BlockReader::findLineStart(pos, found);
+		const char* lineEnd = BlockReader::findLineEnd(found, end);
+
+		if (matchesLine(lineStart, lineEnd))
+			return found;
+
+		pos = lineEnd + 1;
+	}
+
+	return nullptr;
+}
+
+unsigned int RegexSearcher::countMatches(const char* start, const char* end) const
+{
+	unsigned int count = 0;
+
+	const char* pos = start;
+	while (pos < end)
+	{
+		const char* lineStart = pos;
+		const char* lineEnd = nullptr;
+
+		if (!m_aRequiredLiterals.empty())
+		{
+			const char* found = m_requiredLiteralsSearcher.find(pos, end);
+			if (found == nullptr)
+				break;
+
+			lineStart = BlockReader::findLineStart(pos, found);
+			lineEnd = BlockReader::findLineEnd(found, end);
+		}
+		else
+		{
+			lineEnd = BlockReader::findLineEnd(pos, end);
+		}
+
+		count += countLineMatches(lineStart, lineEnd);
+
+		pos = lineEnd + 1;
+	}
+
+	return count;
+}
+
+bool RegexSearcher::parseAlternation(ParseState& state, unsigned int& nodeIndex)
+{
+	unsigned int firstNode = 0;
+	if (!parseConcatenation(state, firstNode))
+		return false;
+
+	if (state.pos >= state.pattern.size() || state.pattern[state.pos] != '|')
+	{
+		nodeIndex = firstNode;
+		return true;
+	}
+
+	ParseNode alternation(ParseNode::eTypeAlternation);
+	alternation.aChildren.emplace_back(firstNode);
+
+	while (state.pos < state.pattern.size() && state.pattern[state.pos] == '|')
+	{
+		state.pos++;
+
+		unsigned int nextNode = 0;
+		if (!parseConcatenation(state, nextNode))
+			return false;
+
+		alternation.aChildren.emplace_back(nextNode);
+	}
+
+	nodeIndex = addParseNode(state, alternation);
+	return true;
+}
+
+bool RegexSearcher::parseConcatenation(ParseState& state, unsigned int& nodeIndex)
+{
+	ParseNode concatenation(ParseNode::eTypeConcatenation);
+
+	while (state.pos < state.pattern.size())
+	{
+		char c = state.pattern[state.pos];
+		if (c == '|' || c == ')')
+			break;
+
+		unsigned int childNode = 0;
+		if (!parseRepeat(state, childNode))
+			return false;
+
+		concatenation.aChildren.emplace_back(childNode);
+	}
+
+	if (concatenation.aChildren.empty())
+	{
+		nodeIndex = addParseNode(state, ParseNode(ParseNode::eTypeEmpty));
+	}
+	else if (concatenation.aChildren.size() == 1)
+	{
+		nodeIndex = concatenation.aChildren[0];
+	}
+	else
+	{
+		nodeIndex = addParseNode(state, concatenation);
+	}
+
+	return true;
+}
+
+bool RegexSearcher::parseRepeat(ParseState& state, unsigned int& nodeIndex)
+{
+	if (!parseAtom(state, nodeIndex))
+		return false;
+
+	while (state.pos < state.pattern.size())
+	{
+		unsigned int minRepeat = 0;
+		unsigned int maxRepeat = kRepeatUnlimited;
+
+		char c = state.pattern[state.pos];
+		if (c == '*')
+		{
+			state.pos++;
+		}
+		else if (c == '+')
+		{
+			minRepeat = 1;
+			state.pos++;
+		}
+		else if (c == '?')
+		{
+			maxRepeat = 1;
+			state.pos++;
+		}
+		else if (c == '{')
+		{
+			if (!parseRepeatBounds(state, minRepeat, maxRepeat))
+			{
+				if (!state.errorMessage.empty())
+					return false;
+
+				// otherwise it's just a literal '{', which will be parsed as the next atom
+				break;
+			}
+		}
+		else
+		{
+			break;
+		}
+
+		ParseNode repeat(ParseNode::eTypeRepeat);
+		repeat.aChildren.emplace_back(nodeIndex);
+		repeat.minRepeat = minRepeat;
+		repeat.maxRepeat = maxRepeat;
+		nodeIndex = addParseNode(state, repeat);
+	}
+
+	return true;
+}
+
+bool RegexSearcher::parseAtom(ParseState& state, unsigned int& nodeIndex)
+{
+	char c = state.pattern[state.pos++];
+
+	ParseNode chars(ParseNode::eTypeChars);
+
+	switch (c)
+	{
+		case '(':
+		{
+			// we don't capture anything, so non-capturing groups are the same
+			if (state.pattern.compare(state.pos, 2, "?:") == 0)
+			{
+				state.pos += 2;
+			}
+
+			if (!parseAlternation(state, nodeIndex))
+				return false;
+
+			if (state.pos >= state.pattern.size() || state.pattern[state.pos] != ')')
+			{
+				state.errorMessage = "missing ')'";
+				return false;
+			}
+
+			state.pos++;
+			return true;
+		}
+		case '*':
+		case '+':
+		case '?':
+			state.errorMessage = std::string("nothing to repeat before '") + c + "'";
+			return false;
+		case '^':
+			nodeIndex = addParseNode(state, ParseNode(ParseNode::eTypeLineStart));
+			return true;
+		case '$':
+			nodeIndex = addParseNode(state, ParseNode(ParseNode::eTypeLineEnd));
+			return true;
+		case '.':
+			chars.chars.set();
+			break;
+		case '[':
+			if (!parseBracketExpression(state, chars.chars))
+				return false;
+			break;
+		case '\\':
+		{
+			int singleChar = 0;
+			if (!parseEscape(state, chars.chars, singleChar))
+				return false;
+			break;
+		}
+		default:
+			chars.chars.set((unsigned char)c);
+			break;
+	}
+
+	if (state.caseInsensitive)
+	{
+		addOtherCases(chars.chars);
+	}
+
+	// as we're searching line by line, nothing can match the end of a line
+	chars.chars.reset('\n');
+
+	nodeIndex = addParseNode(state, chars);
+	return true;
+}
+
+bool RegexSearcher::parseBracketExpression(ParseState& state, CharSet& chars)
+{
+	const std::string& pattern = state.pattern;
+
+	bool negate = false;
+	if (state.pos < pattern.size() && pattern[state.pos] == '^')
+	{
+		negate = true;
+		state.pos++;
+	}
+
+	// a ']' straight away is just a char within the set
+	bool first = true;
+
+	while (true)
+	{
+		if (state.pos >= pattern.size())
+		{
+			state.errorMessage = "missing ']'";
+			return false;
+		}
+
+		char c = pattern[state.pos];
+		if (c == ']' && !first)
+		{
+			state.pos++;
+			break;
+		}
+
+		first = false;
+
+		if (c == '[' && pattern.compare(state.pos, 2, "[:") == 0)
+		{
+			size_t classEnd = pattern.find(":]", state.pos + 2);
+			if (classEnd == std::string::npos)
+			{
+				state.errorMessage = "missing ':]'";
+				return false;
+			}
+
+			std::string className = pattern.substr(state.pos + 2, classEnd - state.pos - 2);
+			state.pos = classEnd + 2;
+
+			int (*classFunction)(int) = nullptr;
+			if (className == "alpha")
+				classFunction = isalpha;
+			else if (className == "digit")
+				classFunction = isdigit;
+			else if (className == "alnum")
+				classFunction = isalnum;
+			else if (className == "upper")
+				classFunction = isupper;
+			else if (className == "lower")
+				classFunction = islower;
+			else if (className == "space")
+				classFunction = isspace;
+			else if (className == "blank")
+				classFunction = isblank;
+			else if (className == "punct")
+				classFunction = ispunct;
+			else if (className == "xdigit")
+				classFunction = isxdigit;
+			else if (className == "print")
+				classFunction = isprint;
+			else if (className == "graph")
+				classFunction = isgraph;
+			else if (className == "cntrl")
+				classFunction = iscntrl;
+			else
+			{
+				state.errorMessage = "unknown character class '" + className + "'";
+				return false;
+			}
+
+			for (unsigned int i = 0; i < 128; i++)
+			{
+				if (classFunction(i))
+					chars.set(i);
+			}
+			continue;
+		}
+
+		int rangeStart = (unsigned char)c;
+		state.pos++;
+
+		if (c == '\\')
+		{
+			if (!parseEscape(state, chars, rangeStart))
+				return false;
+
+			// classes can't be the start of a range
+			if (rangeStart == -1)
+				continue;
+		}
+
+		if (state.pos + 1 < pattern.size() && pattern[state.pos] == '-' && pattern[state.pos + 1] != ']')
+		{
+			state.pos++;
+
+			int rangeEnd = (unsigned char)pattern[state.pos++];
+			if (rangeEnd == '\\')
+			{
+				if (!parseEscape(state, chars, rangeEnd))
+					return false;
+
+				if (rangeEnd == -1)
+				{
+					state.errorMessage = "invalid range end in '[...]'";
+					return false;
+				}
+			}
+
+			if (rangeEnd < rangeStart)
+			{
+				state.errorMessage = "invalid range in '[...]'";
+				return false;
+			}
+
+			for (int i = rangeStart; i <= rangeEnd; i++)
+			{
+				chars.set(i);
+			}
+		}
+		else
+		{
+			chars.set(rangeStart);
+		}
+	}
+
+	if (negate)
+	{
+		// so that e.g. [^a] doesn't match 'A' either
+		if (state.caseInsensitive)
+		{
+			addOtherCases(chars);
+		}
+
+		chars.flip();
+	}
+
+	return true;
+}
+
+void RegexSearcher::addOtherCases(CharSet& chars)
+{
+	for (unsigned int c = 'a'; c <= 'z'; c++)
+	{
+		const unsigned int upper = c - 'a' + 'A';
+		if (chars.test(c) || chars.test(upper))
+		{
+			chars.set(c);
+			chars.set(upper);
+		}
+	}
+}
+
+bool RegexSearcher::parseEscape(ParseState& state, CharSet& chars, int& singleChar)
+{
+	if (state.pos >= state.pattern.size())
+	{
+		state.errorMessage = "trailing '\\'";
+		return false;
+	}
+
+	char c = state.pattern[state.pos++];
+
+	singleChar = -1;
+
+	switch (c)
+	{
+		case 'd':
+		case 'D':
+		case 'w':
+		case 'W':
+		case 's':
+		case 'S':
+		{
+			CharSet classChars;
+			for (unsigned int i = 0; i < 128; i++)
+			{
+				bool inClass = false;
+				if (c == 'd' || c == 'D')
+					inClass = isdigit(i);
+				else if (c == 'w' || c == 'W')
+					inClass = isalnum(i) || i == '_';
+				else
+					inClass = isspace(i);
+
+				if (inClass)
+					classChars.set(i);
+			}
+
+			// upper case versions are the negation
+			if (isupper(c))
+			{
+				classChars.flip();
+			}
+
+			chars |= classChars;
+			return true;
+		}
+		case 't':
+			singleChar = '\t';
+			break;
+		case 'r':
+			singleChar = '\r';
+			break;
+		case 'n':
+			singleChar = '\n';
+			break;
+		case 'f':
+			singleChar = '\f';
+			break;
+		case 'v':
+			singleChar = '\v';
+			break;
+		case 'x':
+		{
+			if (state.pos + 2 > state.pattern.size() || !isxdigit(state.pattern[state.pos]) ||
+				!isxdigit(state.pattern[state.pos + 1]))
+			{
+				state.errorMessage = "'\\x' must be followed by two hex digits";
+				return false;
+			}
+
+			singleChar = std::stoi(state.pattern.substr(state.pos, 2), nullptr, 16);
+			state.pos += 2;
+			break;
+		}
+		default:
+		{
+			// anything else which isn't a letter or number is just an escaped literal char
+			if (isalnum((unsigned char)c))
+			{
+				state.errorMessage = std::string("unsupported escape '\\") + c + "'";
+				return false;
+			}
+
+			singleChar = (unsigned char)c;
+			break;
+		}
+	}
+
+	chars.set(singleChar);
+	return true;
+}
+
+bool RegexSearcher::parseRepeatBounds(ParseState& state, unsigned int& minRepeat, unsigned int& maxRepeat)
+{
+	const std::string& pattern = state.pattern;
+
+	// this is called at the '{'
+	size_t pos = state.pos + 1;
+
+	size_t numberStart = pos;
+	while (pos < pattern.size() && isdigit(pattern[pos]))
+	{
+		pos++;
+	}
+
+	if (pos == numberStart || pos - numberStart > 4 || pos >= pattern.size())
+		return false;
+
+	minRepeat = std::stoi(pattern.substr(numberStart, pos - numberStart));
+	maxRepeat = minRepeat;
+
+	if (pattern[pos] == ',')
+	{
+		pos++;
+
+		numberStart = pos;
+		while (pos < pattern.size() && isdigit(pattern[pos]))
+		{
+			pos++;
+		}
+
+		if (pos - numberStart > 4)
+			return false;
+
+		maxRepeat = (pos == numberStart) ? kRepeatUnlimited : std::stoi(pattern.substr(numberStart, pos - numberStart));
+	}
+
+	if (pos >= pattern.size() || pattern[pos] != '}')
+		return false;
+
+	state.pos = pos + 1;
+
+	if (minRepeat > kMaxRepeatCount || (maxRepeat != kRepeatUnlimited && maxRepeat > kMaxRepeatCount))
+	{
+		state.errorMessage = "repeat count is too large (the maximum is " + std::to_string(kMaxRepeatCount) + ")";
+		return false;
+	}
+
+	if (maxRepeat < minRepeat)
+	{
+		state.errorMessage = "invalid repeat range";
+		return false;
+	}
+
+	return true;
+}
+
+// whether the first set of literals is better to search for than the second: the longer the shortest string
+// is, the fewer false positives and the further the SIMD search can skip, and then fewer strings is better
+static bool areLiteralsBetter(const std::vector<std::string>& literals, const std::vector<std::string>& otherLiterals)
+{
+	if (literals.empty())
+		return false;
+
+	if (otherLiterals.empty())
+		return true;
+
+	size_t minLength = literals[0].size();
+	for (const std::string& literal : literals)
+	{
+		minLength = std::min(minLength, literal.size());
+	}
+
+	size_t otherMinLength = otherLiterals[0].size();
+	for (const std::string& literal : otherLiterals)
+	{
+		otherMinLength = std::min(otherMinLength, literal.size());
+	}
+
+	if (minLength != otherMinLength)
+		return minLength > otherMinLength;
+
+	return literals.size() < otherLiterals.size();
+}
+
+void RegexSearcher::getLiteralInfo(const std::vector<ParseNode>& aNodes, unsigned int nodeIndex, bool caseInsensitive,
+									LiteralInfo& info)
+{
+	const ParseNode& node = aNodes[nodeIndex];
+
+	info.isExact = false;
+	info.exactString.clear();
+	info.aRequired.clear();
+
+	switch (node.type)
+	{
+		case ParseNode::eTypeChars:
+		{
+			// if case insensitive, letters are both cases, which the literal search can handle, so they
+			// count as exact (as the lower case letter)
+			const size_t numChars = node.chars.count();
+			if (numChars == 1 || (caseInsensitive && numChars == 2))
+			{
+				for (unsigned int i = 0; i < 256; i++)
+				{
+					if (node.chars.test(i))
+					{
+						if (numChars == 2 && !(isupper(i) && node.chars.test(tolower(i))))
+							break;
+
+						info.isExact = true;
+						info.exactString.assign(1, (char)(numChars == 2 ? tolower(i) : i));
+						info.aRequired.emplace_back(info.exactString);
+						break;
+					}
+				}
+			}
+			break;
+		}
+		case ParseNode::eTypeEmpty:
+		case ParseNode::eTypeLineStart:
+		case ParseNode::eTypeLineEnd:
+			// these don't match any chars
+			info.isExact = true;
+			break;
+		case ParseNode::eTypeConcatenation:
+		{
+			// runs of children which are exact strings get joined together, and then the best of these or
+			// the required literals of any other children is picked
+			bool allExact = true;
+			std::string currentRun;
+
+			for (unsigned int childIndex : node.aChildren)
+			{
+				LiteralInfo childInfo;
+				getLiteralInfo(aNodes, childIndex, caseInsensitive, childInfo);
+
+				if (childInfo.isExact)
+				{
+					currentRun += childInfo.exactString;
+					continue;
+				}
+
+				allExact = false;
+
+				if (!currentRun.empty())
+				{
+					std::vector<std::string> runLiterals(1, currentRun);
+					if (areLiteralsBetter(runLiterals, info.aRequired))
+					{
+						info.aRequired.swap(runLiterals);
+					}
+					currentRun.clear();
+				}
+
+				if (areLiteralsBetter(childInfo.aRequired, info.aRequired))
+				{
+					info.aRequired.swap(childInfo.aRequired);
+				}
+			}
+
+			if (allExact)
+			{
+				info.isExact = true;
+				info.exactString = currentRun;
+				info.aRequired.clear();
+			}
+
+			if (!currentRun.empty())
+			{
+				std::vector<std::string> runLiterals(1, currentRun);
+				if (areLiteralsBetter(runLiterals, info.aRequired))
+				{
+					info.aRequired.swap(runLiterals);
+				}
+			}
+			break;
+		}
+		case ParseNode::eTypeAlternation:
+		{
+			// a match has to contain one of the literals from one of the alternatives, so if they all have them,
+			// we can search for all of them
+			for (unsigned int childIndex : node.aChildren)
+			{
+				LiteralInfo childInfo;
+				getLiteralInfo(aNodes, childIndex, caseInsensitive, childInfo);
+
+				if (childInfo.aRequired.empty())
+				{
+					info.aRequired.clear();
+					return;
+				}
+
+				for (const std::string& literal : childInfo.aRequired)
+				{
+					if (std::find(info.aRequired.begin(), info.aRequired.end(), literal) == info.aRequired.end())
+					{
+						info.aRequired.emplace_back(literal);
+					}
+				}
+			}
+
+			if (info.aRequired.size() > kMaxRequiredLiterals)
+			{
+				info.aRequired.clear();
+			}
+			break;
+		}
+		case ParseNode::eTypeRepeat:
+		{
+			// if it has to be there at least once, what it requires is required
+			if (node.minRepeat > 0)
+			{
+				getLiteralInfo(aNodes, node.aChildren[0], caseInsensitive, info);
+
+				if (node.minRepeat == 1 && node.maxRepeat == 1)
+					break;
+
+				if (info.isExact && !info.exactString.empty() && info.exactString.size() * node.minRepeat <= kMaxRepeatedLiteralLength)
+				{
+					// the required copies of exact strings can be joined together
+					std::string repeated;
+					for (unsigned int i = 0; i < node.minRepeat; i++)
+					{
+						repeated += info.exactString;
+					}
+
+					info.aRequired.assign(1, repeated);
+					info.isExact = node.minRepeat == node.maxRepeat;
+					info.exactString = info.isExact ? repeated : std::string();
+				}
+				else
+				{
+					info.isExact = false;
+					info.exactString.clear();
+				}
+			}
+			break;
+		}
+	}
+}
+
+
+uint32_t RegexSearcher::compileNode(const std::vector<ParseNode>& aNodes, unsigned int nodeIndex, bool reverse,
+									uint32_t nextState, RegexNFA& nfa)
+{
+	if (nfa.tooLarge)
+		return nextState;
+
+	const ParseNode& node = aNodes[nodeIndex];
+
+	switch (node.type)
+	{
+		case ParseNode::eTypeChars:
+		{
+			nfa.aCharSets.emplace_back(node.chars);
+			return nfa.addState(RegexNFA::State::eTypeChars, nextState, 0, nfa.aCharSets.size() - 1);
+		}
+		case ParseNode::eTypeEmpty:
+			return nextState;
+		case ParseNode::eTypeLineStart:
+			return nfa.addState(reverse ? RegexNFA::State::eTypeLineEnd : RegexNFA::State::eTypeLineStart, nextState);
+		case ParseNode::eTypeLineEnd:
+			return nfa.addState(reverse ? RegexNFA::State::eTypeLineStart : RegexNFA::State::eTypeLineEnd, nextState);
+		case ParseNode::eTypeConcatenation:
+		{
+			// as we're building backwards, the last child goes first (or the first when reversed)
+			uint32_t state = nextState;
+			const size_t numChildren = node.aChildren.size();
+			for (size_t i = 0; i < numChildren; i++)
+			{
+				unsigned int childIndex = reverse ? node.aChildren[i] : node.aChildren[numChildren - 1 - i];
+				state = compileNode(aNodes, childIndex, reverse, state, nfa);
+			}
+			return state;
+		}
+		case ParseNode::eTypeAlternation:
+		{
+			uint32_t state = compileNode(aNodes, node.aChildren.back(), reverse, nextState, nfa);
+			for (size_t i = node.aChildren.size() - 1; i > 0; i--)
+			{
+				uint32_t childState = compileNode(aNodes, node.aChildren[i - 1], reverse, nextState, nfa);
+				state = nfa.addState(RegexNFA::State::eTypeSplit, childState, state);
+			}
+			return state;
+		}
+		case ParseNode::eTypeRepeat:
+		{
+			unsigned int childNode = node.aChildren[0];
+			uint32_t state = nextState;
+			unsigned int requiredCopies = node.minRepeat;
+
+			if (node.maxRepeat == kRepeatUnlimited)
+			{
+				// a loop of the child, which can be left before each time round
+				uint32_t loopState = nfa.addState(RegexNFA::State::eTypeSplit, 0, nextState);
+				if (nfa.tooLarge)
+					return nextState;
+
+				uint32_t childState = compileNode(aNodes, childNode, reverse, loopState, nfa);
+				nfa.aStates[loopState].out = childState;
+
+				// for one or more, the first copy can go straight into the loop
+				if (requiredCopies > 0)
+				{
+					state = childState;
+					requiredCopies--;
+				}
+				else
+				{
+					state = loopState;
+				}
+			}
+			else
+			{
+				// nested optional copies, each of which can skip straight to the end
+				for (unsigned int i = node.minRepeat; i < node.maxRepeat; i++)
+				{
+					uint32_t childState = compileNode(aNodes, childNode, reverse, state, nfa);
+					state = nfa.addState(RegexNFA::State::eTypeSplit, childState, nextState);
+				}
+			}
+
+			for (unsigned int i = 0; i < requiredCopies; i++)
+			{
+				state = compileNode(aNodes, childNode, reverse, state, nfa);
+			}
+
+			return state;
+		}
+	}
+
+	return nextState;
+}
+
+bool RegexSearcher::matchesLine(const char* lineStart, const char* lineEnd) const
+{
+	// the DFA only reports matches on transitions or at the end of the line, so an empty match at the start of the
+	// line would otherwise be missed
+	if (m_lineStartIsMatch)
+		return true;
+
+	int32_t row = m_searchDFA.getStartRow(true);
+
+	for (const char* pos = lineStart; pos < lineEnd; pos++)
+	{
+		int32_t nextRow = m_searchDFA.getNextRow(row, (unsigned char)*pos);
+		if (nextRow == RegexDFA::kMatch)
+			return true;
+
+		row = nextRow;
+	}
+
+	return m_searchDFA.isMatchAtLineEnd(row);
+}
+
+unsigned int RegexSearcher::countLineMatches(const char* lineStart, const char* lineEnd) const
+{
+	// going backwards along the line with the reversed pattern first marks where matches can start,
+	// then from each of those (after the end of the previous match), the longest match is found
+	const size_t lineLength = lineEnd - lineStart;
+	m_aMatchStarts.assign(lineLength, false);
+
+	int32_t row = m_reverseDFA.getStartRow(true);
+	for (size_t i = lineLength; i > 0; i--)
+	{
+		row = m_reverseDFA.getNextRow(row, (unsigned char)lineStart[i - 1]);
+		m_aMatchStarts[i - 1] = (i == 1) ? m_reverseDFA.isMatchAtLineEnd(row) : m_reverseDFA.isMatch(row);
+	}
+
+	unsigned int count = 0;
+
+	size_t matchStart = 0;
+	while (matchStart < lineLength)
+	{
+		if (!m_aMatchStarts[matchStart])
+		{
+			matchStart++;
+			continue;
+		}
+
+		size_t matchEnd = 0;
+		row = m_anchoredDFA.getStartRow(matchStart == 0);
+		for (size_t i = matchStart; i < lineLength; i++)
+		{
+			row = m_anchoredDFA.getNextRow(row, (unsigned char)lineStart[i]);
+			if (m_anchoredDFA.isMatch(row))
+			{
+				matchEnd = i + 1;
+			}
+			else if (m_anchoredDFA.isDead(row))
+			{
+				break;
+			}
+
+			if (i + 1 == lineLength && m_anchoredDFA.isMatchAtLineEnd(row))
+			{
+				matchEnd = lineLength;
+			}
+		}
+
+		if (matchEnd <= matchStart)
+		{
+			// shouldn't happen, but don't get stuck if it does
+			matchStart++;
+			continue;
+		}
+
+		count++;
+		matchStart = matchEnd;
+	}
+
+	// lines which only match something empty still match
+	if (count == 0 && matchesLine(lineStart, lineEnd))
+	{
+		count = 1;
+	}
+
+	return count;
+}
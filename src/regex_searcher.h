@@ -0,0 +1,319 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef REGEX_SEARCHER_H
+#define REGEX_SEARCHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <bitset>
+
+#include <stdint.h>
+
+#include "multi_searcher.h"
+
+// Thompson NFA for a regular expression, built from the parsed pattern by RegexSearcher.
+// As matching is done line by line, '^' and '$' are states which only pass at the start / end of the line.
+
+struct RegexNFA
+{
+	typedef std::bitset<256> CharSet;
+
+	struct State
+	{
+		enum Type
+		{
+			eTypeChars,		// consumes a char in the char set
+			eTypeSplit,		// goes to both out and out1
+			eTypeLineStart,
+			eTypeLineEnd,
+			eTypeMatch
+		};
+
+		State(Type stateType, uint32_t outState, uint32_t outState1, uint32_t stateCharSet) :
+			type(stateType), out(outState), out1(outState1), charSet(stateCharSet)
+		{
+		}
+
+		Type		type;
+		uint32_t	out;
+		uint32_t	out1;
+		uint32_t	charSet;
+	};
+
+	RegexNFA() : start(0), match(0), tooLarge(false)
+	{
+	}
+
+	// if there are too many states, tooLarge is set and nothing's added
+	uint32_t addState(State::Type type, uint32_t out, uint32_t out1 = 0, uint32_t charSet = 0);
+
+	std::vector<State>		aStates;
+	std::vector<CharSet>	aCharSets;
+	uint32_t				start;
+	uint32_t				match;
+	bool					tooLarge;
+};
+
+// Lazily built DFA for a RegexNFA, run on a line at a time. Each DFA state is the set of NFA states which could be
+// active at that point, and states (and the transitions between them) are only worked out the first time they're
+// needed, and then cached, so only the states the content actually hits are ever built. If the cache gets too big,
+// it's thrown away and started again, so memory use is bounded whatever the pattern.
+// As the cache is modified while searching, each thread needs its own copy.
+
+class RegexDFA
+{
+public:
+	RegexDFA();
+
+	// unanchored means a match can start at any position, rather than just where the run starts.
+	// With stopAtMatch, transitions into a match state return kMatch rather than a state, which lets the search
+	// loops check for matches for free, but means the run can't continue past the match.
+	void init(const RegexNFA& nfa, bool unanchored, bool stopAtMatch);
+
+	static const int32_t kUnknown = -1;
+	static const int32_t kMatch = -2;
+
+	// DFA states are referred to by the offset of their row in the transition table
+	int32_t getStartRow(bool atLineStart) const
+	{
+		return atLineStart ? m_lineStartRow : m_midLineStartRow;
+	}
+
+	int32_t getNextRow(int32_t row, unsigned char c) const
+	{
+		const unsigned int byteClass = m_byteClasses[c];
+		int32_t nextRow = m_aTransitions[row + byteClass];
+		if (nextRow == kUnknown)
+		{
+			nextRow = computeTransition(row, byteClass);
+		}
+		return nextRow;
+	}
+
+	bool isMatch(int32_t row) const
+	{
+		return m_aStates[row / m_numByteClasses].isMatch;
+	}
+
+	bool isMatchAtLineEnd(int32_t row) const
+	{
+		return m_aStates[row / m_numByteClasses].isMatchAtLineEnd;
+	}
+
+	// nothing more can match from here
+	bool isDead(int32_t row) const
+	{
+		return m_aStates[row / m_numByteClasses].aNFAStates.empty();
+	}
+
+	// with stopAtMatch, runs over a range of lines (with '\n' handled by the DFA), returning the position where the
+	// first match was found (the '\n' at the end of the line for matches needing the line end), or nullptr
+	const char* findMatchingLine(const char* start, const char* end) const;
+
+private:
+	struct State
+	{
+		std::vector<uint32_t>	aNFAStates;
+		bool					isMatch;
+		bool					isMatchAtLineEnd;
+	};
+
+	void startClosure() const;
+	// adds the NFA state and everything reachable from it without consuming a char to the closure (just the states
+	// which consume chars, or are a match or line end)
+	void addToClosure(uint32_t nfaState, bool atLineStart, std::vector<uint32_t>& aClosure) const;
+	// whether any of the NFA states lead to a match at the end of the line
+	bool isMatchAtLineEnd(const std::vector<uint32_t>& aNFAStates) const;
+
+	void resetCache() const;
+
+	// returns the row of the DFA state for the set of NFA states, adding it if it doesn't exist yet
+	int32_t getStateRow(std::vector<uint32_t>& aNFAStates) const;
+
+	int32_t computeTransition(int32_t fromRow, unsigned int byteClass) const;
+
+private:
+	RegexNFA						m_nfa;
+	bool							m_unanchored;
+	bool							m_stopAtMatch;
+
+	// bytes which all the NFA char sets treat the same share the same class, so the transition table only needs
+	// a column per class. '\n' always has its own class.
+	unsigned int					m_numByteClasses;
+	uint8_t							m_byteClasses[256];
+	unsigned char					m_byteClassChars[256]; // a char from each class
+	unsigned int					m_newLineByteClass;
+
+	mutable std::vector<State>		m_aStates;
+	mutable std::map<std::vector<uint32_t>, int32_t>	m_stateRows;
+	// the next state row for each state and byte class (or kUnknown or kMatch). The stored values are
+	// pre-multiplied by the number of byte classes, so can be used directly as the row for the next lookup.
+	mutable std::vector<int32_t>	m_aTransitions;
+	mutable int32_t					m_lineStartRow;
+	mutable int32_t					m_midLineStartRow;
+
+	// temporary storage for working out closures
+	mutable std::vector<uint32_t>	m_aClosureMarks;
+	mutable uint32_t				m_closureMark;
+	mutable std::vector<uint32_t>	m_aClosureStack;
+	mutable std::vector<uint32_t>	m_aNextNFAStates;
+};
+
+// Regular expression searcher for finding lines containing a match, which never backtracks, so always runs in time
+// linear to the length of the content.
+// Literal strings which every match must contain one of are pulled out of the pattern, and searched for first (with
+// the same SIMD search as literal searching), so that the DFA only needs to be run on the lines containing them.
+//
+// The supported syntax is POSIX ERE-like: literal chars, '.', bracket expressions (with ranges, negation and
+// [:class:] names), \d \w \s (and their negations), escaped chars, groups (including "(?:"), '|', the '*', '+', '?'
+// and {n}, {n,}, {n,m} repetitions, and '^' / '$' for the start and end of the line. Back references aren't
+// supported, as they can't be done without backtracking.
+//
+// As the DFAs are built while searching, each thread needs its own RegexSearcher.
+
+class RegexSearcher
+{
+public:
+	RegexSearcher();
+
+	// returns false if the pattern is invalid (or uses something which isn't supported), with errorMessage set.
+	// If caseInsensitive is set, ASCII letters match either case.
+	bool init(const std::string& pattern, std::string& errorMessage, bool caseInsensitive = false);
+
+	// start must be at the start of a line. Returns a position within the first line in the range which contains
+	// a match, or nullptr if there aren't any.
+	const char* find(const char* start, const char* end) const;
+
+	// returns the number of non-overlapping (leftmost longest) matches within the range, which must start at the
+	// start of a line. Lines which only match something empty (e.g. "^") count once.
+	unsigned int countMatches(const char* start, const char* end) const;
+
+	// the literal strings which are searched for first (every match contains at least one of them), if any.
+	// These are lower case for case insensitive patterns.
+	const std::vector<std::string>& getRequiredLiterals() const
+	{
+		return m_aRequiredLiterals;
+	}
+
+private:
+	typedef RegexNFA::CharSet CharSet;
+
+	// parsing
+
+	struct ParseNode
+	{
+		enum Type
+		{
+			eTypeChars,
+			eTypeEmpty,
+			eTypeConcatenation,
+			eTypeAlternation,
+			eTypeRepeat,
+			eTypeLineStart,
+			eTypeLineEnd
+		};
+
+		ParseNode(Type nodeType) : type(nodeType), minRepeat(0), maxRepeat(0)
+		{
+		}
+
+		Type						type;
+		CharSet						chars;
+		std::vector<unsigned int>	aChildren;
+		unsigned int				minRepeat;
+		unsigned int				maxRepeat; // kRepeatUnlimited if there's no limit
+	};
+
+	struct ParseState
+	{
+		ParseState(const std::string& patternString, bool caseInsensitiveParse) :
+			pattern(patternString), caseInsensitive(caseInsensitiveParse), pos(0)
+		{
+		}
+
+		const std::string&			pattern;
+		bool						caseInsensitive; // letters in the char sets are added in both cases
+		size_t						pos;
+		std::vector<ParseNode>		aNodes;
+		std::string					errorMessage;
+	};
+
+	static unsigned int addParseNode(ParseState& state, const ParseNode& node)
+	{
+		state.aNodes.emplace_back(node);
+		return state.aNodes.size() - 1;
+	}
+
+	static bool parseAlternation(ParseState& state, unsigned int& nodeIndex);
+	static bool parseConcatenation(ParseState& state, unsigned int& nodeIndex);
+	static bool parseRepeat(ParseState& state, unsigned int& nodeIndex);
+	static bool parseAtom(ParseState& state, unsigned int& nodeIndex);
+	// these are called after the opening char
+	static bool parseBracketExpression(ParseState& state, CharSet& chars);
+	// singleChar is set to -1 for escapes which are classes of chars (\d, \w, \s)
+	static bool parseEscape(ParseState& state, CharSet& chars, int& singleChar);
+	// for case insensitive patterns - adds the other case of any letters in the set
+	static void addOtherCases(CharSet& chars);
+	// returns false without an error message if it's not a valid repeat, in which case the '{' is just a literal char
+	static bool parseRepeatBounds(ParseState& state, unsigned int& minRepeat, unsigned int& maxRepeat);
+
+	// required literals
+
+	struct LiteralInfo
+	{
+		LiteralInfo() : isExact(false)
+		{
+		}
+
+		bool						isExact; // whether the node always matches exactly exactString
+		std::string					exactString;
+		std::vector<std::string>	aRequired; // every match contains one of these (empty if there's nothing we know of)
+	};
+
+	// if case insensitive, the literals are lower case (and need searching for case insensitively)
+	static void getLiteralInfo(const std::vector<ParseNode>& aNodes, unsigned int nodeIndex, bool caseInsensitive,
+							   LiteralInfo& info);
+
+	// builds the NFA states for the node backwards, with everything leading on to nextState, and returns its start.
+	// If reverse is set, the NFA is for the pattern reversed (so matching the content backwards).
+	static uint32_t compileNode(const std::vector<ParseNode>& aNodes, unsigned int nodeIndex, bool reverse,
+								uint32_t nextState, RegexNFA& nfa);
+
+	// lineEnd is the end of the line, not including the '\n'
+	bool matchesLine(const char* lineStart, const char* lineEnd) const;
+	unsigned int countLineMatches(const char* lineStart, const char* lineEnd) const;
+
+private:
+	// whether the pattern can match nothing at the start of a line, in which case every line matches
+	bool						m_lineStartIsMatch;
+
+	std::vector<std::string>	m_aRequiredLiterals;
+	MultiSearcher				m_requiredLiteralsSearcher;
+
+	// for finding matching lines
+	RegexDFA					m_searchDFA;
+
+	// for counting matches - the reverse DFA finds where matches start, and the anchored one the longest match from there
+	RegexDFA					m_reverseDFA;
+	RegexDFA					m_anchoredDFA;
+	mutable std::vector<bool>	m_aMatchStarts;
+};
+
+#endif // REGEX_SEARCHER_H
@@ -0,0 +1,165 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "searcher.h"
+
+#include <cctype>
+
+#include "utils/string_helpers.h"
+
+// When we don't have SIMD kernels available, search strings at least this long use Horspool, as the
+// average skip distance is then long enough for it to beat checking every position.
+// With SSE2 / AVX2, the SIMD kernels are faster than Horspool for all lengths measured on log content
+// (up to 50+ chars), as they're bound by memory bandwidth, so they're always used in that case.
+static const size_t kHorspoolMinLength = 32;
+
+// searchChars has to be lower case
+static bool equalsIgnoreCase(const unsigned char* pos, const unsigned char* searchChars, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		if (tolower(pos[i]) != searchChars[i])
+			return false;
+	}
+
+	return true;
+}
+
+Searcher::Searcher() :
+	m_algorithm(eAlgorithmSIMD),
+	m_caseInsensitive(false)
+{
+
+}
+
+Searcher::Searcher(const std::string& searchString, Algorithm algorithm, bool caseInsensitive)
+{
+	init(searchString, algorithm, caseInsensitive);
+}
+
+void Searcher::init(const std::string& searchString, Algorithm algorithm, bool caseInsensitive)
+{
+	m_searchString = searchString;
+	m_caseInsensitive = false;
+
+	if (caseInsensitive)
+	{
+		// the search kernels need the search string in lower case. If there aren't any letters, it's
+		// the same as a case sensitive search, which is quicker.
+		StringHelpers::toLower(m_searchString);
+		m_caseInsensitive = StringHelpers::containsLetters(m_searchString);
+	}
+
+	if (algorithm == eAlgorithmAuto)
+	{
+		if (searchString.size() == 1)
+		{
+			algorithm = eAlgorithmSingleChar;
+		}
+		else if (searchString.size() >= kHorspoolMinLength && SearchKernels::getKernelType() == SearchKernels::eKernelScalar)
+		{
+			algorithm = eAlgorithmHorspool;
+		}
+		else
+		{
+			algorithm = eAlgorithmSIMD;
+		}
+	}
+	else if (algorithm == eAlgorithmSingleChar && searchString.size() != 1)
+	{
+		algorithm = eAlgorithmSIMD;
+	}
+	else if ((algorithm == eAlgorithmHorspool && searchString.empty()) || algorithm == eAlgorithmRegex)
+	{
+		// regexes need initRegex()
+		algorithm = eAlgorithmSIMD;
+	}
+
+	m_algorithm = algorithm;
+
+	if (m_algorithm == eAlgorithmSingleChar)
+	{
+		m_singleCharCases[0] = m_searchString[0];
+		m_singleCharCases[1] = (char)toupper(m_searchString[0]);
+	}
+	else if (m_algorithm == eAlgorithmHorspool)
+	{
+		const size_t length = m_searchString.size();
+
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			m_skipTable[i] = length;
+		}
+
+		// the last char isn't included, as otherwise it would have a skip of 0
+		for (size_t i = 0; i < length - 1; i++)
+		{
+			const char c = m_searchString[i];
+			m_skipTable[(unsigned char)c] = length - 1 - i;
+			if (m_caseInsensitive)
+			{
+				m_skipTable[(unsigned char)toupper(c)] = length - 1 - i;
+			}
+		}
+	}
+}
+
+bool Searcher::initRegex(const std::string& pattern, std::string& errorMessage, bool caseInsensitive)
+{
+	if (!m_regexSearcher.init(pattern, errorMessage, caseInsensitive))
+		return false;
+
+	m_searchString = pattern;
+	m_algorithm = eAlgorithmRegex;
+	m_caseInsensitive = caseInsensitive;
+
+	return true;
+}
+
+const char* Searcher::findHorspool(const char* start, const char* end) const
+{
+	const size_t length = m_searchString.size();
+	if ((size_t)(end - start) < length)
+		return nullptr;
+
+	const unsigned char* searchChars = (const unsigned char*)m_searchString.c_str();
+	const unsigned char lastChar = searchChars[length - 1];
+
+	const unsigned char* pos = (const unsigned char*)start;
+	const unsigned char* lastPos = (const unsigned char*)end - length;
+
+	while (pos <= lastPos)
+	{
+		const unsigned char windowLastChar = pos[length - 1];
+		if (m_caseInsensitive)
+		{
+			if (tolower(windowLastChar) == lastChar && equalsIgnoreCase(pos, searchChars, length - 1))
+			{
+				return (const char*)pos;
+			}
+		}
+		else if (windowLastChar == lastChar && memcmp(pos, searchChars, length - 1) == 0)
+		{
+			return (const char*)pos;
+		}
+
+		pos += m_skipTable[windowLastChar];
+	}
+
+	return nullptr;
+}
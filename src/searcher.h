@@ -0,0 +1,127 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef SEARCHER_H
+#define SEARCHER_H
+
+#include <string>
+#include <cstring>
+
+#include "regex_searcher.h"
+
+#include "utils/search_kernels.h"
+
+// Pre-compiled literal string searcher, which is built once for a search string and then re-used
+// for all files and blocks, picking the search algorithm to use based off the search string length
+// (and what the CPU supports).
+// It can also search case insensitively (for ASCII letters), which is done within the search kernels themselves, so
+// there's no extra pass over the content.
+// It can also search for a regular expression instead, in which case find() returns a position within the
+// first line containing a match (and the range searched must start at the start of a line).
+
+class Searcher
+{
+public:
+	enum Algorithm
+	{
+		eAlgorithmAuto,
+		eAlgorithmSingleChar,	// memchr()
+		eAlgorithmSIMD,			// SearchKernels vectorised first/last char matching
+		eAlgorithmHorspool,		// Boyer-Moore-Horspool with a bad char skip table
+		eAlgorithmRegex			// RegexSearcher
+	};
+
+	Searcher();
+	Searcher(const std::string& searchString, Algorithm algorithm = eAlgorithmAuto, bool caseInsensitive = false);
+
+	void init(const std::string& searchString, Algorithm algorithm = eAlgorithmAuto, bool caseInsensitive = false);
+
+	// returns false if the pattern isn't a valid regex, with errorMessage set
+	bool initRegex(const std::string& pattern, std::string& errorMessage, bool caseInsensitive = false);
+
+	// returns the position of the first occurrence of the search string within the range, or nullptr
+	const char* find(const char* start, const char* end) const
+	{
+		switch (m_algorithm)
+		{
+			case eAlgorithmSingleChar:
+				if (m_caseInsensitive)
+					return SearchKernels::findFirstOf(start, end - start, m_singleCharCases, 2);
+				return (const char*)memchr(start, m_searchString[0], end - start);
+			case eAlgorithmHorspool:
+				return findHorspool(start, end);
+			case eAlgorithmRegex:
+				return m_regexSearcher.find(start, end);
+			case eAlgorithmSIMD:
+			default:
+				if (m_caseInsensitive)
+					return SearchKernels::findStringCaseInsensitive(start, end - start, m_searchString.c_str(), m_searchString.size());
+				return SearchKernels::findString(start, end - start, m_searchString.c_str(), m_searchString.size());
+		}
+	}
+
+	// lower case if the search is case insensitive
+	const std::string& getSearchString() const
+	{
+		return m_searchString;
+	}
+
+	size_t getLength() const
+	{
+		return m_searchString.size();
+	}
+
+	Algorithm getAlgorithm() const
+	{
+		return m_algorithm;
+	}
+
+	// only set if the search string actually contains letters
+	bool isCaseInsensitive() const
+	{
+		return m_caseInsensitive;
+	}
+
+	bool isRegex() const
+	{
+		return m_algorithm == eAlgorithmRegex;
+	}
+
+	const RegexSearcher& getRegexSearcher() const
+	{
+		return m_regexSearcher;
+	}
+
+private:
+	const char* findHorspool(const char* start, const char* end) const;
+
+private:
+	std::string		m_searchString;
+	Algorithm		m_algorithm;
+	bool			m_caseInsensitive;
+
+	// for single char case insensitive searches - both cases of the char
+	char			m_singleCharCases[2];
+
+	// for Horspool - the amount to skip forwards based off the last char of the current window
+	unsigned int	m_skipTable[256];
+
+	RegexSearcher	m_regexSearcher;
+};
+
+#endif // SEARCHER_H
@@ -22,21 +22,30 @@
 #include <cstring>
 #include <cstdlib>
 #include <clocale>
+#include <thread>
+#include <functional> // for cref()
 
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "utils/file_helpers.h"
+#include "utils/search_kernels.h"
 #include "utils/string_helpers.h"
 #include "utils/system_helpers.h"
 
-#include "file_grepper.h"
+#include "file_content_processor.h"
+#include "file_follower.h"
 
 #include "filename_matchers.h"
 #include "file_finders.h"
+#include "found_files.h"
+
+// how many found files can be waiting to be processed before finding more files waits
+static const size_t kMaxQueuedFoundFiles = 16 * 1024;
 
 Sniffle::Sniffle() :
+	m_timeWindow(false),
 	m_pFilenameMatcher(nullptr),
 	m_pFileFinder(nullptr)
 {
@@ -67,6 +76,9 @@ bool Sniffle::configureGlobals()
 //	char const* previousLocale = setlocale(LC_ALL, "C");
 //	fprintf(stderr, "Prev locale: %s\n", previousLocale);
 
+	// work out which content search implementations the CPU supports up-front
+	SearchKernels::init();
+
 	return true;
 }
 
@@ -228,10 +240,11 @@ bool Sniffle::parseFilter(int argc, char** argv, int startOptionArg, int& nextAr
 void Sniffle::runFind(const std::string& pattern)
 {
 	std::vector<std::string> foundFiles;
+	FoundFileList foundFileList(foundFiles);
 
 	fprintf(stderr, "Searching for files...\n");
 
-	if (!findFiles(pattern, foundFiles, 0))
+	if (!findFiles(pattern, foundFileList, 0))
 	{
 		fprintf(stderr, "No files found matching file match criteria.\n");
 		return;
@@ -256,62 +269,21 @@ void Sniffle::runFind(const std::string& pattern)
 
 void Sniffle::runGrep(const std::string& filePattern, const std::string& contentsPattern)
 {
-	// this can be done as a file find, plus additional contents search on the results.
-	// TODO: contents search in multiple threads...
-
-	std::vector<std::string> foundFiles;
+	// this is done as a file find, with the contents of the files being processed as they're found.
 
-	fprintf(stderr, "Searching for files...\n");
-
-	if (!findFiles(filePattern, foundFiles, 0))
+	FileContentProcessor contentProcessor(m_config);
+	std::string errorMessage;
+	if (!contentProcessor.configureGrep(contentsPattern, errorMessage))
 	{
-		fprintf(stderr, "No files found matching file match criteria.\n");
+		fprintf(stderr, "Invalid regex: %s\n", errorMessage.c_str());
 		return;
 	}
 
-	fprintf(stderr, "Found %s %s matching file match criteria.\n", StringHelpers::formatNumberThousandsSeparator(foundFiles.size()).c_str(),
-			foundFiles.size() == 1 ? "file" : "files");
-
-	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
-
-	FileGrepper grepper(m_config);
-
-	bool foundPrevious = false;
-
-	size_t totalFiles = foundFiles.size();
-	size_t fileCount = 0;
-	size_t lastPercentage = 101;
 	size_t foundCount = 0;
+	if (!findAndProcessFiles(filePattern, contentProcessor, foundCount))
+		return;
 
-	if (printProgress)
-	{
-		fprintf(stderr, "Grepping files for content...");
-	}
-
-	for (const std::string& fileItem : foundFiles)
-	{
-		if (printProgress)
-		{
-			fileCount++;
-			size_t thisPercentage = (fileCount * 100) / totalFiles;
-			if (thisPercentage != lastPercentage)
-			{
-				fprintf(stderr, "\rGrepping files for content - %zu%% complete...", thisPercentage);
-				lastPercentage = thisPercentage;
-			}
-		}
-
-		// the grepper itself does any printing...
-		bool foundInFile = grepper.grepBasic(fileItem, contentsPattern, foundPrevious);
-
-		if (foundInFile)
-		{
-			foundCount++;
-		}
-
-		// TODO: this bit could be kept within FileGrepper...
-		foundPrevious |= foundInFile;
-	}
+	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
 
 	if (printProgress)
 	{
@@ -336,63 +308,63 @@ void Sniffle::runGrep(const std::string& filePattern, const std::string& content
 
 void Sniffle::runCount(const std::string& filePattern, const std::string& contentsPattern)
 {
-	// this can be done as a file find, plus additional contents search on the results.
-	// TODO: contents search in multiple threads...
-
-	std::vector<std::string> foundFiles;
-
-	fprintf(stderr, "Searching for files...\n");
+	// this is done as a file find, with the contents of the files being processed as they're found.
 
-	if (!findFiles(filePattern, foundFiles, 0))
+	FileContentProcessor contentProcessor(m_config);
+	std::string errorMessage;
+	if (!contentProcessor.configureCount(contentsPattern, errorMessage))
 	{
-		fprintf(stderr, "No files found matching file match criteria.\n");
+		fprintf(stderr, "Invalid regex: %s\n", errorMessage.c_str());
 		return;
 	}
 
-	fprintf(stderr, "Found %s %s matching file match criteria.\n", StringHelpers::formatNumberThousandsSeparator(foundFiles.size()).c_str(),
-			foundFiles.size() == 1 ? "file" : "files");
+	size_t foundCount = 0;
+	if (!findAndProcessFiles(filePattern, contentProcessor, foundCount))
+		return;
 
 	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
 
-	FileGrepper grepper(m_config);
-
-	bool foundPrevious = false;
-
-	size_t totalFiles = foundFiles.size();
-	size_t fileCount = 0;
-	size_t lastPercentage = 101;
-	size_t foundCount = 0;
-
 	if (printProgress)
 	{
-		fprintf(stderr, "Searching files for content counts...");
+		// annoyingly, we need to clear the remainder of previous progress line here, hence the space padding...
+		fprintf(stderr, "\rFound content in %s %s. Output piped to stdout.%-5s\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+							foundCount == 1 ? "file" : "files", " ");
 	}
-
-	for (const std::string& fileItem : foundFiles)
+	else
 	{
-		if (printProgress)
+		if (SystemHelpers::isStdOutATTY())
 		{
-			fileCount++;
-			size_t thisPercentage = (fileCount * 100) / totalFiles;
-			if (thisPercentage != lastPercentage)
-			{
-				fprintf(stderr, "\rSearching files for content counts - %zu%% complete...", thisPercentage);
-				lastPercentage = thisPercentage;
-			}
+			fprintf(stderr, "Found content in %s %s.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+					foundCount == 1 ? "file" : "files");
 		}
-
-		// the grepper itself does any printing...
-		bool foundInFile = grepper.countBasic(fileItem, contentsPattern);
-
-		if (foundInFile)
+		else
 		{
-			foundCount++;
+			fprintf(stderr, "Found content in %s %s. Output piped to stdout.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+					foundCount == 1 ? "file" : "files");
 		}
+	}
+}
+
+void Sniffle::runTail(const std::string& filePattern, const std::string& contentsPattern)
+{
+	// this is done as a file find, with the contents of the files being processed as they're found.
 
-		// TODO: this bit could be kept within FileGrepper...
-		foundPrevious |= foundInFile;
+	disableLineNumbers("in tail mode");
+
+	FileContentProcessor contentProcessor(m_config);
+	std::string errorMessage;
+	if (!contentProcessor.configureGrepLast(contentsPattern, errorMessage))
+	{
+		fprintf(stderr, "Invalid regex: %s\n", errorMessage.c_str());
+		return;
 	}
 
+	size_t foundCount = 0;
+	if (!findAndProcessFiles(filePattern, contentProcessor, foundCount))
+		return;
+
+	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
+
 	if (printProgress)
 	{
 		// annoyingly, we need to clear the remainder of previous progress line here, hence the space padding...
@@ -416,70 +388,31 @@ void Sniffle::runCount(const std::string& filePattern, const std::string& conten
 
 void Sniffle::runMatch(const std::string& filePattern, const std::string& contentsPattern)
 {
-	// this can be done as a file find, plus additional contents search on the results.
-	// TODO: contents search in multiple threads...
+	// this is done as a file find, with the contents of the files being processed as they're found.
 
 	// do the initialisation first, so that we can print an error if there's a problem with the match term before we bother
 	// searching for files.
-	FileGrepper grepper(m_config);
-	if (!grepper.initMatch(contentsPattern))
+	FileContentProcessor contentProcessor(m_config);
+	std::string errorMessage;
+	if (!contentProcessor.configureMatch(contentsPattern, errorMessage))
 	{
-		fprintf(stderr, "Invalid match pattern. Make sure you provide multiple items to search for, separated by the respective OR and AND character separators.\n");
+		if (!errorMessage.empty())
+		{
+			fprintf(stderr, "Invalid regex: %s\n", errorMessage.c_str());
+		}
+		else
+		{
+			fprintf(stderr, "Invalid match pattern. Make sure you provide multiple items to search for, separated by the respective OR and AND character separators.\n");
+		}
 		return;
 	}
 
-	std::vector<std::string> foundFiles;
-
-	fprintf(stderr, "Searching for files...\n");
-
-	if (!findFiles(filePattern, foundFiles, 0))
-	{
-		fprintf(stderr, "No files found matching file match criteria.\n");
+	size_t foundCount = 0;
+	if (!findAndProcessFiles(filePattern, contentProcessor, foundCount))
 		return;
-	}
-
-	fprintf(stderr, "Found %s %s matching file match criteria.\n", StringHelpers::formatNumberThousandsSeparator(foundFiles.size()).c_str(),
-			foundFiles.size() == 1 ? "file" : "files");
 
 	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
 
-	bool foundPrevious = false;
-
-	size_t totalFiles = foundFiles.size();
-	size_t fileCount = 0;
-	size_t lastPercentage = 101;
-	size_t foundCount = 0;
-
-	if (printProgress)
-	{
-		fprintf(stderr, "Searching files for match content...");
-	}
-
-	for (const std::string& fileItem : foundFiles)
-	{
-		if (printProgress)
-		{
-			fileCount++;
-			size_t thisPercentage = (fileCount * 100) / totalFiles;
-			if (thisPercentage != lastPercentage)
-			{
-				fprintf(stderr, "\rSearching files for match content - %zu%% complete...", thisPercentage);
-				lastPercentage = thisPercentage;
-			}
-		}
-
-		// the grepper itself does any printing...
-		bool foundInFile = grepper.matchBasic(fileItem, foundPrevious);
-
-		if (foundInFile)
-		{
-			foundCount++;
-		}
-
-		// TODO: this bit could be kept within FileGrepper...
-		foundPrevious |= foundInFile;
-	}
-
 	if (printProgress)
 	{
 		// annoyingly, we need to clear the remainder of previous progress line here, hence the space padding...
@@ -502,69 +435,67 @@ void Sniffle::runMatch(const std::string& filePattern, const std::string& conten
 	}
 }
 
-void Sniffle::runTimestampDeltaFind(const std::string& filePattern, uint64_t timeDeltaSecond)
+void Sniffle::runTimestampDeltaFind(const std::string& filePattern, uint64_t timeDeltaMicroseconds)
 {
-	// this can be done as a file find, plus additional contents search on the results.
-	// TODO: contents search in multiple threads...
-
-	std::vector<std::string> foundFiles;
+	// this is done as a file find, with the contents of the files being processed as they're found.
 
-	fprintf(stderr, "Searching for files...\n");
+	FileContentProcessor contentProcessor(m_config);
+	contentProcessor.configureTimestampDelta(timeDeltaMicroseconds);
 
-	if (!findFiles(filePattern, foundFiles, 0))
-	{
-		fprintf(stderr, "No files found matching file match criteria.\n");
+	size_t foundCount = 0;
+	if (!findAndProcessFiles(filePattern, contentProcessor, foundCount))
 		return;
-	}
-
-	fprintf(stderr, "Found %s %s matching file match criteria.\n", StringHelpers::formatNumberThousandsSeparator(foundFiles.size()).c_str(),
-			foundFiles.size() == 1 ? "file" : "files");
 
 	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
 
-	FileGrepper grepper(m_config);
-
-	bool foundPrevious = false;
-
-	size_t totalFiles = foundFiles.size();
-	size_t fileCount = 0;
-	size_t lastPercentage = 101;
-	size_t foundCount = 0;
-
 	if (printProgress)
 	{
-		fprintf(stderr, "Searching files for timestamp delta diff...");
+		// annoyingly, we need to clear the remainder of previous progress line here, hence the space padding...
+		fprintf(stderr, "\rFound matching timestamp deltas in %s %s. Output piped to stdout.%-5s\n",
+								StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+								foundCount == 1 ? "file" : "files", " ");
 	}
-
-	for (const std::string& fileItem : foundFiles)
+	else
 	{
-		if (printProgress)
+		if (SystemHelpers::isStdOutATTY())
 		{
-			fileCount++;
-			size_t thisPercentage = (fileCount * 100) / totalFiles;
-			if (thisPercentage != lastPercentage)
-			{
-				fprintf(stderr, "\rSearching files for timestamp delta diff - %zu%% complete...", thisPercentage);
-				lastPercentage = thisPercentage;
-			}
+			fprintf(stderr, "Found matching timestamp deltas in %s %s.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+					foundCount == 1 ? "file" : "files");
 		}
-
-		// the grepper itself does any printing...
-		bool foundInFile = grepper.findTimestampDelta(fileItem, timeDeltaSecond, foundPrevious);
-
-		if (foundInFile)
+		else
 		{
-			foundCount++;
+			fprintf(stderr, "Found matching timestamp deltas in %s %s. Output piped to stdout.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+					foundCount == 1 ? "file" : "files");
 		}
-
-		// TODO: this bit could be kept within FileGrepper...
-		foundPrevious |= foundInFile;
 	}
+}
+
+void Sniffle::setTimeWindow(const std::string& windowStart, const std::string& windowEnd)
+{
+	m_timeWindow = true;
+	m_timeWindowStart = windowStart;
+	m_timeWindowEnd = windowEnd;
+
+	disableLineNumbers("with a time window");
+}
+
+void Sniffle::runTimeWindow(const std::string& filePattern)
+{
+	// this is done as a file find, with the contents of the files being processed as they're found.
+
+	FileContentProcessor contentProcessor(m_config);
+	contentProcessor.configureOutputLines();
+
+	size_t foundCount = 0;
+	if (!findAndProcessFiles(filePattern, contentProcessor, foundCount))
+		return;
+
+	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
 
 	if (printProgress)
 	{
 		// annoyingly, we need to clear the remainder of previous progress line here, hence the space padding...
-		fprintf(stderr, "\rFound matching timestamp deltas in %s %s. Output piped to stdout.%-5s\n",
+		fprintf(stderr, "\rFound lines within time window in %s %s. Output piped to stdout.%-5s\n",
 								StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
 								foundCount == 1 ? "file" : "files", " ");
 	}
@@ -572,19 +503,70 @@ void Sniffle::runTimestampDeltaFind(const std::string& filePattern, uint64_t tim
 	{
 		if (SystemHelpers::isStdOutATTY())
 		{
-			fprintf(stderr, "Found matching timestamp deltas in %s %s.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+			fprintf(stderr, "Found lines within time window in %s %s.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
 					foundCount == 1 ? "file" : "files");
 		}
 		else
 		{
-			fprintf(stderr, "Found matching timestamp deltas in %s %s. Output piped to stdout.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
+			fprintf(stderr, "Found lines within time window in %s %s. Output piped to stdout.\n", StringHelpers::formatNumberThousandsSeparator(foundCount).c_str(),
 					foundCount == 1 ? "file" : "files");
 		}
 	}
 }
 
+void Sniffle::runFollow(const std::string& filePattern, const std::string& contentsPattern, bool countMode)
+{
+	// the files are followed from their current end, so we don't know the line numbers
+	disableLineNumbers("in follow mode");
+
+	FileFollower follower(m_config);
+	std::string errorMessage;
+	if (!follower.initGrep(contentsPattern, countMode, errorMessage))
+	{
+		fprintf(stderr, "Invalid regex: %s\n", errorMessage.c_str());
+		return;
+	}
+
+	fprintf(stderr, "Searching for files...\n");
+
+	findFiles(filePattern, follower, 0);
+	follower.setInitialFilesFound();
+
+	if (follower.getFileCount() == 0)
+	{
+		fprintf(stderr, "No files found matching file match criteria yet, waiting for some...\n");
+	}
+	else
+	{
+		fprintf(stderr, "Following %s %s matching file match criteria...\n",
+				StringHelpers::formatNumberThousandsSeparator(follower.getFileCount()).c_str(),
+				follower.getFileCount() == 1 ? "file" : "files");
+	}
+
+	while (true)
+	{
+		if (follower.waitForChanges())
+		{
+			// look for any new files - the ones we already know about are ignored
+			findFiles(filePattern, follower, 0);
+		}
+
+		follower.processChangedFiles();
+	}
+}
+
 //
 
+void Sniffle::disableLineNumbers(const char* modeDescription)
+{
+	if (m_config.getOutputLineNumbers())
+	{
+		// we'd need to read the whole file up to where we start to know them
+		fprintf(stderr, "Warning: line numbers can't be output %s, so they're disabled.\n", modeDescription);
+		m_config.setOutputLineNumbers(false);
+	}
+}
+
 PatternSearch Sniffle::classifyPattern(const std::string& pattern)
 {
 	PatternSearch result;
@@ -787,6 +769,13 @@ bool Sniffle::configureFileFinder(const PatternSearch& pattern)
 	// this shouldn't be needed, as we shouldn't get to here if we don't have a valid pattern type, but...
 	if (pattern.type == PatternSearch::ePatternError || pattern.type == PatternSearch::ePatternUnknown)
 		return false;
+
+	// in follow mode, files are found more than once
+	if (m_pFileFinder)
+	{
+		delete m_pFileFinder;
+		m_pFileFinder = nullptr;
+	}
 	
 	if (pattern.type == PatternSearch::ePatternSimple)
 	{
@@ -812,7 +801,7 @@ bool Sniffle::configureFileFinder(const PatternSearch& pattern)
 	return true;
 }
 
-bool Sniffle::findFiles(const std::string& pattern, std::vector<std::string>& foundFiles, unsigned int findFlags)
+bool Sniffle::findFiles(const std::string& pattern, FoundFileSink& foundFiles, unsigned int findFlags)
 {
 	PatternSearch patternRes = classifyPattern(pattern);
 
@@ -827,7 +816,7 @@ bool Sniffle::findFiles(const std::string& pattern, std::vector<std::string>& fo
 			return false;
 		}
 		fclose(pFile);
-		foundFiles.push_back(pattern);
+		foundFiles.addFoundFile(pattern, kUnknownFileSize);
 		return true;
 	}
 
@@ -848,3 +837,55 @@ bool Sniffle::findFiles(const std::string& pattern, std::vector<std::string>& fo
 
 	return found;
 }
+
+void Sniffle::findFilesToQueue(const std::string& pattern, FoundFileQueue* pFoundFileQueue)
+{
+	findFiles(pattern, *pFoundFileQueue, 0);
+
+	pFoundFileQueue->setFinished();
+}
+
+bool Sniffle::findAndProcessFiles(const std::string& pattern, FileContentProcessor& contentProcessor, size_t& foundCount)
+{
+	if (m_timeWindow)
+	{
+		std::string errorMessage;
+		if (!contentProcessor.configureTimeWindow(m_timeWindowStart, m_timeWindowEnd, errorMessage))
+		{
+			fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+			return false;
+		}
+	}
+
+	fprintf(stderr, "Searching for files...\n");
+
+	// find the files on a separate thread, so that the files found so far can be processed while we carry on
+	// looking for more, with the queue size limiting how far ahead of the processing finding can get
+	FoundFileQueue foundFileQueue(kMaxQueuedFoundFiles);
+	std::thread findThread(&Sniffle::findFilesToQueue, this, std::cref(pattern), &foundFileQueue);
+
+	foundCount = contentProcessor.processFiles(foundFileQueue);
+
+	findThread.join();
+
+	bool finished = false;
+	size_t numFoundFiles = foundFileQueue.getAddedCount(finished);
+
+	bool printProgress = m_config.getPrintProgressWhenOutToStdOut() && !SystemHelpers::isStdOutATTY();
+	if (printProgress)
+	{
+		// clear the progress line
+		fprintf(stderr, "\r%-70s\r", " ");
+	}
+
+	if (numFoundFiles == 0)
+	{
+		fprintf(stderr, "No files found matching file match criteria.\n");
+		return false;
+	}
+
+	fprintf(stderr, "Found %s %s matching file match criteria.\n", StringHelpers::formatNumberThousandsSeparator(numFoundFiles).c_str(),
+			numFoundFiles == 1 ? "file" : "files");
+
+	return true;
+}
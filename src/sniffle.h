@@ -28,6 +28,9 @@
 #include "file_filters.h"
 
 class FilenameMatcher;
+class FileContentProcessor;
+class FoundFileSink;
+class FoundFileQueue;
 
 class Sniffle
 {
@@ -45,10 +48,23 @@ public:
 	void runGrep(const std::string& filePattern, const std::string& contentsPattern);
 	
 	void runCount(const std::string& filePattern, const std::string& contentsPattern);
+
+	// like grep, but only the last matches in each file
+	void runTail(const std::string& filePattern, const std::string& contentsPattern);
 	
 	void runMatch(const std::string& filePattern, const std::string& contentsPattern);
 
-	void runTimestampDeltaFind(const std::string& filePattern, uint64_t timeDeltaSecond);
+	void runTimestampDeltaFind(const std::string& filePattern, uint64_t timeDeltaMicroseconds);
+
+	// with a time window set, the content commands only process the part of each file with timestamps within it
+	void setTimeWindow(const std::string& windowStart, const std::string& windowEnd);
+
+	// just outputs the lines within the time window
+	void runTimeWindow(const std::string& filePattern);
+
+	// keeps following the files as they grow (and any new ones), running grep or count on the lines added to them.
+	// This never returns.
+	void runFollow(const std::string& filePattern, const std::string& contentsPattern, bool countMode);
 
 private:
 
@@ -61,10 +77,19 @@ private:
 
 	static PatternSearch classifyPattern(const std::string& pattern);
 
+	// for modes where files aren't read from the start, so the line numbers aren't known
+	void disableLineNumbers(const char* modeDescription);
+
 	bool configureFilenameMatcher(const PatternSearch& pattern);
 	bool configureFileFinder(const PatternSearch& pattern);
 
-	bool findFiles(const std::string& pattern, std::vector<std::string>& foundFiles, unsigned int findFlags);
+	bool findFiles(const std::string& pattern, FoundFileSink& foundFiles, unsigned int findFlags);
+
+	void findFilesToQueue(const std::string& pattern, FoundFileQueue* pFoundFileQueue);
+
+	// finds files and processes them at the same time, returning false (after printing a message) if there
+	// weren't any files found
+	bool findAndProcessFiles(const std::string& pattern, FileContentProcessor& contentProcessor, size_t& foundCount);
 	//
 
 
@@ -73,6 +98,10 @@ private:
 
 	FilterParameters	m_filter;
 
+	bool				m_timeWindow;
+	std::string			m_timeWindowStart;
+	std::string			m_timeWindowEnd;
+
 	FilenameMatcher*	m_pFilenameMatcher;
 	FileFinder*			m_pFileFinder;
 };
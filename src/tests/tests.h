@@ -20,9 +20,22 @@
 #define TESTS_H
 
 #include <stdio.h>
+#include <stdlib.h>
 
+#include <algorithm>
+#include <regex>
+
+#include <unistd.h>
+
+#include "utils/io_uring_reader.h"
+#include "utils/search_kernels.h"
 #include "utils/string_helpers.h"
 #include "filename_matchers.h"
+#include "searcher.h"
+#include "multi_searcher.h"
+#include "regex_searcher.h"
+#include "timestamp_parser.h"
+#include "file_grepper.h"
 
 // disgusting putting this in header instead of doing it properly, but don't want to play
 // around with build stuff yet...
@@ -34,6 +47,601 @@ public:
 	{
 		return true;
 	}
+
+	// random content for the search tests, from a small alphabet so there are lots of partial matches
+	static std::string makeRandomHaystack(const char* alphabet, unsigned int seed)
+	{
+		srand(seed);
+
+		const size_t alphabetLength = strlen(alphabet);
+
+		std::string haystack;
+		for (unsigned int i = 0; i < 4000; i++)
+		{
+			haystack += alphabet[rand() % alphabetLength];
+		}
+		return haystack;
+	}
+
+	// a needle taken from somewhere in the haystack, optionally with a 'z' (which isn't in any of the haystacks)
+	// swapped in to make it unlikely to be found
+	static std::string pickRandomNeedle(const std::string& haystack, size_t needleLength, bool makeUnlikely)
+	{
+		std::string needle = haystack.substr(rand() % (haystack.size() - needleLength), needleLength);
+		if (makeUnlikely && needleLength > 0)
+		{
+			needle[needleLength / 2] = 'z';
+		}
+		return needle;
+	}
+
+	// a range within the haystack, with different start offsets and lengths to cover remainders
+	static void pickRandomRange(const std::string& haystack, const char*& start, const char*& end)
+	{
+		size_t haystackStart = rand() % 64;
+		start = haystack.c_str() + haystackStart;
+		end = start + rand() % (haystack.size() - haystackStart);
+	}
+
+	static bool charsEqualIgnoreCase(char a, char b)
+	{
+		return tolower(a) == tolower(b);
+	}
+
+	// what a search for the needle within the range should return
+	static const char* findExpected(const char* start, const char* end, const std::string& needle, bool caseInsensitive = false)
+	{
+		const char* found = caseInsensitive ? std::search(start, end, needle.begin(), needle.end(), charsEqualIgnoreCase) :
+											  std::search(start, end, needle.begin(), needle.end());
+		return (found == end) ? nullptr : found;
+	}
+
+	bool testSearchKernels()
+	{
+		SearchKernels::KernelType kernelTypes[3] = { SearchKernels::eKernelScalar, SearchKernels::eKernelSSE2, SearchKernels::eKernelAVX2 };
+
+		std::string haystack = makeRandomHaystack("abcd", 42);
+
+		bool allOK = true;
+
+		for (SearchKernels::KernelType kernelType : kernelTypes)
+		{
+			if (!SearchKernels::setKernelType(kernelType))
+				continue;
+
+			for (unsigned int needleLength = 0; needleLength < 40; needleLength++)
+			{
+				for (unsigned int attempt = 0; attempt < 50; attempt++)
+				{
+					std::string needle = pickRandomNeedle(haystack, needleLength, attempt % 2 == 1);
+
+					const char* start = nullptr;
+					const char* end = nullptr;
+					pickRandomRange(haystack, start, end);
+
+					const char* result = SearchKernels::findString(start, end - start, needle.c_str(), needleLength);
+					if (result != findExpected(start, end, needle))
+					{
+						fprintf(stderr, "FAIL: findString() kernel: %u, needle length: %u\n", (unsigned int)kernelType, needleLength);
+						allOK = false;
+					}
+				}
+			}
+		}
+
+		SearchKernels::init();
+
+		return CHECK_RETURN_TRUE("test search kernels", allOK);
+	}
+
+	bool testSearchers()
+	{
+		Searcher::Algorithm algorithms[3] = { Searcher::eAlgorithmSingleChar, Searcher::eAlgorithmSIMD, Searcher::eAlgorithmHorspool };
+
+		std::string haystack = makeRandomHaystack("abcd", 43);
+
+		bool allOK = true;
+
+		for (Searcher::Algorithm algorithm : algorithms)
+		{
+			for (unsigned int needleLength = 1; needleLength < 70; needleLength++)
+			{
+				for (unsigned int attempt = 0; attempt < 20; attempt++)
+				{
+					std::string needle = pickRandomNeedle(haystack, needleLength, attempt % 2 == 1);
+
+					Searcher searcher(needle, algorithm);
+
+					const char* start = nullptr;
+					const char* end = nullptr;
+					pickRandomRange(haystack, start, end);
+
+					if (searcher.find(start, end) != findExpected(start, end, needle))
+					{
+						fprintf(stderr, "FAIL: Searcher algorithm: %u, needle length: %u\n", (unsigned int)searcher.getAlgorithm(), needleLength);
+						allOK = false;
+					}
+				}
+			}
+		}
+
+		return CHECK_RETURN_TRUE("test searchers", allOK);
+	}
+
+	bool testMultiSearcher()
+	{
+		SearchKernels::KernelType kernelTypes[3] = { SearchKernels::eKernelScalar, SearchKernels::eKernelSSE2, SearchKernels::eKernelAVX2 };
+
+		std::string haystack = makeRandomHaystack("abcde", 44);
+
+		bool allOK = true;
+
+		for (SearchKernels::KernelType kernelType : kernelTypes)
+		{
+			if (!SearchKernels::setKernelType(kernelType))
+				continue;
+
+			for (unsigned int attempt = 0; attempt < 500; attempt++)
+			{
+				// few items (which use the SearchKernels search), as well as lots of items (which use the DFA)
+				unsigned int numItems = 1 + rand() % ((attempt % 2 == 0) ? 4 : 30);
+				std::vector<std::string> items;
+				for (unsigned int i = 0; i < numItems; i++)
+				{
+					unsigned int itemLength = 1 + rand() % 10;
+					bool makeUnlikely = rand() % 2 == 1;
+					items.emplace_back(pickRandomNeedle(haystack, itemLength, makeUnlikely));
+				}
+
+				MultiSearcher searcher;
+				searcher.init(items);
+
+				const char* start = nullptr;
+				const char* end = nullptr;
+				pickRandomRange(haystack, start, end);
+
+				// depending on the method, the result can be either the first match to start or the first to end,
+				// so check it's a real match and that there are no other matches completely before it
+				unsigned int resultIndex = 0;
+				const char* result = searcher.find(start, end, &resultIndex);
+
+				const char* firstMatchEnd = nullptr;
+				for (const char* matchEnd = start + 1; matchEnd <= end && firstMatchEnd == nullptr; matchEnd++)
+				{
+					for (const std::string& item : items)
+					{
+						if ((size_t)(matchEnd - start) >= item.size() && memcmp(matchEnd - item.size(), item.c_str(), item.size()) == 0)
+						{
+							firstMatchEnd = matchEnd;
+							break;
+						}
+					}
+				}
+
+				bool resultOK = false;
+				if (result == nullptr)
+				{
+					resultOK = firstMatchEnd == nullptr;
+				}
+				else if (resultIndex < numItems)
+				{
+					const std::string& item = items[resultIndex];
+					resultOK = result + item.size() <= end && memcmp(result, item.c_str(), item.size()) == 0 &&
+								firstMatchEnd != nullptr && result < firstMatchEnd;
+
+					if (numItems <= SearchKernels::kMaxFindStringsNeedles)
+					{
+						// the SearchKernels search should always find the one which starts first
+						for (const std::string& otherItem : items)
+						{
+							const char* otherFound = findExpected(start, end, otherItem);
+							if (otherFound != nullptr && otherFound < result)
+							{
+								resultOK = false;
+							}
+						}
+					}
+				}
+
+				if (!resultOK)
+				{
+					fprintf(stderr, "FAIL: MultiSearcher kernel: %u, items: %u\n", (unsigned int)kernelType, numItems);
+					allOK = false;
+				}
+			}
+		}
+
+		SearchKernels::init();
+
+		return CHECK_RETURN_TRUE("test multi searcher", allOK);
+	}
+
+	bool testCaseInsensitiveSearch()
+	{
+		SearchKernels::KernelType kernelTypes[3] = { SearchKernels::eKernelScalar, SearchKernels::eKernelSSE2, SearchKernels::eKernelAVX2 };
+		Searcher::Algorithm algorithms[3] = { Searcher::eAlgorithmSingleChar, Searcher::eAlgorithmSIMD, Searcher::eAlgorithmHorspool };
+
+		// include non-letters which only differ from others by the 0x20 bit, which mustn't match each other
+		std::string haystack = makeRandomHaystack("aAbB@`[{", 45);
+
+		bool allOK = true;
+
+		for (SearchKernels::KernelType kernelType : kernelTypes)
+		{
+			if (!SearchKernels::setKernelType(kernelType))
+				continue;
+
+			for (unsigned int needleLength = 1; needleLength < 40; needleLength++)
+			{
+				for (unsigned int attempt = 0; attempt < 30; attempt++)
+				{
+					std::string needle = pickRandomNeedle(haystack, needleLength, false);
+					for (char& c : needle)
+					{
+						if (rand() % 2 == 1)
+							c = (char)toupper(c);
+					}
+
+					const char* start = nullptr;
+					const char* end = nullptr;
+					pickRandomRange(haystack, start, end);
+
+					const char* expected = findExpected(start, end, needle, true);
+
+					std::string lowerNeedle = needle;
+					StringHelpers::toLower(lowerNeedle);
+					if (SearchKernels::findStringCaseInsensitive(start, end - start, lowerNeedle.c_str(), needleLength) != expected)
+					{
+						fprintf(stderr, "FAIL: findStringCaseInsensitive() kernel: %u, needle length: %u\n", (unsigned int)kernelType, needleLength);
+						allOK = false;
+					}
+
+					Searcher searcher(needle, algorithms[attempt % 3], true);
+					if (searcher.find(start, end) != expected)
+					{
+						fprintf(stderr, "FAIL: case insensitive Searcher algorithm: %u, needle length: %u\n", (unsigned int)searcher.getAlgorithm(), needleLength);
+						allOK = false;
+					}
+
+					// and with other items, for both the SearchKernels search and the DFA - anything found has to be a match
+					// with no other matches completely before it
+					std::vector<std::string> items(1, needle);
+					unsigned int numOtherItems = (attempt % 2 == 0) ? 2 : 10;
+					for (unsigned int i = 0; i < numOtherItems; i++)
+					{
+						std::string item = pickRandomNeedle(haystack, 2 + rand() % 6, false);
+						item[0] = (char)toupper(item[0]);
+						items.emplace_back(item);
+					}
+
+					MultiSearcher multiSearcher;
+					multiSearcher.init(items, true);
+
+					unsigned int resultIndex = 0;
+					const char* result = multiSearcher.find(start, end, &resultIndex);
+
+					const char* firstMatchEnd = end + 1;
+					for (const std::string& item : items)
+					{
+						const char* found = findExpected(start, end, item, true);
+						if (found != nullptr)
+						{
+							firstMatchEnd = std::min(firstMatchEnd, found + item.size());
+						}
+					}
+
+					bool resultOK = (result == nullptr) ? firstMatchEnd == end + 1 :
+									(resultIndex < items.size() && result < firstMatchEnd &&
+									 std::equal(items[resultIndex].begin(), items[resultIndex].end(), result, charsEqualIgnoreCase));
+					if (!resultOK)
+					{
+						fprintf(stderr, "FAIL: case insensitive MultiSearcher kernel: %u, items: %u\n", (unsigned int)kernelType, (unsigned int)items.size());
+						allOK = false;
+					}
+				}
+			}
+		}
+
+		SearchKernels::init();
+
+		return CHECK_RETURN_TRUE("test case insensitive search", allOK);
+	}
+
+	bool testRegexSearcher()
+	{
+		// compare against std::regex (POSIX extended, which is also leftmost longest) on random lines
+		const char* patterns[] = { "Error [0-9]+ in frame", "a(b|c)*d", "^ab", "cd$", "^(a|b)*$", "x{2,3}y", "(ab|cd)+e?",
+								   "[^a-c]z", "a.c|b..d", "e{2}", "[[:alpha:]]{3}[0-9]", "(a|b|c|d|e|f|g)h",
+								   "^", "x*", "a|^" };
+		const char chars[] = "abcdexyz019 E";
+
+		srand(45);
+
+		bool allOK = true;
+
+		for (const char* pattern : patterns)
+		{
+			RegexSearcher searcher;
+			std::string errorMessage;
+			if (!searcher.init(pattern, errorMessage))
+			{
+				fprintf(stderr, "FAIL: RegexSearcher init: %s: %s\n", pattern, errorMessage.c_str());
+				allOK = false;
+				continue;
+			}
+
+			std::regex expected(pattern, std::regex::extended);
+
+			for (unsigned int attempt = 0; attempt < 500; attempt++)
+			{
+				std::string content;
+				int expectedFirstLine = -1;
+				unsigned int expectedCount = 0;
+
+				unsigned int numLines = 1 + rand() % 5;
+				for (unsigned int i = 0; i < numLines; i++)
+				{
+					std::string line;
+					unsigned int lineLength = rand() % 14;
+					for (unsigned int j = 0; j < lineLength; j++)
+					{
+						line += chars[rand() % (sizeof(chars) - 1)];
+					}
+					if (rand() % 20 == 0)
+					{
+						line = "Error 123 in frame";
+					}
+
+					if (std::regex_search(line, expected))
+					{
+						if (expectedFirstLine == -1)
+						{
+							expectedFirstLine = i;
+						}
+
+						unsigned int lineCount = 0;
+						for (std::sregex_iterator it(line.begin(), line.end(), expected); it != std::sregex_iterator(); ++it)
+						{
+							if (it->length() > 0)
+								lineCount++;
+						}
+						// lines which only match something empty count once
+						expectedCount += std::max(lineCount, 1u);
+					}
+
+					content += line + "\n";
+				}
+
+				const char* start = content.c_str();
+				const char* end = start + content.size();
+
+				const char* result = searcher.find(start, end);
+				int resultLine = (result == nullptr) ? -1 : (int)std::count(start, result, '\n');
+				unsigned int resultCount = searcher.countMatches(start, end);
+
+				if (resultLine != expectedFirstLine || resultCount != expectedCount)
+				{
+					fprintf(stderr, "FAIL: RegexSearcher pattern: %s, content: %s\n", pattern, content.c_str());
+					allOK = false;
+				}
+			}
+		}
+
+		RegexSearcher invalidSearcher;
+		std::string errorMessage;
+		if (invalidSearcher.init("a(b", errorMessage) || invalidSearcher.init("\\1", errorMessage) || invalidSearcher.init("a{3,1}", errorMessage))
+		{
+			fprintf(stderr, "FAIL: RegexSearcher accepted invalid pattern\n");
+			allOK = false;
+		}
+
+		return CHECK_RETURN_TRUE("test regex searcher", allOK);
+	}
+
+	bool testTimestampParser()
+	{
+		struct TimestampTest
+		{
+			const char*		format;
+			const char*		line1;
+			const char*		line2;
+			int64_t			expectedDelta; // in microseconds
+		};
+
+		static const int64_t kSecond = 1000000;
+
+		const TimestampTest tests[] = {
+			{ "[%ts%]", "[2019-03-28 08:23:33] a", "[2019-03-28 09:24:35] b", 3662 * kSecond },
+			{ "%ts%", "2019-03-28 23:59:59.123", "2019-03-29 00:00:01,5 b", 2 * kSecond + 377000 },
+			{ "%ts%", "2019-12-31 23:59:59", "2020-01-01 00:00:00", kSecond }, // across a year boundary
+			{ "%ts%", "2019-02-28 12:00:00", "2024-03-01 12:00:00", (5 * 365 + 3) * 86400 * kSecond }, // across leap years
+			{ "%Y-%m-%dT%H:%M:%SZ", "2019-03-28T08:23:33.123Z", "2019-04-01T08:23:33Z", 4 * 86400 * kSecond - 123000 },
+			{ "%Y-%m-%dT%H:%M:%S.%fZ", "2019-03-28T08:23:33.1Z", "2019-03-28T08:23:43.1234567Z x", 10 * kSecond + 23456 },
+			{ "%b %e %H:%M:%S", "Feb  8 08:23:33 host", "Mar 28 08:23:33 host", 49 * 86400 * kSecond }, // no year, so a leap year,
+			{ "%s", "1553761413 a", "1553761414.5 b", kSecond + 500000 },
+			{ "%Q", "1553761413000 a", "1553761473999 b", 60 * kSecond + 999000 },
+			{ "%*[%ts%]", "INFO host [2019-03-28 08:23:33]", "WARN [2019-03-28 08:23:40] x", 7 * kSecond }
+		};
+
+		bool allOK = true;
+
+		for (const TimestampTest& test : tests)
+		{
+			TimestampParser parser;
+			std::string errorMessage;
+			if (!parser.init(test.format, errorMessage))
+			{
+				fprintf(stderr, "FAIL: TimestampParser init: %s: %s\n", test.format, errorMessage.c_str());
+				allOK = false;
+				continue;
+			}
+
+			int64_t time1 = 0;
+			int64_t time2 = 0;
+			if (!parser.parse(test.line1, test.line1 + strlen(test.line1), time1) ||
+				!parser.parse(test.line2, test.line2 + strlen(test.line2), time2) || time2 - time1 != test.expectedDelta)
+			{
+				fprintf(stderr, "FAIL: TimestampParser parse: %s\n", test.format);
+				allOK = false;
+			}
+		}
+
+		// the calendar and epoch times should agree
+		TimestampParser calendarParser;
+		TimestampParser epochParser;
+		std::string errorMessage;
+		calendarParser.init("%ts%", errorMessage);
+		epochParser.init("%s", errorMessage);
+		const char* calendarLine = "2019-03-28 08:23:33.25";
+		const char* epochLine = "1553761413.25";
+		int64_t calendarTime = 0;
+		int64_t epochTime = 0;
+		if (!calendarParser.parse(calendarLine, calendarLine + strlen(calendarLine), calendarTime) ||
+			!epochParser.parse(epochLine, epochLine + strlen(epochLine), epochTime) || calendarTime != epochTime)
+		{
+			fprintf(stderr, "FAIL: TimestampParser calendar time doesn't match epoch time\n");
+			allOK = false;
+		}
+
+		// times given on the command line
+		const char* timeStrings[] = { "2019-03-28", "2019-03-28 00:00", "2019-03-28T00:00:00", "2019-03-28 00:00:00.0" };
+		for (const char* timeString : timeStrings)
+		{
+			int64_t time = 0;
+			if (!calendarParser.parseTimeString(timeString, time) || time != (calendarTime / kSecond - 8 * 3600 - 23 * 60 - 33) * kSecond)
+			{
+				fprintf(stderr, "FAIL: TimestampParser parseTimeString: %s\n", timeString);
+				allOK = false;
+			}
+		}
+		int64_t invalidTime = 0;
+		if (calendarParser.parseTimeString("2019-03-28 00:00 x", invalidTime) || calendarParser.parseTimeString("2019-03-28 00", invalidTime))
+		{
+			fprintf(stderr, "FAIL: TimestampParser parseTimeString accepted invalid time\n");
+			allOK = false;
+		}
+
+		// lines which shouldn't parse
+		const char* invalidLines[] = { "", "[2019-03-28 08:23:3]", "[2019-13-28 08:23:33]", "[2019-03-28 08:23:33", "2019-03-28 08:23:33]",
+									   "[2019-03-28 08:2a:33]", "[INFO] 2019-03-28 08:23:33" };
+		TimestampParser parser;
+		parser.init("[%ts%]", errorMessage);
+		for (const char* line : invalidLines)
+		{
+			int64_t time = 0;
+			if (parser.parse(line, line + strlen(line), time))
+			{
+				fprintf(stderr, "FAIL: TimestampParser parsed invalid line: %s\n", line);
+				allOK = false;
+			}
+		}
+
+		// invalid formats
+		const char* invalidFormats[] = { "%Y-%m-%d", "%x %H", "%s %H", "%H%", "%*%H" };
+		for (const char* format : invalidFormats)
+		{
+			if (parser.init(format, errorMessage))
+			{
+				fprintf(stderr, "FAIL: TimestampParser accepted invalid format: %s\n", format);
+				allOK = false;
+			}
+		}
+
+		return CHECK_RETURN_TRUE("test timestamp parser", allOK);
+	}
+
+	bool testCountOccurrences()
+	{
+		struct CountTest
+		{
+			const char*		searchString;
+			bool			caseInsensitive;
+			const char*		content;
+			unsigned int	expectedCount;
+		};
+
+		const CountTest tests[] = {
+			{ "ab", false, "abab\nxab\n", 3 },
+			{ "aa", false, "aaaa\naaa\n", 3 }, // occurrences don't overlap
+			{ "Ab", true, "aBAB\nab\n", 3 },
+			{ "b", true, "abB\nb", 3 },
+			// an empty string matches each line once (rather than being found at the same place forever)
+			{ "", false, "abc\n\nxyz", 3 },
+			{ "", false, "abc\n\nxyz\n", 3 },
+			{ "", true, "abc\n", 1 },
+			{ "", false, "", 0 }
+		};
+
+		bool allOK = true;
+
+		for (const CountTest& test : tests)
+		{
+			Searcher searcher;
+			searcher.init(test.searchString, Searcher::eAlgorithmAuto, test.caseInsensitive);
+
+			unsigned int count = FileGrepper::countOccurrences(searcher, test.content, test.content + strlen(test.content));
+			if (count != test.expectedCount)
+			{
+				fprintf(stderr, "FAIL: countOccurrences: '%s' found %u times, expected %u\n", test.searchString, count, test.expectedCount);
+				allOK = false;
+			}
+		}
+
+		return CHECK_RETURN_TRUE("test count occurrences", allOK);
+	}
+
+	bool testIoUringReader()
+	{
+		IoUringReader reader;
+		if (!reader.init(4))
+		{
+			fprintf(stderr, "SKIP: test io_uring reader (io_uring isn't available)\n");
+			return true;
+		}
+
+		char tempFilename[] = "/tmp/sniffle_test_XXXXXX";
+		int fileDescriptor = mkstemp(tempFilename);
+		if (fileDescriptor == -1)
+			return CHECK_RETURN_TRUE("test io_uring reader temp file", false);
+
+		unlink(tempFilename);
+
+		char data[3 * 64];
+		for (unsigned int i = 0; i < sizeof(data); i++)
+		{
+			data[i] = (char)('a' + (i / 64));
+		}
+
+		bool allOK = write(fileDescriptor, data, sizeof(data)) == (ssize_t)sizeof(data);
+
+		char buffers[3][64];
+		memset(buffers, 0, sizeof(buffers));
+
+		allOK = allOK && reader.queueRead(fileDescriptor, buffers[0], 64, 0, 0) && reader.queueRead(fileDescriptor, buffers[1], 64, 64, 1);
+
+		uint64_t userData = 0;
+		int result = 0;
+		allOK = allOK && reader.waitForCompletion(userData, result) && result == 64;
+
+		// reads from the page cache complete straight away, so the other read's completion should be waiting to be
+		// read by now, but a read queued now should still be submitted by the next wait, rather than being held back
+		// until there are no completions left
+		allOK = allOK && reader.queueRead(fileDescriptor, buffers[2], 64, 128, 2);
+		allOK = allOK && reader.waitForCompletion(userData, result) && result == 64;
+		if (allOK && reader.getUnsubmittedCount() != 0)
+		{
+			fprintf(stderr, "FAIL: io_uring read wasn't submitted while there was a completion waiting\n");
+			allOK = false;
+		}
+
+		allOK = allOK && reader.waitForCompletion(userData, result) && result == 64;
+
+		allOK = allOK && memcmp(buffers, data, sizeof(data)) == 0;
+
+		close(fileDescriptor);
+
+		return CHECK_RETURN_TRUE("test io_uring reader", allOK);
+	}
 	
 	
 	
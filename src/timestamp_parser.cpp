@@ -0,0 +1,584 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "timestamp_parser.h"
+
+#include <cstring>
+
+// the most digits accepted for epoch times (milliseconds now are 13 digits)
+static const unsigned int kMaxEpochDigits = 15;
+
+static inline bool parseTwoDigits(const char* pos, unsigned int& value)
+{
+	const unsigned int digit0 = (unsigned char)pos[0] - '0';
+	const unsigned int digit1 = (unsigned char)pos[1] - '0';
+	if (digit0 > 9 || digit1 > 9)
+		return false;
+
+	value = digit0 * 10 + digit1;
+	return true;
+}
+
+// sets invalid if they're not both digits
+static inline unsigned int parseTwoDigitsUnchecked(const char* pos, unsigned int& invalid)
+{
+	const unsigned int digit0 = (unsigned char)pos[0] - '0';
+	const unsigned int digit1 = (unsigned char)pos[1] - '0';
+	invalid |= (digit0 > 9) | (digit1 > 9);
+
+	return digit0 * 10 + digit1;
+}
+
+static inline bool isDigit(char c)
+{
+	return (unsigned int)((unsigned char)c - '0') <= 9;
+}
+
+// Returns the number of days since 1970-01-01 for the date, which is just arithmetic (no branches or tables),
+// and is correct for any (proleptic Gregorian) date - see http://howardhinnant.github.io/date_algorithms.html
+static inline int64_t daysFromCivil(unsigned int year, unsigned int month, unsigned int day)
+{
+	// years are treated as starting in March, so that the leap day is at the end of the year. They're also shifted
+	// on by one 400 year era, so that everything stays unsigned for any 4 digit year.
+	year = year + 400 - (month <= 2);
+	const unsigned int era = year / 400;
+	const unsigned int yearOfEra = year - era * 400;
+	const unsigned int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	const unsigned int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return (int64_t)(era - 1) * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+// returns the month (1 - 12), or 0 if it's not a month name
+static unsigned int parseMonthName(const char* pos)
+{
+	// case insensitive, as some logs have them in upper case
+	const char c0 = pos[0] | 0x20;
+	const char c1 = pos[1] | 0x20;
+	const char c2 = pos[2] | 0x20;
+
+	static const char* kMonthNames = "janfebmaraprmayjunjulaugsepoctnovdec";
+	for (unsigned int i = 0; i < 12; i++)
+	{
+		const char* monthName = kMonthNames + i * 3;
+		if (c0 == monthName[0] && c1 == monthName[1] && c2 == monthName[2])
+			return i + 1;
+	}
+
+	return 0;
+}
+
+TimestampParser::TimestampParser() :
+	m_minLength(0),
+	m_fractionAfterSeconds(true),
+	m_epochTime(false),
+	m_simpleLayout(false)
+{
+
+}
+
+bool TimestampParser::init(const std::string& format, std::string& errorMessage)
+{
+	m_aOps.clear();
+	m_fractionAfterSeconds = format.find("%f") == std::string::npos;
+	m_epochTime = false;
+
+	bool haveCalendarTime = false;
+
+	// '?' chars aren't ops themselves, they're just skipped before the next op
+	unsigned int skipChars = 0;
+
+	for (size_t i = 0; i < format.size(); i++)
+	{
+		const char c = format[i];
+		if (c == '?')
+		{
+			skipChars++;
+			continue;
+		}
+		else if (c != '%')
+		{
+			addOp(Op::eTypeLiteral, skipChars, c);
+			continue;
+		}
+
+		if (i + 1 >= format.size())
+		{
+			errorMessage = "the format ends with a '%'.";
+			return false;
+		}
+
+		const char specifier = format[++i];
+		switch (specifier)
+		{
+			case '%':
+			case '?':
+				addOp(Op::eTypeLiteral, skipChars, specifier);
+				break;
+			case '*':
+				if (i + 1 >= format.size() || format[i + 1] == '%' || format[i + 1] == '?')
+				{
+					errorMessage = "'%*' must be followed by a literal char.";
+					return false;
+				}
+				// the following literal op matches the char itself
+				addOp(Op::eTypeSkipTo, skipChars, format[i + 1]);
+				break;
+			case 't':
+				if (format.compare(i, 3, "ts%") != 0)
+				{
+					errorMessage = "unknown format specifier '%t'.";
+					return false;
+				}
+				i += 2;
+				// any separators are allowed between the values
+				addOp(Op::eTypeYear, skipChars);
+				skipChars = 1;
+				addOp(Op::eTypeMonth, skipChars);
+				skipChars = 1;
+				addOp(Op::eTypeDay, skipChars);
+				skipChars = 1;
+				addOp(Op::eTypeHour, skipChars);
+				skipChars = 1;
+				addOp(Op::eTypeMinute, skipChars);
+				skipChars = 1;
+				addOp(Op::eTypeSecond, skipChars);
+				haveCalendarTime = true;
+				break;
+			case 'Y':
+				addOp(Op::eTypeYear, skipChars);
+				break;
+			case 'm':
+				addOp(Op::eTypeMonth, skipChars);
+				break;
+			case 'b':
+				addOp(Op::eTypeMonthName, skipChars);
+				break;
+			case 'd':
+				addOp(Op::eTypeDay, skipChars);
+				break;
+			case 'e':
+				addOp(Op::eTypeDaySpacePadded, skipChars);
+				break;
+			case 'H':
+				addOp(Op::eTypeHour, skipChars);
+				haveCalendarTime = true;
+				break;
+			case 'M':
+				addOp(Op::eTypeMinute, skipChars);
+				break;
+			case 'S':
+				addOp(Op::eTypeSecond, skipChars);
+				break;
+			case 'f':
+				addOp(Op::eTypeFraction, skipChars);
+				break;
+			case 's':
+				addOp(Op::eTypeEpochSeconds, skipChars);
+				m_epochTime = true;
+				break;
+			case 'Q':
+				addOp(Op::eTypeEpochMilliseconds, skipChars);
+				m_epochTime = true;
+				break;
+			default:
+				errorMessage = std::string("unknown format specifier '%") + specifier + "'.";
+				return false;
+		}
+	}
+
+	if (skipChars > 0)
+	{
+		addOp(Op::eTypeAnyChars, skipChars);
+	}
+
+	if (m_epochTime == haveCalendarTime)
+	{
+		errorMessage = m_epochTime ? "epoch times can't be combined with other date / time fields." :
+									 "the format must contain a time (%H, %s, %Q or %ts%).";
+		return false;
+	}
+
+	combineDateTimeOps();
+
+	// a single date / time, optionally with a literal char either side, can be parsed without going through the ops
+	const size_t dateTimeIndex = (!m_aOps.empty() && m_aOps[0].type == Op::eTypeLiteral) ? 1 : 0;
+	m_simpleLayout = dateTimeIndex < m_aOps.size() && m_aOps[dateTimeIndex].type == Op::eTypeDateTime &&
+					 (dateTimeIndex + 1 == m_aOps.size() ||
+					  (dateTimeIndex + 2 == m_aOps.size() && m_aOps[dateTimeIndex + 1].type == Op::eTypeLiteral));
+
+	// work out the minimum length needed after each op, so that fixed width fields don't need to check the line
+	// length individually - only the variable length ones do, once they know how long they are
+	unsigned int minRemaining = 0;
+	for (size_t i = m_aOps.size(); i > 0; i--)
+	{
+		Op& op = m_aOps[i - 1];
+		op.minRemainingAfter = minRemaining;
+		minRemaining += op.skipChars;
+		switch (op.type)
+		{
+			case Op::eTypeLiteral:
+			case Op::eTypeFraction:
+			case Op::eTypeEpochSeconds:
+			case Op::eTypeEpochMilliseconds:
+				minRemaining += 1;
+				break;
+			case Op::eTypeYear:
+				minRemaining += 4;
+				break;
+			case Op::eTypeDateTime:
+				minRemaining += 19;
+				break;
+			case Op::eTypeMonthName:
+				minRemaining += 3;
+				break;
+			case Op::eTypeAnyChars:
+			case Op::eTypeSkipTo:
+				break;
+			default:
+				minRemaining += 2;
+				break;
+		}
+	}
+
+	m_minLength = minRemaining;
+
+	return true;
+}
+
+void TimestampParser::combineDateTimeOps()
+{
+	static const Op::Type kDateTimeTypes[6] = { Op::eTypeYear, Op::eTypeMonth, Op::eTypeDay, Op::eTypeHour, Op::eTypeMinute,
+												Op::eTypeSecond };
+
+	for (size_t start = 0; start < m_aOps.size(); start++)
+	{
+		if (m_aOps[start].type != Op::eTypeYear)
+			continue;
+
+		// each value after the year needs to be after either one '?' char, or a single literal char
+		Op combinedOp(Op::eTypeDateTime, m_aOps[start].skipChars, 0);
+		size_t i = start + 1;
+		unsigned int value = 1;
+		for (; value < 6 && i < m_aOps.size(); value++)
+		{
+			const Op& op = m_aOps[i];
+			if (op.type == Op::eTypeLiteral && op.skipChars == 0 && i + 1 < m_aOps.size() &&
+				m_aOps[i + 1].type == kDateTimeTypes[value] && m_aOps[i + 1].skipChars == 0)
+			{
+				combinedOp.separators[value - 1] = op.c;
+				combinedOp.c = 1; // so we know there are separators to check
+				i += 2;
+			}
+			else if (op.type == kDateTimeTypes[value] && op.skipChars == 1)
+			{
+				i += 1;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (value == 6)
+		{
+			m_aOps.erase(m_aOps.begin() + start + 1, m_aOps.begin() + i);
+			m_aOps[start] = combinedOp;
+		}
+	}
+}
+
+bool TimestampParser::parse(const char* lineStart, const char* lineEnd, int64_t& time) const
+{
+	if ((size_t)(lineEnd - lineStart) < m_minLength)
+		return false;
+
+	DateTime dateTime;
+	if (m_simpleLayout ? !parseSimpleLayout(lineStart, lineEnd, dateTime) : !parseOps(lineStart, lineEnd, dateTime))
+		return false;
+
+	if (m_epochTime)
+	{
+		time = dateTime.epoch;
+		return true;
+	}
+
+	const int64_t days = daysFromCivil(dateTime.year, dateTime.month, dateTime.day);
+	const int64_t seconds = days * 86400 + dateTime.hour * 3600 + dateTime.minute * 60 + dateTime.second;
+	time = seconds * 1000000 + dateTime.microsecond;
+	return true;
+}
+
+bool TimestampParser::parseTimeString(const std::string& timeString, int64_t& time) const
+{
+	if (parse(timeString.c_str(), timeString.c_str() + timeString.size(), time))
+		return true;
+
+	// otherwise fill in any missing time parts, so it can be parsed as a full date / time
+	std::string fullTimeString = timeString;
+	if (fullTimeString.size() == 10)
+	{
+		fullTimeString += " 00:00:00";
+	}
+	else if (fullTimeString.size() == 16)
+	{
+		fullTimeString += ":00";
+	}
+
+	TimestampParser dateTimeParser;
+	std::string errorMessage;
+	dateTimeParser.init("%ts%", errorMessage);
+	if (!dateTimeParser.parse(fullTimeString.c_str(), fullTimeString.c_str() + fullTimeString.size(), time))
+		return false;
+
+	// make sure there isn't anything else after it, other than fractional seconds
+	for (size_t i = 19; i < fullTimeString.size(); i++)
+	{
+		char c = fullTimeString[i];
+		if (!isDigit(c) && !(i == 19 && (c == '.' || c == ',')))
+			return false;
+	}
+
+	return true;
+}
+
+bool TimestampParser::parseSimpleLayout(const char* lineStart, const char* lineEnd, DateTime& dateTime) const
+{
+	// this is the same as what parseOps() would do for these ops, but without the loop and switch, as most
+	// formats are like this (including the default one), and the parsing is a noticeable part of the time
+	const char* pos = lineStart;
+
+	const Op* pOp = m_aOps.data();
+	if (pOp->type == Op::eTypeLiteral)
+	{
+		pos += pOp->skipChars;
+		if (*pos != pOp->c)
+			return false;
+		pos++;
+		pOp++;
+	}
+
+	pos += pOp->skipChars;
+	if (!parseDateTime(pos, *pOp, dateTime))
+		return false;
+
+	pos += 19;
+	if (m_fractionAfterSeconds)
+	{
+		pos = parseOptionalFraction(pos, lineEnd, dateTime.microsecond);
+		if ((size_t)(lineEnd - pos) < pOp->minRemainingAfter)
+			return false;
+	}
+
+	if (++pOp != m_aOps.data() + m_aOps.size())
+	{
+		pos += pOp->skipChars;
+		if (*pos != pOp->c)
+			return false;
+	}
+
+	return true;
+}
+
+bool TimestampParser::parseOps(const char* lineStart, const char* lineEnd, DateTime& dateTime) const
+{
+	const char* pos = lineStart;
+
+	for (const Op& op : m_aOps)
+	{
+		pos += op.skipChars;
+
+		switch (op.type)
+		{
+			case Op::eTypeLiteral:
+				if (*pos != op.c)
+					return false;
+				pos++;
+				break;
+			case Op::eTypeAnyChars:
+				break;
+			case Op::eTypeSkipTo:
+				pos = (const char*)memchr(pos, op.c, lineEnd - pos);
+				if (pos == nullptr || (size_t)(lineEnd - pos) < op.minRemainingAfter)
+					return false;
+				break;
+			case Op::eTypeYear:
+			{
+				unsigned int century;
+				if (!parseTwoDigits(pos, century) || !parseTwoDigits(pos + 2, dateTime.year))
+					return false;
+				dateTime.year += century * 100;
+				pos += 4;
+				break;
+			}
+			case Op::eTypeMonth:
+				if (!parseTwoDigits(pos, dateTime.month) || dateTime.month < 1 || dateTime.month > 12)
+					return false;
+				pos += 2;
+				break;
+			case Op::eTypeMonthName:
+				dateTime.month = parseMonthName(pos);
+				if (dateTime.month == 0)
+					return false;
+				pos += 3;
+				break;
+			case Op::eTypeDaySpacePadded:
+				if (pos[0] == ' ')
+				{
+					if (!isDigit(pos[1]))
+						return false;
+					dateTime.day = pos[1] - '0';
+					pos += 2;
+					break;
+				}
+				// otherwise it's the same as %d
+				// fall through
+			case Op::eTypeDay:
+				if (!parseTwoDigits(pos, dateTime.day) || dateTime.day < 1 || dateTime.day > 31)
+					return false;
+				pos += 2;
+				break;
+			case Op::eTypeHour:
+				if (!parseTwoDigits(pos, dateTime.hour) || dateTime.hour > 23)
+					return false;
+				pos += 2;
+				break;
+			case Op::eTypeMinute:
+				if (!parseTwoDigits(pos, dateTime.minute) || dateTime.minute > 59)
+					return false;
+				pos += 2;
+				break;
+			case Op::eTypeSecond:
+				// 60 for leap seconds
+				if (!parseTwoDigits(pos, dateTime.second) || dateTime.second > 60)
+					return false;
+				pos += 2;
+				if (m_fractionAfterSeconds)
+				{
+					pos = parseOptionalFraction(pos, lineEnd, dateTime.microsecond);
+					if ((size_t)(lineEnd - pos) < op.minRemainingAfter)
+						return false;
+				}
+				break;
+			case Op::eTypeFraction:
+			{
+				const char* fractionStart = pos;
+				pos = parseFractionDigits(pos, lineEnd, dateTime.microsecond);
+				if (pos == fractionStart || (size_t)(lineEnd - pos) < op.minRemainingAfter)
+					return false;
+				break;
+			}
+			case Op::eTypeDateTime:
+				if (!parseDateTime(pos, op, dateTime))
+					return false;
+
+				pos += 19;
+				if (m_fractionAfterSeconds)
+				{
+					pos = parseOptionalFraction(pos, lineEnd, dateTime.microsecond);
+					if ((size_t)(lineEnd - pos) < op.minRemainingAfter)
+						return false;
+				}
+				break;
+			case Op::eTypeEpochSeconds:
+			case Op::eTypeEpochMilliseconds:
+			{
+				const char* digitsStart = pos;
+				while (pos < lineEnd && isDigit(*pos) && pos - digitsStart < kMaxEpochDigits)
+				{
+					dateTime.epoch = dateTime.epoch * 10 + (*pos - '0');
+					pos++;
+				}
+				if (pos == digitsStart)
+					return false;
+
+				if (op.type == Op::eTypeEpochMilliseconds)
+				{
+					dateTime.epoch *= 1000;
+				}
+				else
+				{
+					unsigned int microsecond = 0;
+					if (m_fractionAfterSeconds)
+					{
+						pos = parseOptionalFraction(pos, lineEnd, microsecond);
+					}
+					// (done unsigned, as absurdly large values can overflow)
+					dateTime.epoch = (int64_t)((uint64_t)dateTime.epoch * 1000000 + microsecond);
+				}
+
+				if ((size_t)(lineEnd - pos) < op.minRemainingAfter)
+					return false;
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool TimestampParser::parseDateTime(const char* pos, const Op& op, DateTime& dateTime)
+{
+	// all the values are checked at once at the end, so there's only one branch for them
+	unsigned int invalid = 0;
+	dateTime.year = parseTwoDigitsUnchecked(pos, invalid) * 100 + parseTwoDigitsUnchecked(pos + 2, invalid);
+	dateTime.month = parseTwoDigitsUnchecked(pos + 5, invalid);
+	dateTime.day = parseTwoDigitsUnchecked(pos + 8, invalid);
+	dateTime.hour = parseTwoDigitsUnchecked(pos + 11, invalid);
+	dateTime.minute = parseTwoDigitsUnchecked(pos + 14, invalid);
+	dateTime.second = parseTwoDigitsUnchecked(pos + 17, invalid);
+
+	if (op.c != 0)
+	{
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			invalid |= op.separators[i] != 0 && pos[4 + i * 3] != op.separators[i];
+		}
+	}
+
+	invalid |= (dateTime.month - 1) > 11 || (dateTime.day - 1) > 30 || dateTime.hour > 23 || dateTime.minute > 59 ||
+				dateTime.second > 60;
+
+	return invalid == 0;
+}
+
+const char* TimestampParser::parseFractionDigits(const char* pos, const char* lineEnd, unsigned int& microsecond)
+{
+	// only down to microseconds is kept, with any further digits skipped
+	static const unsigned int kDigitScales[6] = { 100000, 10000, 1000, 100, 10, 1 };
+
+	microsecond = 0;
+	for (unsigned int i = 0; pos < lineEnd && isDigit(*pos); i++, pos++)
+	{
+		if (i < 6)
+		{
+			microsecond += (*pos - '0') * kDigitScales[i];
+		}
+	}
+
+	return pos;
+}
+
+const char* TimestampParser::parseOptionalFraction(const char* pos, const char* lineEnd, unsigned int& microsecond)
+{
+	if (pos + 1 < lineEnd && (*pos == '.' || *pos == ',') && isDigit(pos[1]))
+	{
+		pos = parseFractionDigits(pos + 1, lineEnd, microsecond);
+	}
+
+	return pos;
+}
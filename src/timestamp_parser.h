@@ -0,0 +1,151 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef TIMESTAMP_PARSER_H
+#define TIMESTAMP_PARSER_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <stdint.h>
+
+// Parser for log line timestamps, which is compiled once from the logTimestampFormat string into a list of
+// fixed operations, so that parsing each line is just running through them (with no per-line format string
+// interpretation, or any strptime() / mktime() calls, which are far too slow to do for every line).
+//
+// Format syntax:
+//   %Y		4 digit year
+//   %m		2 digit month
+//   %b		3 letter month name (Jan, Feb, ...)
+//   %d		2 digit day
+//   %e		2 char day, which can be space padded (as in syslog)
+//   %H		2 digit hour (24 hour)
+//   %M		2 digit minute
+//   %S		2 digit second, followed by optional fractional seconds (e.g. ".123" or ",123") if there's no %f
+//   %f		fractional seconds digits (only down to microseconds is used)
+//   %s		seconds since the epoch (followed by optional fractional seconds, as with %S)
+//   %Q		milliseconds since the epoch
+//   %*		skips any chars up to the next char in the format, which must be a literal char
+//   %ts%	the original format, equivalent to "%Y?%m?%d?%H?%M?%S"
+//   ?		any single char
+//   %%, %?	literal '%' and '?'
+// All other chars must match exactly.
+
+class TimestampParser
+{
+public:
+	TimestampParser();
+
+	// returns false if the format isn't valid, with errorMessage set
+	bool init(const std::string& format, std::string& errorMessage);
+
+	// lineEnd is the end of the line, not including the '\n'. Returns false if the line doesn't start with a timestamp
+	// in the format, otherwise time is set to the number of microseconds since the epoch (for formats without a
+	// time zone, that's as if the times are UTC).
+	bool parse(const char* lineStart, const char* lineEnd, int64_t& time) const;
+
+	// for times given on the command line (e.g. time windows) - the whole string has to either be a timestamp in the
+	// format, or "YYYY-MM-DD[ HH:MM[:SS]]" (with any separator chars, and optional fractional seconds).
+	bool parseTimeString(const std::string& timeString, int64_t& time) const;
+
+protected:
+	struct Op
+	{
+		enum Type
+		{
+			eTypeLiteral,
+			eTypeAnyChars,	// just for any '?' chars at the end of the format
+			eTypeSkipTo,
+			eTypeYear,
+			eTypeMonth,
+			eTypeMonthName,
+			eTypeDay,
+			eTypeDaySpacePadded,
+			eTypeHour,
+			eTypeMinute,
+			eTypeSecond,
+			eTypeFraction,
+			eTypeEpochSeconds,
+			eTypeEpochMilliseconds,
+			eTypeDateTime	// "%Y-%m-%d %H:%M:%S" (with any single char separators) combined into one op
+		};
+
+		Op(Type opType, unsigned int opSkipChars, char opChar) : type(opType), skipChars(opSkipChars), c(opChar),
+			minRemainingAfter(0)
+		{
+			memset(separators, 0, sizeof(separators));
+		}
+
+		Type			type;
+		unsigned int	skipChars;			// the number of chars to skip (for '?' chars) before the op
+		char			c;					// for literals and skipping (and set for eTypeDateTime if there are separators)
+		unsigned int	minRemainingAfter;	// the minimum number of chars the following ops need
+		char			separators[5];		// for eTypeDateTime, the separator between each value, or 0 for any char
+	};
+
+	// resets skipChars, as they've been used up by the op
+	void addOp(Op::Type type, unsigned int& skipChars, char c = 0)
+	{
+		m_aOps.emplace_back(Op(type, skipChars, c));
+		skipChars = 0;
+	}
+
+	struct DateTime
+	{
+		DateTime() : year(kDefaultYear), month(1), day(1), hour(0), minute(0), second(0), microsecond(0), epoch(0)
+		{
+		}
+
+		// for formats without a year (like syslog), which is a leap year so that 29th Feb is valid
+		static const unsigned int kDefaultYear = 2000;
+
+		unsigned int	year;
+		unsigned int	month;
+		unsigned int	day;
+		unsigned int	hour;
+		unsigned int	minute;
+		unsigned int	second;
+		unsigned int	microsecond;
+		int64_t			epoch;		// in microseconds
+	};
+
+	bool parseSimpleLayout(const char* lineStart, const char* lineEnd, DateTime& dateTime) const;
+	bool parseOps(const char* lineStart, const char* lineEnd, DateTime& dateTime) const;
+	// for eTypeDateTime ops
+	static bool parseDateTime(const char* pos, const Op& op, DateTime& dateTime);
+
+	// combines the ops for the usual date / time layout into a single eTypeDateTime op, which can be parsed in one
+	// go with the values at fixed offsets
+	void combineDateTimeOps();
+
+	// returns the position after the digits
+	static const char* parseFractionDigits(const char* pos, const char* lineEnd, unsigned int& microsecond);
+	// for %S and %s - parses any fractional seconds after the value (with the '.' or ',' before them)
+	static const char* parseOptionalFraction(const char* pos, const char* lineEnd, unsigned int& microsecond);
+
+protected:
+	std::vector<Op>			m_aOps;
+	unsigned int			m_minLength;
+	bool					m_fractionAfterSeconds;	// whether %S and %s can be followed by fractional seconds
+	bool					m_epochTime;
+	// whether the format's just a date / time with an optional literal char either side
+	bool					m_simpleLayout;
+};
+
+#endif // TIMESTAMP_PARSER_H
@@ -0,0 +1,797 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "block_reader.h"
+
+#include <cstdio>
+#include <cerrno>
+
+#include <algorithm>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "file_helpers.h"
+#include "io_uring_reader.h"
+
+// the readers with a mapping open on each thread (a SIGBUS is delivered to the thread which faulted)
+static thread_local BlockReader* s_pFirstMappedReader = nullptr;
+
+static std::once_flag s_busErrorHandlerInstalled;
+static struct sigaction s_previousBusErrorAction;
+static uintptr_t s_pageSize = 0; // as sysconf() can't be called in the handler
+
+BlockReader::BlockReader() :
+	m_fileDescriptor(-1),
+	m_pBuffer(nullptr),
+	m_pOwnBuffer(nullptr),
+	m_bufferSize(0),
+	m_pBlock(nullptr),
+	m_dataLength(0),
+	m_blockStart(0),
+	m_blockLength(0),
+	m_blockFileOffset(0),
+	m_remainingLength(0),
+	m_dataStart(0),
+	m_reversePosition(0),
+	m_reverseRangeStart(0),
+	m_endOfFile(false),
+	m_allowMemoryMapping(false),
+	m_pMapping(nullptr),
+	m_mappingLength(0),
+	m_pMappedData(nullptr),
+	m_mappedDataLength(0),
+	m_mappedPosition(0),
+	m_pNextMappedReader(nullptr),
+	m_mappingTruncated(false),
+	m_pIoUring(nullptr),
+	m_asyncReading(false),
+	m_asyncNextSlot(0),
+	m_asyncCurrentSlot(0),
+	m_asyncReadsInFlight(0),
+	m_asyncNextReadOffset(0),
+	m_asyncRangeEnd(0),
+	m_asyncFileSize(0),
+	m_prefetchedFileDescriptor(-1),
+	m_knownFileSize(UINT64_MAX),
+	m_readOffset(0),
+	m_expectedFileSize(UINT64_MAX)
+{
+
+}
+
+BlockReader::~BlockReader()
+{
+	closeFile();
+	clearFileDetails();
+
+	if (m_pOwnBuffer)
+	{
+		delete [] m_pOwnBuffer;
+		m_pOwnBuffer = nullptr;
+	}
+	m_pBuffer = nullptr;
+
+	for (AsyncReadSlot& slot : m_aAsyncReadSlots)
+	{
+		delete [] slot.pBuffer;
+	}
+	m_aAsyncReadSlots.clear();
+
+	if (m_pIoUring)
+	{
+		delete m_pIoUring;
+		m_pIoUring = nullptr;
+	}
+}
+
+void BlockReader::init(size_t blockSize)
+{
+	if (m_pOwnBuffer)
+	{
+		delete [] m_pOwnBuffer;
+		m_pOwnBuffer = nullptr;
+	}
+
+	// our own buffer's only allocated if it's needed, as the buffer can be provided instead
+	m_bufferSize = blockSize;
+	m_pBuffer = nullptr;
+	m_pBlock = nullptr;
+}
+
+void BlockReader::setBuffer(char* pBuffer)
+{
+	closeFile();
+
+	m_pBuffer = pBuffer ? pBuffer : m_pOwnBuffer;
+	m_pBlock = m_pBuffer;
+}
+
+bool BlockReader::enableIoUring(unsigned int queueDepth)
+{
+	// we need at least two slots, as the incomplete line at the end of one block is copied from its slot to the next
+	queueDepth = std::max(queueDepth, 2u);
+
+	IoUringReader* pIoUring = new IoUringReader();
+	if (!pIoUring->init(queueDepth))
+	{
+		delete pIoUring;
+		return false;
+	}
+
+	m_pIoUring = pIoUring;
+
+	m_aAsyncReadSlots.resize(queueDepth);
+	for (AsyncReadSlot& slot : m_aAsyncReadSlots)
+	{
+		slot.pBuffer = new char[m_bufferSize * 2];
+	}
+
+	return true;
+}
+
+void BlockReader::setFileDetails(const std::string& filename, int fileDescriptor, uint64_t fileSize)
+{
+	clearFileDetails();
+
+	m_detailsFilename = filename;
+	m_prefetchedFileDescriptor = fileDescriptor;
+	m_knownFileSize = fileSize;
+}
+
+void BlockReader::clearFileDetails()
+{
+	if (m_prefetchedFileDescriptor != -1)
+	{
+		close(m_prefetchedFileDescriptor);
+		m_prefetchedFileDescriptor = -1;
+	}
+
+	m_detailsFilename.clear();
+	m_knownFileSize = UINT64_MAX;
+}
+
+bool BlockReader::openFile(const std::string& filename)
+{
+	closeFile();
+
+	if (m_prefetchedFileDescriptor != -1 && filename == m_detailsFilename)
+	{
+		// it's already been opened for us, so we don't need to wait for another open (which over NFS is a round trip)
+		m_fileDescriptor = m_prefetchedFileDescriptor;
+		m_prefetchedFileDescriptor = -1;
+	}
+	else
+	{
+		m_fileDescriptor = open(filename.c_str(), O_RDONLY);
+	}
+
+	if (m_fileDescriptor == -1)
+	{
+		// for the moment, we don't want to report any errors for files we can't access (invalid permissions, etc)
+		return false;
+	}
+
+	if (!m_pBuffer)
+	{
+		if (!m_pOwnBuffer)
+		{
+			m_pOwnBuffer = new char[m_bufferSize];
+		}
+		m_pBuffer = m_pOwnBuffer;
+	}
+
+	m_pBlock = m_pBuffer;
+	m_dataLength = 0;
+	m_blockStart = 0;
+	m_blockLength = 0;
+	m_blockFileOffset = 0;
+	m_remainingLength = UINT64_MAX;
+	m_endOfFile = false;
+
+	return true;
+}
+
+bool BlockReader::openFileRange(const std::string& filename, uint64_t rangeStart, uint64_t rangeLength)
+{
+	if (!openFile(filename))
+		return false;
+
+	m_blockFileOffset = rangeStart;
+
+	// the size the file was when it was found, if we know it
+	m_expectedFileSize = (filename == m_detailsFilename) ? m_knownFileSize : UINT64_MAX;
+
+	// files which we already know fit in the buffer are just read in one go, without needing to stat() them first, as
+	// they're not worth mapping or reading asynchronously. Anything else needs its size (and what it's on) to work out
+	// how best to read it.
+	if (m_expectedFileSize > m_bufferSize)
+	{
+		struct stat statState;
+		if (fstat(m_fileDescriptor, &statState) == 0 && S_ISREG(statState.st_mode))
+		{
+			m_expectedFileSize = statState.st_size;
+
+			if (m_allowMemoryMapping && mapFileRange(filename, statState.st_size, statState.st_dev, rangeStart, rangeLength))
+				return true;
+
+			if (m_pIoUring)
+			{
+				startAsyncReads(statState.st_size, rangeStart, rangeLength);
+				return true;
+			}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+			// it's going to take several reads, so let the kernel know it can read further ahead
+			if (std::min(rangeLength, m_expectedFileSize - std::min(rangeStart, m_expectedFileSize)) > m_bufferSize)
+			{
+				posix_fadvise(m_fileDescriptor, rangeStart, 0, POSIX_FADV_SEQUENTIAL);
+			}
+#endif
+		}
+		else
+		{
+			m_expectedFileSize = UINT64_MAX;
+		}
+	}
+
+	if (rangeStart > 0 && lseek(m_fileDescriptor, rangeStart, SEEK_SET) == (off_t)-1)
+	{
+		closeFile();
+		return false;
+	}
+
+	m_remainingLength = rangeLength;
+	m_readOffset = rangeStart;
+
+	return true;
+}
+
+bool BlockReader::openFileRangeReverse(const std::string& filename, uint64_t rangeStart, uint64_t rangeLength)
+{
+	if (!openFile(filename))
+		return false;
+
+	struct stat statState;
+	if (fstat(m_fileDescriptor, &statState) != 0)
+	{
+		closeFile();
+		return false;
+	}
+
+	uint64_t fileSize = statState.st_size;
+
+	m_reverseRangeStart = std::min(rangeStart, fileSize);
+	m_reversePosition = (rangeLength == UINT64_MAX) ? fileSize : std::min(rangeStart + rangeLength, fileSize);
+
+	// there's nothing in the buffer yet
+	m_dataStart = m_bufferSize;
+	m_blockStart = m_bufferSize;
+
+	return true;
+}
+
+void BlockReader::closeFile()
+{
+	unmapFile();
+	finishAsyncReads();
+
+	if (m_fileDescriptor != -1)
+	{
+		close(m_fileDescriptor);
+		m_fileDescriptor = -1;
+	}
+}
+
+bool BlockReader::readNextBlock()
+{
+	if (m_fileDescriptor == -1)
+		return false;
+
+	if (m_pMappedData)
+		return readNextMappedBlock();
+
+	if (m_asyncReading)
+		return readNextAsyncBlock();
+
+	m_blockFileOffset += m_blockLength;
+
+	// move any incomplete line left over from the last block to the start of the buffer
+	size_t carryOverLength = m_dataLength - m_blockLength;
+	if (carryOverLength > 0 && m_blockLength > 0)
+	{
+		memmove(m_pBuffer, m_pBuffer + m_blockLength, carryOverLength);
+	}
+
+	m_dataLength = carryOverLength;
+	m_blockLength = 0;
+
+	// fill up the rest of the buffer - read() can return less than we asked for (especially over NFS),
+	// so keep going until it's full or we hit the end of the file
+	while (!m_endOfFile && m_dataLength < m_bufferSize)
+	{
+		size_t readLength = std::min((uint64_t)(m_bufferSize - m_dataLength), m_remainingLength);
+		ssize_t readAmount = readLength > 0 ? read(m_fileDescriptor, m_pBuffer + m_dataLength, readLength) : 0;
+		if (readAmount <= 0)
+		{
+			// either the end of the file (or range), or an error, which we treat the same way for the moment...
+			m_endOfFile = true;
+			break;
+		}
+
+		m_dataLength += readAmount;
+		m_remainingLength -= readAmount;
+		m_readOffset += readAmount;
+
+		// if we got less than we asked for and we've read as much as the file had in it, there's no point in another
+		// read() just to find out that's the end (which for small files would be half the reads)
+		if ((size_t)readAmount < readLength && m_readOffset >= m_expectedFileSize)
+		{
+			m_endOfFile = true;
+			break;
+		}
+	}
+
+	if (m_dataLength == 0)
+		return false;
+
+	if (m_endOfFile)
+	{
+		// everything left is complete lines, including a possible final line without a newline
+		m_blockLength = m_dataLength;
+		return true;
+	}
+
+	const char* lastLineStart = findLineStart(m_pBuffer, m_pBuffer + m_dataLength);
+	if (lastLineStart == m_pBuffer)
+	{
+		// the line is longer than our whole buffer, so we have no choice but to split it
+		m_blockLength = m_dataLength;
+	}
+	else
+	{
+		m_blockLength = lastLineStart - m_pBuffer;
+	}
+
+	return true;
+}
+
+bool BlockReader::readPreviousBlock()
+{
+	if (m_fileDescriptor == -1)
+		return false;
+
+	// move any incomplete line left over from the start of the last block to the end of the buffer, and read the
+	// content before it in front of it
+	size_t carryOverLength = m_blockStart - m_dataStart;
+	if (carryOverLength > 0)
+	{
+		memmove(m_pBuffer + m_bufferSize - carryOverLength, m_pBuffer + m_dataStart, carryOverLength);
+	}
+
+	size_t readLength = std::min((uint64_t)(m_bufferSize - carryOverLength), m_reversePosition - m_reverseRangeStart);
+	m_reversePosition -= readLength;
+	m_dataStart = m_bufferSize - carryOverLength - readLength;
+
+	size_t readSoFar = 0;
+	while (readSoFar < readLength)
+	{
+		ssize_t readAmount = pread(m_fileDescriptor, m_pBuffer + m_dataStart + readSoFar, readLength - readSoFar,
+								   m_reversePosition + readSoFar);
+		if (readAmount <= 0)
+		{
+			// the file's been truncated, or there was an error, neither of which we can do much about
+			closeFile();
+			return false;
+		}
+
+		readSoFar += readAmount;
+	}
+
+	if (m_dataStart == m_bufferSize)
+		return false;
+
+	m_blockStart = m_dataStart;
+
+	if (m_reversePosition > m_reverseRangeStart)
+	{
+		// the first line might have started before what we've read, so the block starts after the first new line
+		// (other than one right at the end, as we need something in the block). If there isn't one, the line's longer
+		// than our whole buffer (which is full in this case), so we have no choice but to split it.
+		const char* newLine = (const char*)memchr(m_pBuffer + m_dataStart, '\n', m_bufferSize - m_dataStart - 1);
+		if (newLine)
+		{
+			m_blockStart = newLine + 1 - m_pBuffer;
+		}
+	}
+
+	m_pBlock = m_pBuffer + m_blockStart;
+	m_blockLength = m_bufferSize - m_blockStart;
+	m_blockFileOffset = m_reversePosition + (m_blockStart - m_dataStart);
+
+	return true;
+}
+
+bool BlockReader::mapFileRange(const std::string& filename, uint64_t fileSize, uint64_t device, uint64_t rangeStart,
+							   uint64_t rangeLength)
+{
+	// like reading, this only goes up to the end of the file as it is now
+	const uint64_t rangeEnd = (rangeLength == UINT64_MAX) ? fileSize : std::min(rangeStart + rangeLength, fileSize);
+
+	// for anything which fits in a single block, one read() is cheaper than setting up (and tearing down) a mapping
+	if (rangeStart >= rangeEnd || rangeEnd - rangeStart <= m_bufferSize)
+		return false;
+
+	if (!canMemoryMapOnDevice(filename, device))
+		return false;
+
+	static const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+	const uint64_t mappingStart = rangeStart - (rangeStart % pageSize);
+	const size_t mappingLength = rangeEnd - mappingStart;
+
+	void* pMapping = mmap(nullptr, mappingLength, PROT_READ, MAP_SHARED, m_fileDescriptor, mappingStart);
+	if (pMapping == MAP_FAILED)
+		return false;
+
+	// these are just hints, so it doesn't matter if they fail (MADV_HUGEPAGE only works for file mappings on some
+	// file systems and kernels, but cuts down on page faults where it does)
+	madvise(pMapping, mappingLength, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(pMapping, mappingLength, MADV_HUGEPAGE);
+#endif
+
+	std::call_once(s_busErrorHandlerInstalled, installBusErrorHandler);
+
+	m_pMapping = pMapping;
+	m_mappingLength = mappingLength;
+	m_pMappedData = (const char*)pMapping + (rangeStart - mappingStart);
+	m_mappedDataLength = rangeEnd - rangeStart;
+	m_mappedPosition = 0;
+
+	m_mappingTruncated = false;
+	m_pNextMappedReader = s_pFirstMappedReader;
+	s_pFirstMappedReader = this;
+
+	return true;
+}
+
+void BlockReader::unmapFile()
+{
+	if (m_pMapping)
+	{
+		BlockReader** ppReader = &s_pFirstMappedReader;
+		while (*ppReader && *ppReader != this)
+		{
+			ppReader = &(*ppReader)->m_pNextMappedReader;
+		}
+		if (*ppReader)
+		{
+			*ppReader = m_pNextMappedReader;
+		}
+		m_pNextMappedReader = nullptr;
+
+		munmap(m_pMapping, m_mappingLength);
+		m_pMapping = nullptr;
+		m_mappingLength = 0;
+		m_pMappedData = nullptr;
+		m_mappedDataLength = 0;
+	}
+}
+
+bool BlockReader::readNextMappedBlock()
+{
+	m_blockFileOffset += m_blockLength;
+	m_mappedPosition += m_blockLength;
+	m_blockLength = 0;
+
+	const size_t remainingLength = m_mappedDataLength - m_mappedPosition;
+	if (remainingLength == 0 || m_mappingTruncated)
+		return false;
+
+	// the blocks are split in exactly the same places as they would be when reading into the buffer
+	m_pBlock = m_pMappedData + m_mappedPosition;
+
+	if (remainingLength <= m_bufferSize)
+	{
+		m_blockLength = remainingLength;
+		return true;
+	}
+
+	const char* lastLineStart = findLineStart(m_pBlock, m_pBlock + m_bufferSize);
+	if (lastLineStart == m_pBlock)
+	{
+		// the line is longer than a whole block, so we have to split it
+		m_blockLength = m_bufferSize;
+	}
+	else
+	{
+		m_blockLength = lastLineStart - m_pBlock;
+	}
+
+	return true;
+}
+
+void BlockReader::installBusErrorHandler()
+{
+	s_pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = handleBusError;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+
+	sigaction(SIGBUS, &action, &s_previousBusErrorAction);
+}
+
+void BlockReader::handleBusError(int signalNumber, siginfo_t* pInfo, void* pContext)
+{
+	const uintptr_t faultAddress = (uintptr_t)pInfo->si_addr;
+
+	for (BlockReader* pReader = s_pFirstMappedReader; pReader != nullptr; pReader = pReader->m_pNextMappedReader)
+	{
+		const uintptr_t mappingStart = (uintptr_t)pReader->m_pMapping;
+		const uintptr_t mappingEnd = mappingStart + pReader->m_mappingLength;
+		if (faultAddress < mappingStart || faultAddress >= mappingEnd)
+			continue;
+
+		// the file's been truncated since it was mapped, so swap the rest of the mapping (from the page which faulted)
+		// for zeros, so that whatever was scanning it can carry on to the end of the block, after which
+		// readNextMappedBlock() stops. mmap() is just a syscall, so it's fine to call here.
+		const uintptr_t pageStart = faultAddress - (faultAddress - mappingStart) % s_pageSize;
+		mmap((void*)pageStart, mappingEnd - pageStart, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+
+		pReader->m_mappingTruncated = true;
+		return;
+	}
+
+	// it's not from one of our mappings, so do whatever would have happened without this handler
+	if (s_previousBusErrorAction.sa_flags & SA_SIGINFO)
+	{
+		s_previousBusErrorAction.sa_sigaction(signalNumber, pInfo, pContext);
+	}
+	else if (s_previousBusErrorAction.sa_handler != SIG_DFL && s_previousBusErrorAction.sa_handler != SIG_IGN)
+	{
+		s_previousBusErrorAction.sa_handler(signalNumber);
+	}
+	else
+	{
+		// returning with the default action set means the fault happens again, which then terminates as normal
+		signal(SIGBUS, SIG_DFL);
+	}
+}
+
+bool BlockReader::canMemoryMapOnDevice(const std::string& filename, uint64_t device)
+{
+	std::map<uint64_t, bool>::const_iterator itDevice = m_deviceCanMemoryMap.find(device);
+	if (itDevice != m_deviceCanMemoryMap.end())
+		return itDevice->second;
+
+	bool canMemoryMap = !FileHelpers::isNetworkFileSystem(filename);
+	m_deviceCanMemoryMap[device] = canMemoryMap;
+
+	return canMemoryMap;
+}
+
+void BlockReader::startAsyncReads(uint64_t fileSize, uint64_t rangeStart, uint64_t rangeLength)
+{
+	m_asyncReading = true;
+	m_asyncNextSlot = 0;
+	m_asyncCurrentSlot = m_aAsyncReadSlots.size(); // there isn't a current block yet
+	m_asyncNextReadOffset = rangeStart;
+	m_asyncRangeEnd = (rangeLength == UINT64_MAX) ? UINT64_MAX : rangeStart + rangeLength;
+	m_asyncFileSize = fileSize;
+
+	m_pBlock = m_aAsyncReadSlots[0].pBuffer + m_bufferSize;
+
+	// fill up the queue (up to the end of the file)
+	for (size_t i = 0; i < m_aAsyncReadSlots.size(); i++)
+	{
+		if (!queueAsyncRead(i, false))
+			break;
+	}
+
+	// start them now, rather than when we first wait, so they're in flight while anything else is being done
+	m_pIoUring->submitQueued();
+}
+
+bool BlockReader::queueAsyncRead(size_t slotIndex, bool force)
+{
+	// past the size the file was when it was opened, there's probably nothing to read (unless it's still being written),
+	// so we only check once everything before it has been read
+	if (m_asyncNextReadOffset >= m_asyncRangeEnd || (!force && m_asyncNextReadOffset >= m_asyncFileSize))
+		return false;
+
+	AsyncReadSlot& slot = m_aAsyncReadSlots[slotIndex];
+	slot.offset = m_asyncNextReadOffset;
+	slot.requestedLength = (size_t)std::min((uint64_t)m_bufferSize, m_asyncRangeEnd - m_asyncNextReadOffset);
+	slot.result = 0;
+
+	if (m_pIoUring->queueRead(m_fileDescriptor, slot.pBuffer + m_bufferSize, slot.requestedLength, slot.offset, slotIndex))
+	{
+		slot.state = AsyncReadSlot::eStateInFlight;
+		m_asyncReadsInFlight++;
+	}
+	else
+	{
+		// this shouldn't happen, as the queue's as big as the number of slots, but it'll just be read normally
+		slot.state = AsyncReadSlot::eStateCompleted;
+		slot.result = -EAGAIN;
+	}
+
+	m_asyncNextReadOffset += slot.requestedLength;
+
+	return true;
+}
+
+bool BlockReader::waitForAsyncRead()
+{
+	uint64_t slotIndex = 0;
+	int result = 0;
+	if (!m_pIoUring->waitForCompletion(slotIndex, result))
+		return false;
+
+	AsyncReadSlot& slot = m_aAsyncReadSlots[slotIndex];
+	slot.state = AsyncReadSlot::eStateCompleted;
+	slot.result = result;
+
+	m_asyncReadsInFlight--;
+
+	return true;
+}
+
+void BlockReader::finishAsyncReads()
+{
+	if (!m_asyncReading)
+		return;
+
+	while (m_asyncReadsInFlight > 0)
+	{
+		if (!waitForAsyncRead())
+		{
+			abandonIoUring();
+			return;
+		}
+	}
+
+	for (AsyncReadSlot& slot : m_aAsyncReadSlots)
+	{
+		slot.state = AsyncReadSlot::eStateIdle;
+	}
+
+	m_asyncReading = false;
+}
+
+void BlockReader::abandonIoUring()
+{
+	fprintf(stderr, "Error: waiting for io_uring reads failed, so files will be read normally from now on.\n");
+
+	// the reads still in flight could write to the buffers at any point, so they can't be freed
+	m_aAsyncReadSlots.clear();
+
+	delete m_pIoUring;
+	m_pIoUring = nullptr;
+
+	m_asyncReading = false;
+	m_asyncReadsInFlight = 0;
+	m_dataLength = 0;
+	m_blockLength = 0;
+	m_endOfFile = true;
+}
+
+bool BlockReader::readNextAsyncBlock()
+{
+	if (m_endOfFile)
+		return false;
+
+	m_blockFileOffset += m_blockLength;
+
+	// the incomplete line left over from the last block, which goes in front of the next block's data
+	const char* pCarryOver = m_pBlock + m_blockLength;
+	const size_t carryOverLength = m_dataLength - m_blockLength;
+
+	AsyncReadSlot& slot = m_aAsyncReadSlots[m_asyncNextSlot];
+
+	// if the last read ended at the size of the file when it was opened, this one won't have been queued yet
+	if (slot.state == AsyncReadSlot::eStateIdle && !queueAsyncRead(m_asyncNextSlot, true))
+	{
+		slot.offset = m_asyncNextReadOffset;
+		slot.requestedLength = 0;
+		slot.result = 0;
+		slot.state = AsyncReadSlot::eStateCompleted;
+	}
+
+	while (slot.state != AsyncReadSlot::eStateCompleted)
+	{
+		if (!waitForAsyncRead())
+		{
+			abandonIoUring();
+			return false;
+		}
+	}
+
+	char* pData = slot.pBuffer + m_bufferSize;
+
+	// reads can be short (or fail, e.g. on kernels without IORING_OP_READ), in which case the rest is read normally
+	size_t readLength = slot.result > 0 ? slot.result : 0;
+	while (readLength < slot.requestedLength)
+	{
+		ssize_t readAmount = pread(m_fileDescriptor, pData + readLength, slot.requestedLength - readLength,
+								   slot.offset + readLength);
+		if (readAmount <= 0)
+			break;
+
+		readLength += readAmount;
+	}
+
+	m_endOfFile = readLength < slot.requestedLength || slot.offset + readLength >= m_asyncRangeEnd;
+
+	if (carryOverLength > 0)
+	{
+		memcpy(pData - carryOverLength, pCarryOver, carryOverLength);
+	}
+
+	// the slot the last block was in is free again now
+	if (m_asyncCurrentSlot < m_aAsyncReadSlots.size())
+	{
+		m_aAsyncReadSlots[m_asyncCurrentSlot].state = AsyncReadSlot::eStateIdle;
+		if (!m_endOfFile && queueAsyncRead(m_asyncCurrentSlot, false))
+		{
+			// start it straight away, so it's in flight while this block's being processed
+			m_pIoUring->submitQueued();
+		}
+	}
+
+	m_asyncCurrentSlot = m_asyncNextSlot;
+	m_asyncNextSlot = (m_asyncNextSlot + 1) % m_aAsyncReadSlots.size();
+
+	m_pBlock = pData - carryOverLength;
+	m_dataLength = carryOverLength + readLength;
+	m_blockLength = 0;
+
+	if (m_dataLength == 0)
+		return false;
+
+	if (m_endOfFile)
+	{
+		// everything left is complete lines, including a possible final line without a newline
+		m_blockLength = m_dataLength;
+		return true;
+	}
+
+	const char* lastLineStart = findLineStart(m_pBlock, m_pBlock + m_dataLength);
+	if (lastLineStart == m_pBlock)
+	{
+		// there's no new line at all, so we have no choice but to split the line
+		m_blockLength = m_dataLength;
+	}
+	else
+	{
+		m_blockLength = lastLineStart - m_pBlock;
+	}
+
+	return true;
+}
+
+unsigned int BlockReader::countLines(const char* start, const char* end)
+{
+	return std::count(start, end, '\n');
+}
@@ -0,0 +1,272 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef BLOCK_READER_H
+#define BLOCK_READER_H
+
+#include <string>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+#include <signal.h>
+
+// Reads files in large blocks with read(), and presents each block as a run of complete lines,
+// carrying over any incomplete line at the end of one block to the start of the next one.
+// This means content searching can be done over the whole block at once, with line boundaries
+// only needing to be worked out around actual matches.
+// Files can also be read backwards from the end, for when only the last part of them is wanted, in which case
+// the incomplete line at the start of each block is carried over to the end of the next (previous) one.
+// When reading forwards, files on local file systems can be memory mapped instead, in which case each block is just
+// a view of the mapping (split at the same places as it would be when reading), so the content isn't copied at all.
+// This isn't done for network file systems, where the file being truncated by another machine while it's mapped
+// would cause a SIGBUS, and where it wouldn't be any quicker anyway. Local files can still be truncated while they're
+// mapped (e.g. logs rotated with copytruncate), so a SIGBUS handler replaces the rest of the mapping with zeros if
+// that happens, and the file's treated as ending there, as it would be when reading it.
+// Files which aren't mapped can optionally be read with io_uring, which keeps several block reads in flight ahead of
+// the block being processed, each into its own buffer, so that the latency of each read (which can be large over NFS)
+// overlaps with the others and with searching. The incomplete line at the end of each block is copied in front of the
+// next block's data, which is read after space for it. As the reads are at fixed offsets, lines longer than the block
+// size are split at different places than with normal reads.
+// If the file's size is already known (from when it was found), files which fit in the buffer are read with a single
+// read(), without a stat() first, and files which need several reads are read with a sequential access hint.
+
+class IoUringReader;
+
+class BlockReader
+{
+public:
+	BlockReader();
+	~BlockReader();
+
+	// blockSize is in bytes.
+	void init(size_t blockSize);
+
+	// sets the buffer to read into (which must be at least the block size), which the caller owns, and which is used
+	// until it's changed again. If it's nullptr (or isn't set), the reader allocates its own. Closes any open file.
+	// Buffers for io_uring reads are still the reader's own.
+	void setBuffer(char* pBuffer);
+
+	size_t getBufferSize() const
+	{
+		return m_bufferSize;
+	}
+
+	void setAllowMemoryMapping(bool allowMemoryMapping)
+	{
+		m_allowMemoryMapping = allowMemoryMapping;
+	}
+
+	// queueDepth is the number of reads to keep in flight. Returns false if io_uring isn't available, in which case
+	// files are just read normally. init() has to have been called first.
+	bool enableIoUring(unsigned int queueDepth);
+
+	// the memory allocated for the io_uring read buffers (0 if io_uring isn't being used)
+	size_t getIoUringBufferMemory() const
+	{
+		return m_aAsyncReadSlots.size() * m_bufferSize * 2;
+	}
+
+	// what's already known about the file: the file descriptor it's already been opened with (or -1), which is used
+	// (rather than opening it again) the next time the file's opened, and is owned by the reader from then on,
+	// and its size when it was found (or UINT64_MAX), which is used to work out how to read it each time it's opened.
+	// clearFileDetails() closes the file descriptor if it wasn't used.
+	void setFileDetails(const std::string& filename, int fileDescriptor, uint64_t fileSize);
+	void clearFileDetails();
+
+	bool openFile(const std::string& filename);
+	// only reads the given range of the file, which should start and end on line boundaries
+	bool openFileRange(const std::string& filename, uint64_t rangeStart, uint64_t rangeLength);
+	// for reading the range backwards with readPreviousBlock(). A rangeLength of UINT64_MAX is to the end of the file.
+	bool openFileRangeReverse(const std::string& filename, uint64_t rangeStart, uint64_t rangeLength);
+	void closeFile();
+
+	// reads the next block of complete lines. Returns false when there's no more content.
+	// Lines longer than the block size are split at the block size.
+	bool readNextBlock();
+
+	// reads the block of complete lines before the last one, going backwards from the end of the range. Returns false
+	// once the start of the range has been reached. As with readNextBlock(), long lines are split at the block size.
+	bool readPreviousBlock();
+
+	// all lines within the block end with '\n', other than possibly the very last line in the file
+	const char* getBlockStart() const
+	{
+		return m_pBlock;
+	}
+
+	const char* getBlockEnd() const
+	{
+		return m_pBlock + m_blockLength;
+	}
+
+	// the offset within the file of the start of the block
+	uint64_t getBlockFileOffset() const
+	{
+		return m_blockFileOffset;
+	}
+
+	// line helpers for working within a block
+
+	// returns the start of the line containing pos
+	static const char* findLineStart(const char* blockStart, const char* pos)
+	{
+#ifdef __linux__
+		const char* newLine = (const char*)memrchr(blockStart, '\n', pos - blockStart);
+		return newLine ? newLine + 1 : blockStart;
+#else
+		while (pos > blockStart && *(pos - 1) != '\n')
+		{
+			pos--;
+		}
+		return pos;
+#endif
+	}
+
+	// returns the end of the line containing pos (the position of the '\n' char, or blockEnd)
+	static const char* findLineEnd(const char* pos, const char* blockEnd)
+	{
+		const char* newLine = (const char*)memchr(pos, '\n', blockEnd - pos);
+		return newLine ? newLine : blockEnd;
+	}
+
+	// returns the start of the last numLines lines within the range (where the last line might not have a new line),
+	// setting numLines to the number actually found if there are fewer than that
+	static const char* findLastLinesStart(const char* start, const char* end, unsigned int& numLines)
+	{
+		const unsigned int maxLines = numLines;
+		numLines = 0;
+
+		const char* linesStart = end;
+		while (numLines < maxLines && linesStart > start)
+		{
+			const char* lineEnd = (*(linesStart - 1) == '\n') ? linesStart - 1 : linesStart;
+			linesStart = findLineStart(start, lineEnd);
+			numLines++;
+		}
+
+		return linesStart;
+	}
+
+	static unsigned int countLines(const char* start, const char* end);
+
+private:
+	// returns false if the range shouldn't (or can't) be memory mapped, in which case it's read normally
+	bool mapFileRange(const std::string& filename, uint64_t fileSize, uint64_t device, uint64_t rangeStart,
+					  uint64_t rangeLength);
+	void unmapFile();
+
+	bool readNextMappedBlock();
+
+	static void installBusErrorHandler();
+	static void handleBusError(int signalNumber, siginfo_t* pInfo, void* pContext);
+
+	// for io_uring reads
+	struct AsyncReadSlot
+	{
+		enum State
+		{
+			eStateIdle,
+			eStateInFlight,
+			eStateCompleted
+		};
+
+		AsyncReadSlot() : pBuffer(nullptr), state(eStateIdle), offset(0), requestedLength(0), result(0)
+		{
+		}
+
+		char*		pBuffer;	// space for the incomplete line from the previous block, followed by the read data
+		State		state;
+		uint64_t	offset;
+		size_t		requestedLength;
+		int			result;
+	};
+
+	void startAsyncReads(uint64_t fileSize, uint64_t rangeStart, uint64_t rangeLength);
+	// returns false if there's nothing more to read (unless force is set, only up to the file size when it was opened)
+	bool queueAsyncRead(size_t slotIndex, bool force);
+	// returns false if waiting failed
+	bool waitForAsyncRead();
+	// waits for any reads still in flight, so that the buffers aren't in use
+	void finishAsyncReads();
+	// if waiting for reads fails, we can't tell when the buffers are free, so io_uring isn't used any more
+	void abandonIoUring();
+	bool readNextAsyncBlock();
+
+	// whether the file system the device is on is one we can memory map files on
+	bool canMemoryMapOnDevice(const std::string& filename, uint64_t device);
+
+private:
+	int				m_fileDescriptor;
+
+	char*			m_pBuffer;
+	char*			m_pOwnBuffer; // only allocated if a buffer isn't provided
+	size_t			m_bufferSize;
+
+	const char*		m_pBlock;
+
+	size_t			m_dataLength; // total amount of data within the buffer
+	size_t			m_blockStart; // where the complete lines start within the buffer (only non-zero when reading backwards)
+	size_t			m_blockLength; // length of the complete lines within the buffer
+	uint64_t		m_blockFileOffset;
+
+	uint64_t		m_remainingLength; // how much more we're allowed to read from the file
+
+	// when reading backwards, the data is at the end of the buffer, starting at m_dataStart, and m_reversePosition is
+	// the offset in the file of it, with everything from m_reverseRangeStart to there still to be read
+	size_t			m_dataStart;
+	uint64_t		m_reversePosition;
+	uint64_t		m_reverseRangeStart;
+
+	bool			m_endOfFile;
+
+	bool			m_allowMemoryMapping;
+	// the whole mapping (which starts on a page boundary), and the range within it
+	void*			m_pMapping;
+	size_t			m_mappingLength;
+	const char*		m_pMappedData;
+	size_t			m_mappedDataLength;
+	size_t			m_mappedPosition; // the start of the current block within the mapped data
+	// mappings are opened and closed on the same thread, and are in a list for that thread for the SIGBUS handler
+	BlockReader*	m_pNextMappedReader;
+	volatile bool	m_mappingTruncated; // set by the SIGBUS handler
+
+	// whether files can be memory mapped on each device we've seen, so the file system type is only looked up once each
+	std::map<uint64_t, bool>	m_deviceCanMemoryMap;
+
+	IoUringReader*				m_pIoUring; // if io_uring is being used
+	std::vector<AsyncReadSlot>	m_aAsyncReadSlots; // reads are in order round the slots
+	bool						m_asyncReading; // whether the current file's being read with io_uring
+	size_t						m_asyncNextSlot; // the slot with the data for the next block
+	size_t						m_asyncCurrentSlot; // the slot with the data for the current block
+	unsigned int				m_asyncReadsInFlight;
+	uint64_t					m_asyncNextReadOffset;
+	uint64_t					m_asyncRangeEnd;
+	uint64_t					m_asyncFileSize; // when the file was opened
+
+	// from setFileDetails()
+	std::string					m_detailsFilename;
+	int							m_prefetchedFileDescriptor;
+	uint64_t					m_knownFileSize;
+
+	uint64_t					m_readOffset; // the offset in the file of the next read
+	uint64_t					m_expectedFileSize; // the file's size as far as we know, or UINT64_MAX
+};
+
+#endif // BLOCK_READER_H
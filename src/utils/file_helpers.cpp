@@ -25,12 +25,30 @@
 #include <set>
 
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <dirent.h>
 #include <unistd.h>
 
 static const char kDirSepChar = '/';
 static const std::string kDirSepString = "/";
 
+// statfs() f_type values of network / cluster file systems (from linux/magic.h, and the file systems' own sources
+// for the ones which aren't in there)
+static const unsigned long kNetworkFileSystemTypes[] =
+{
+	0x6969,			// NFS
+	0x517B,			// SMB
+	0xFF534D42,		// CIFS
+	0xFE534D42,		// SMB2
+	0x73757245,		// Coda
+	0x5346414F,		// AFS
+	0x6B414653,		// kAFS
+	0x00C36400,		// Ceph
+	0x0BD00BD0,		// Lustre
+	0x47504653,		// GPFS
+	0x65735546		// FUSE (sshfs etc. - we can't tell whether it's local or not)
+};
+
 FileHelpers::FileHelpers()
 {
 
@@ -191,3 +209,21 @@ bool FileHelpers::getDirectoriesInDirectory(const std::string& directoryPath, co
 
 	return !directories.empty();
 }
+
+bool FileHelpers::isNetworkFileSystem(const std::string& path)
+{
+	struct statfs statfsState;
+	if (statfs(path.c_str(), &statfsState) != 0)
+		return false;
+
+	// f_type is signed on some platforms, and the CIFS / SMB2 values have the top bit set
+	const unsigned long fileSystemType = (unsigned long)(unsigned int)statfsState.f_type;
+
+	for (unsigned long networkType : kNetworkFileSystemTypes)
+	{
+		if (fileSystemType == networkType)
+			return true;
+	}
+
+	return false;
+}
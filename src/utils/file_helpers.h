@@ -41,6 +41,10 @@ public:
 	// currently dirMatch has to be '*'...
 	static bool getDirectoriesInDirectory(const std::string& directoryPath, const std::string& dirMatch,
 										  bool ignoreHiddenDirs, std::vector<std::string>& directories);
+
+	// whether the path is on a network (or cluster) file system, where other machines can change files, so things
+	// like inotify don't see all changes. Returns false if it can't be worked out.
+	static bool isNetworkFileSystem(const std::string& path);
 };
 
 #endif // FILE_HELPERS_H
@@ -0,0 +1,263 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "io_uring_reader.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <algorithm>
+
+#if SNIFFLE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+IoUringReader::IoUringReader() :
+	m_ringFD(-1),
+	m_pSubmissionRing(nullptr),
+	m_submissionRingSize(0),
+	m_pCompletionRing(nullptr),
+	m_completionRingSize(0),
+	m_pSubmissionEntries(nullptr),
+	m_submissionEntriesSize(0),
+	m_pSubmissionHead(nullptr),
+	m_pSubmissionTail(nullptr),
+	m_submissionMask(0),
+	m_submissionEntryCount(0),
+	m_pSubmissionArray(nullptr),
+	m_pCompletionHead(nullptr),
+	m_pCompletionTail(nullptr),
+	m_completionMask(0),
+	m_pCompletionEntries(nullptr),
+	m_queuedCount(0)
+{
+
+}
+
+#if SNIFFLE_IO_URING
+
+IoUringReader::~IoUringReader()
+{
+	if (m_pSubmissionEntries)
+	{
+		munmap(m_pSubmissionEntries, m_submissionEntriesSize);
+	}
+
+	if (m_pCompletionRing && m_pCompletionRing != m_pSubmissionRing)
+	{
+		munmap(m_pCompletionRing, m_completionRingSize);
+	}
+
+	if (m_pSubmissionRing)
+	{
+		munmap(m_pSubmissionRing, m_submissionRingSize);
+	}
+
+	if (m_ringFD != -1)
+	{
+		close(m_ringFD);
+	}
+}
+
+bool IoUringReader::init(unsigned int queueDepth)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	m_ringFD = (int)syscall(__NR_io_uring_setup, queueDepth, &params);
+	if (m_ringFD < 0)
+	{
+		m_ringFD = -1;
+		return false;
+	}
+
+	m_submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	m_completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	// newer kernels let both rings be mapped in one go
+	const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMapping)
+	{
+		m_submissionRingSize = std::max(m_submissionRingSize, m_completionRingSize);
+		m_completionRingSize = m_submissionRingSize;
+	}
+
+	m_pSubmissionRing = mmap(nullptr, m_submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFD,
+							 IORING_OFF_SQ_RING);
+	if (m_pSubmissionRing == MAP_FAILED)
+	{
+		m_pSubmissionRing = nullptr;
+		return false;
+	}
+
+	if (singleMapping)
+	{
+		m_pCompletionRing = m_pSubmissionRing;
+	}
+	else
+	{
+		m_pCompletionRing = mmap(nullptr, m_completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFD,
+								 IORING_OFF_CQ_RING);
+		if (m_pCompletionRing == MAP_FAILED)
+		{
+			m_pCompletionRing = nullptr;
+			return false;
+		}
+	}
+
+	m_submissionEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	void* pSubmissionEntries = mmap(nullptr, m_submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+									m_ringFD, IORING_OFF_SQES);
+	if (pSubmissionEntries == MAP_FAILED)
+		return false;
+
+	m_pSubmissionEntries = (struct io_uring_sqe*)pSubmissionEntries;
+
+	char* pSubmissionRing = (char*)m_pSubmissionRing;
+	m_pSubmissionHead = (unsigned int*)(pSubmissionRing + params.sq_off.head);
+	m_pSubmissionTail = (unsigned int*)(pSubmissionRing + params.sq_off.tail);
+	m_submissionMask = *(unsigned int*)(pSubmissionRing + params.sq_off.ring_mask);
+	m_submissionEntryCount = params.sq_entries;
+	m_pSubmissionArray = (unsigned int*)(pSubmissionRing + params.sq_off.array);
+
+	char* pCompletionRing = (char*)m_pCompletionRing;
+	m_pCompletionHead = (unsigned int*)(pCompletionRing + params.cq_off.head);
+	m_pCompletionTail = (unsigned int*)(pCompletionRing + params.cq_off.tail);
+	m_completionMask = *(unsigned int*)(pCompletionRing + params.cq_off.ring_mask);
+	m_pCompletionEntries = (struct io_uring_cqe*)(pCompletionRing + params.cq_off.cqes);
+
+	return true;
+}
+
+bool IoUringReader::queueRead(int fileDescriptor, char* pBuffer, size_t length, uint64_t offset, uint64_t userData)
+{
+	// we're the only thing adding entries, so only the head (which the kernel moves on) needs an atomic load
+	const unsigned int tail = *m_pSubmissionTail;
+	const unsigned int head = __atomic_load_n(m_pSubmissionHead, __ATOMIC_ACQUIRE);
+	if (tail - head >= m_submissionEntryCount)
+		return false;
+
+	const unsigned int index = tail & m_submissionMask;
+
+	struct io_uring_sqe* pEntry = &m_pSubmissionEntries[index];
+	memset(pEntry, 0, sizeof(struct io_uring_sqe));
+	pEntry->opcode = IORING_OP_READ;
+	pEntry->fd = fileDescriptor;
+	pEntry->addr = (uint64_t)(uintptr_t)pBuffer;
+	pEntry->len = (uint32_t)length;
+	pEntry->off = offset;
+	pEntry->user_data = userData;
+
+	m_pSubmissionArray[index] = index;
+
+	__atomic_store_n(m_pSubmissionTail, tail + 1, __ATOMIC_RELEASE);
+
+	m_queuedCount++;
+
+	return true;
+}
+
+bool IoUringReader::submitQueued()
+{
+	while (m_queuedCount > 0)
+	{
+		int ret = (int)syscall(__NR_io_uring_enter, m_ringFD, m_queuedCount, 0, 0, nullptr, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		m_queuedCount -= std::min((unsigned int)ret, m_queuedCount);
+
+		// it can submit fewer than asked for if it's short of memory, in which case the rest go with the next call
+		if (ret == 0)
+			break;
+	}
+
+	return true;
+}
+
+bool IoUringReader::waitForCompletion(uint64_t& userData, int& result)
+{
+	while (true)
+	{
+		const unsigned int head = *m_pCompletionHead;
+		const unsigned int tail = __atomic_load_n(m_pCompletionTail, __ATOMIC_ACQUIRE);
+		if (head != tail)
+		{
+			// otherwise reads queued since the last wait wouldn't start until there were no completions left,
+			// so there'd be far fewer in flight than there should be
+			if (m_queuedCount > 0 && !submitQueued())
+				return false;
+
+			const struct io_uring_cqe* pEntry = &m_pCompletionEntries[head & m_completionMask];
+			userData = pEntry->user_data;
+			result = pEntry->res;
+
+			__atomic_store_n(m_pCompletionHead, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		// submit anything queued, and wait for something to complete, in one call
+		int ret = (int)syscall(__NR_io_uring_enter, m_ringFD, m_queuedCount, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		m_queuedCount -= std::min((unsigned int)ret, m_queuedCount);
+	}
+}
+
+#else
+
+IoUringReader::~IoUringReader()
+{
+
+}
+
+bool IoUringReader::init(unsigned int /*queueDepth*/)
+{
+	return false;
+}
+
+bool IoUringReader::queueRead(int /*fileDescriptor*/, char* /*pBuffer*/, size_t /*length*/, uint64_t /*offset*/, uint64_t /*userData*/)
+{
+	return false;
+}
+
+bool IoUringReader::submitQueued()
+{
+	return false;
+}
+
+bool IoUringReader::waitForCompletion(uint64_t& /*userData*/, int& /*result*/)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef IO_URING_READER_H
+#define IO_URING_READER_H
+
+#include <cstddef>
+
+#include <stdint.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SNIFFLE_IO_URING 1
+#endif
+#endif
+
+#ifndef SNIFFLE_IO_URING
+#define SNIFFLE_IO_URING 0
+#endif
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Minimal io_uring wrapper (using the syscalls directly, so there's no dependency on liburing) for having multiple
+// reads in flight at once, so that the latency of each read (which can be large over NFS) overlaps with the others
+// and with processing what's already been read.
+// Each instance has its own ring, so it can only be used by one thread at a time.
+
+class IoUringReader
+{
+public:
+	IoUringReader();
+	~IoUringReader();
+
+	// returns false if io_uring isn't available (not supported by the kernel, disabled, or blocked by seccomp)
+	bool init(unsigned int queueDepth);
+
+	// queues a read, which isn't started until it's submitted with submitQueued() or waitForCompletion().
+	// Returns false if the queue's full.
+	bool queueRead(int fileDescriptor, char* pBuffer, size_t length, uint64_t offset, uint64_t userData);
+
+	// submits any queued reads without waiting for anything. Returns false if submitting failed.
+	bool submitQueued();
+
+	// submits any queued reads (even if there's already a completed one), and waits for one to complete if there
+	// isn't one already. result is the number of bytes read, or -errno. Returns false if there was an error waiting.
+	bool waitForCompletion(uint64_t& userData, int& result);
+
+	unsigned int getUnsubmittedCount() const
+	{
+		return m_queuedCount;
+	}
+
+private:
+	int				m_ringFD;
+
+	// shared with the kernel
+	void*			m_pSubmissionRing;
+	size_t			m_submissionRingSize;
+	void*			m_pCompletionRing;
+	size_t			m_completionRingSize;
+	io_uring_sqe*	m_pSubmissionEntries;
+	size_t			m_submissionEntriesSize;
+
+	unsigned int*	m_pSubmissionHead;
+	unsigned int*	m_pSubmissionTail;
+	unsigned int	m_submissionMask;
+	unsigned int	m_submissionEntryCount;
+	unsigned int*	m_pSubmissionArray;
+
+	unsigned int*	m_pCompletionHead;
+	unsigned int*	m_pCompletionTail;
+	unsigned int	m_completionMask;
+	io_uring_cqe*	m_pCompletionEntries;
+
+	unsigned int	m_queuedCount; // queued, but not submitted yet
+};
+
+#endif // IO_URING_READER_H
@@ -0,0 +1,167 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "read_buffer_pool.h"
+
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+ReadBufferPool::ReadBufferPool() :
+	m_bufferSize(0),
+	m_memoryLimit(0),
+	m_useHugePages(false),
+	m_slabSize(0),
+	m_allocatedSize(0),
+	m_reservedSize(0)
+{
+
+}
+
+ReadBufferPool::~ReadBufferPool()
+{
+	freeSlabs();
+}
+
+void ReadBufferPool::init(size_t bufferSize, size_t memoryLimit, bool useHugePages)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	freeSlabs();
+
+	const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+	// keep each buffer page aligned
+	m_bufferSize = (bufferSize + pageSize - 1) / pageSize * pageSize;
+	m_memoryLimit = memoryLimit;
+	m_useHugePages = useHugePages;
+	m_reservedSize = 0;
+
+	m_slabSize = m_useHugePages ? (m_bufferSize + kHugePageSize - 1) / kHugePageSize * kHugePageSize : m_bufferSize;
+}
+
+void ReadBufferPool::reserveMemory(size_t size)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_reservedSize += size;
+}
+
+char* ReadBufferPool::takeBuffer()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (m_aFreeBuffers.empty())
+	{
+		bool withinLimit = m_memoryLimit == 0 || m_reservedSize + m_allocatedSize + m_slabSize <= m_memoryLimit;
+		if (m_allocatedSize == 0 || withinLimit)
+		{
+			if (allocateSlab())
+				break;
+
+			// if we can't allocate any at all, there's nothing to wait for
+			if (m_allocatedSize == 0)
+				return nullptr;
+		}
+
+		m_bufferReturnedEvent.wait(lock);
+	}
+
+	char* pBuffer = m_aFreeBuffers.back();
+	m_aFreeBuffers.pop_back();
+
+	return pBuffer;
+}
+
+void ReadBufferPool::returnBuffer(char* pBuffer)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_aFreeBuffers.emplace_back(pBuffer);
+
+	m_bufferReturnedEvent.notify_one();
+}
+
+bool ReadBufferPool::allocateSlab()
+{
+	// for huge pages, the slab needs to be aligned to the huge page size, which mmap() doesn't do, so we map more than
+	// we need and trim off either end
+	size_t mappingLength = m_useHugePages ? m_slabSize + kHugePageSize : m_slabSize;
+
+	void* pMapping = mmap(nullptr, mappingLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pMapping == MAP_FAILED)
+		return false;
+
+	char* pSlab = (char*)pMapping;
+
+	if (m_useHugePages)
+	{
+		uintptr_t mappingStart = (uintptr_t)pMapping;
+		uintptr_t alignedStart = (mappingStart + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+
+		size_t startTrim = alignedStart - mappingStart;
+		if (startTrim > 0)
+		{
+			munmap(pMapping, startTrim);
+		}
+
+		size_t endTrim = mappingLength - startTrim - m_slabSize;
+		if (endTrim > 0)
+		{
+			munmap((char*)alignedStart + m_slabSize, endTrim);
+		}
+
+		pSlab = (char*)alignedStart;
+		pMapping = pSlab;
+		mappingLength = m_slabSize;
+
+#ifdef MADV_HUGEPAGE
+		// this is just a hint, so it doesn't matter if it fails (e.g. transparent huge pages are disabled)
+		madvise(pMapping, mappingLength, MADV_HUGEPAGE);
+#endif
+	}
+
+	Slab newSlab;
+	newSlab.pMapping = pMapping;
+	newSlab.mappingLength = mappingLength;
+	m_aSlabs.emplace_back(newSlab);
+
+	m_allocatedSize += m_slabSize;
+
+	for (size_t offset = 0; offset + m_bufferSize <= m_slabSize; offset += m_bufferSize)
+	{
+		m_aFreeBuffers.emplace_back(pSlab + offset);
+	}
+
+	return true;
+}
+
+void ReadBufferPool::freeSlabs()
+{
+	for (const Slab& slab : m_aSlabs)
+	{
+		munmap(slab.pMapping, slab.mappingLength);
+	}
+
+	m_aSlabs.clear();
+	m_aFreeBuffers.clear();
+	m_allocatedSize = 0;
+}
@@ -0,0 +1,119 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef READ_BUFFER_POOL_H
+#define READ_BUFFER_POOL_H
+
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+// Pool of page-aligned read buffers (all the same size), shared between all the threads reading files, which take a
+// buffer while processing a file and give it back afterwards, so that the total memory used for them can be capped.
+// Buffers are allocated with mmap() in slabs as they're needed, and are kept until the pool is destroyed.
+// With huge pages enabled, slabs are 2 MB aligned and rounded up to a multiple of 2 MB (so hold several buffers each,
+// unless the buffers are larger than that), and are marked with MADV_HUGEPAGE, to cut down on TLB misses when scanning.
+// When the memory limit's been reached, taking a buffer waits until another thread gives one back. At least one slab
+// is always allowed however small the limit is, so there's always a buffer for something to make progress with.
+
+class ReadBufferPool
+{
+public:
+	ReadBufferPool();
+	~ReadBufferPool();
+
+	// memoryLimit is in bytes, with 0 meaning no limit. Must be called before any buffers are taken.
+	void init(size_t bufferSize, size_t memoryLimit, bool useHugePages);
+
+	size_t getBufferSize() const
+	{
+		return m_bufferSize;
+	}
+
+	// counts memory allocated elsewhere for reading files (e.g. io_uring read buffers) towards the memory limit,
+	// so there's less left for the pool's own buffers. Must be called after init().
+	void reserveMemory(size_t size);
+
+	// blocks while there isn't a buffer free and the memory limit's been reached
+	char* takeBuffer();
+	void returnBuffer(char* pBuffer);
+
+protected:
+	// adds the buffers of a new slab to the free buffers - m_lock must be held. Returns false if allocating it failed.
+	bool allocateSlab();
+
+	void freeSlabs();
+
+protected:
+	size_t						m_bufferSize;
+	size_t						m_memoryLimit;
+	bool						m_useHugePages;
+
+	std::mutex					m_lock;
+	std::condition_variable		m_bufferReturnedEvent;
+
+	std::vector<char*>			m_aFreeBuffers;
+
+	struct Slab
+	{
+		void*		pMapping;
+		size_t		mappingLength;
+	};
+
+	std::vector<Slab>			m_aSlabs;
+	size_t						m_slabSize;
+	size_t						m_allocatedSize;
+	size_t						m_reservedSize; // allocated outside the pool, but counted towards the limit
+};
+
+// takes a buffer from the pool for the scope it's in, giving it back at the end
+
+class ScopedReadBuffer
+{
+public:
+	ScopedReadBuffer(ReadBufferPool& pool) : m_pool(pool), m_pBuffer(pool.takeBuffer())
+	{
+	}
+
+	~ScopedReadBuffer()
+	{
+		returnBuffer();
+	}
+
+	// gives it back early
+	void returnBuffer()
+	{
+		if (m_pBuffer)
+		{
+			m_pool.returnBuffer(m_pBuffer);
+			m_pBuffer = nullptr;
+		}
+	}
+
+	char* getBuffer() const
+	{
+		return m_pBuffer;
+	}
+
+protected:
+	ReadBufferPool&		m_pool;
+	char*				m_pBuffer;
+};
+
+#endif // READ_BUFFER_POOL_H
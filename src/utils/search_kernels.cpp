@@ -0,0 +1,641 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "search_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SNIFFLE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define SNIFFLE_X86_KERNELS 0
+#endif
+
+SearchKernels::FindStringFunc SearchKernels::s_pFindStringFunc = SearchKernels::findStringInit;
+SearchKernels::FindStringFunc SearchKernels::s_pFindStringCaseInsensitiveFunc = SearchKernels::findStringCaseInsensitiveInit;
+SearchKernels::FindFirstOfFunc SearchKernels::s_pFindFirstOfFunc = SearchKernels::findFirstOfInit;
+SearchKernels::FindStringsFunc SearchKernels::s_pFindStringsFunc = SearchKernels::findStringsInit;
+SearchKernels::FindStringsFunc SearchKernels::s_pFindStringsCaseInsensitiveFunc = SearchKernels::findStringsCaseInsensitiveInit;
+SearchKernels::KernelType SearchKernels::s_kernelType = SearchKernels::eKernelScalar;
+
+// All the implementations below check the first and last chars of the needle at each candidate position
+// first (which rejects almost all positions for typical text), and only then compare the full needle.
+//
+// They're all templated on whether the search is case insensitive (ASCII letters only), in which case the needle has
+// to be lower case already. ASCII letters only differ between cases by the 0x20 bit, and no other byte ORed with 0x20
+// gives a lower case letter, so ORing the content with 0x20 where the needle char is a letter (and with 0 where it
+// isn't) matches both cases exactly, and costs just one extra instruction per vector - no lower case copy is needed.
+
+static inline bool isLowerCaseLetter(char c)
+{
+	return c >= 'a' && c <= 'z';
+}
+
+static inline char toUpperCase(char c)
+{
+	return isLowerCaseLetter(c) ? (char)(c & ~0x20) : c;
+}
+
+// the mask to OR content bytes with before comparing them against the (lower case) needle char
+static inline char getCaseFoldMask(char c)
+{
+	return isLowerCaseLetter(c) ? 0x20 : 0;
+}
+
+static inline char foldCase(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c | 0x20) : c;
+}
+
+template <bool caseInsensitive>
+static inline bool compareNeedle(const char* pos, const char* needle, size_t length)
+{
+	if (!caseInsensitive)
+		return memcmp(pos, needle, length) == 0;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		if (foldCase(pos[i]) != needle[i])
+			return false;
+	}
+
+	return true;
+}
+
+static const char* findFirstOfScalar(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars)
+{
+	if (numChars == 1)
+		return (const char*)memchr(haystack, chars[0], haystackLength);
+
+	const char* end = haystack + haystackLength;
+	for (const char* pos = haystack; pos < end; pos++)
+	{
+		for (unsigned int i = 0; i < numChars; i++)
+		{
+			if (*pos == chars[i])
+				return pos;
+		}
+	}
+
+	return nullptr;
+}
+
+// needle must be at least two chars long, and no longer than the haystack
+template <bool caseInsensitive>
+static const char* findStringScalarImpl(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	// if case insensitive, the first char could be either case
+	const char firstChars[2] = { needle[0], toUpperCase(needle[0]) };
+	const unsigned int numFirstChars = (caseInsensitive && isLowerCaseLetter(needle[0])) ? 2 : 1;
+	const char lastChar = needle[needleLength - 1];
+
+	const char* pos = haystack;
+	const char* lastCandidate = haystack + haystackLength - needleLength;
+
+	while (pos <= lastCandidate)
+	{
+		// memchr() is normally vectorised itself, so use it to skip to the next possible start
+		pos = findFirstOfScalar(pos, lastCandidate - pos + 1, firstChars, numFirstChars);
+		if (pos == nullptr)
+			return nullptr;
+
+		const char posLastChar = caseInsensitive ? foldCase(pos[needleLength - 1]) : pos[needleLength - 1];
+		if (posLastChar == lastChar && compareNeedle<caseInsensitive>(pos + 1, needle + 1, needleLength - 2))
+			return pos;
+
+		pos++;
+	}
+
+	return nullptr;
+}
+
+template <bool caseInsensitive>
+static const char* findStringScalar(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	if (needleLength > haystackLength)
+		return nullptr;
+
+	if (needleLength <= 1)
+	{
+		if (needleLength == 0)
+			return haystack;
+
+		const char chars[2] = { needle[0], toUpperCase(needle[0]) };
+		return findFirstOfScalar(haystack, haystackLength, chars, (caseInsensitive && chars[0] != chars[1]) ? 2 : 1);
+	}
+
+	return findStringScalarImpl<caseInsensitive>(haystack, haystackLength, needle, needleLength);
+}
+
+template <bool caseInsensitive>
+static const char* findStringsScalar(const char* haystack, size_t haystackLength, const char* const* needles,
+									const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+{
+	// just search for each one in turn, only searching as far as we need to for the later ones
+	const char* firstFound = nullptr;
+	for (unsigned int i = 0; i < numNeedles; i++)
+	{
+		size_t searchLength = haystackLength;
+		if (firstFound != nullptr)
+		{
+			// anything found has to start before the current first one
+			searchLength = std::min(searchLength, (size_t)(firstFound - haystack) - 1 + needleLengths[i]);
+		}
+
+		const char* found = findStringScalar<caseInsensitive>(haystack, searchLength, needles[i], needleLengths[i]);
+		if (found != nullptr && (firstFound == nullptr || found < firstFound))
+		{
+			firstFound = found;
+			needleIndex = i;
+		}
+	}
+
+	return firstFound;
+}
+
+// checks the full needle at a position where the first and last chars are already known to match
+template <bool caseInsensitive>
+static inline bool checkNeedleMiddle(const char* pos, const char* needle, size_t needleLength)
+{
+	return needleLength <= 2 || compareNeedle<caseInsensitive>(pos + 1, needle + 1, needleLength - 2);
+}
+
+#if SNIFFLE_X86_KERNELS
+
+static const char* findFirstOfSSE2(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars);
+static const char* findFirstOfAVX2(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars);
+
+template <bool caseInsensitive>
+static const char* findStringSSE2Impl(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	const __m128i firstChar = _mm_set1_epi8(needle[0]);
+	const __m128i lastChar = _mm_set1_epi8(needle[needleLength - 1]);
+	const __m128i firstFoldMask = _mm_set1_epi8(getCaseFoldMask(needle[0]));
+	const __m128i lastFoldMask = _mm_set1_epi8(getCaseFoldMask(needle[needleLength - 1]));
+
+	// the number of positions the needle could start at
+	const size_t numCandidates = haystackLength - needleLength + 1;
+
+	size_t i = 0;
+	for (; i + 16 <= numCandidates; i += 16)
+	{
+		__m128i blockFirst = _mm_loadu_si128((const __m128i*)(haystack + i));
+		__m128i blockLast = _mm_loadu_si128((const __m128i*)(haystack + i + needleLength - 1));
+
+		if (caseInsensitive)
+		{
+			blockFirst = _mm_or_si128(blockFirst, firstFoldMask);
+			blockLast = _mm_or_si128(blockLast, lastFoldMask);
+		}
+
+		const __m128i matchFirst = _mm_cmpeq_epi8(blockFirst, firstChar);
+		const __m128i matchLast = _mm_cmpeq_epi8(blockLast, lastChar);
+
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(matchFirst, matchLast));
+		while (mask != 0)
+		{
+			const unsigned int bitPos = __builtin_ctz(mask);
+			if (compareNeedle<caseInsensitive>(haystack + i + bitPos + 1, needle + 1, needleLength - 2))
+				return haystack + i + bitPos;
+
+			mask &= mask - 1;
+		}
+	}
+
+	if (i == numCandidates)
+		return nullptr;
+
+	// do the remainder which won't fill a full vector
+	return findStringScalarImpl<caseInsensitive>(haystack + i, haystackLength - i, needle, needleLength);
+}
+
+template <bool caseInsensitive>
+static const char* findStringSSE2(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	if (needleLength > haystackLength)
+		return nullptr;
+
+	if (needleLength <= 1)
+	{
+		if (needleLength == 0)
+			return haystack;
+
+		if (caseInsensitive && isLowerCaseLetter(needle[0]))
+		{
+			const char chars[2] = { needle[0], toUpperCase(needle[0]) };
+			return findFirstOfSSE2(haystack, haystackLength, chars, 2);
+		}
+
+		return (const char*)memchr(haystack, needle[0], haystackLength);
+	}
+
+	return findStringSSE2Impl<caseInsensitive>(haystack, haystackLength, needle, needleLength);
+}
+
+template <bool caseInsensitive>
+__attribute__((target("avx2")))
+static const char* findStringAVX2(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	if (needleLength > haystackLength)
+		return nullptr;
+
+	if (needleLength <= 1)
+	{
+		if (needleLength == 0)
+			return haystack;
+
+		if (caseInsensitive && isLowerCaseLetter(needle[0]))
+		{
+			const char chars[2] = { needle[0], toUpperCase(needle[0]) };
+			return findFirstOfAVX2(haystack, haystackLength, chars, 2);
+		}
+
+		return (const char*)memchr(haystack, needle[0], haystackLength);
+	}
+
+	const __m256i firstChar = _mm256_set1_epi8(needle[0]);
+	const __m256i lastChar = _mm256_set1_epi8(needle[needleLength - 1]);
+	const __m256i firstFoldMask = _mm256_set1_epi8(getCaseFoldMask(needle[0]));
+	const __m256i lastFoldMask = _mm256_set1_epi8(getCaseFoldMask(needle[needleLength - 1]));
+
+	const size_t numCandidates = haystackLength - needleLength + 1;
+
+	size_t i = 0;
+	for (; i + 32 <= numCandidates; i += 32)
+	{
+		__m256i blockFirst = _mm256_loadu_si256((const __m256i*)(haystack + i));
+		__m256i blockLast = _mm256_loadu_si256((const __m256i*)(haystack + i + needleLength - 1));
+
+		if (caseInsensitive)
+		{
+			blockFirst = _mm256_or_si256(blockFirst, firstFoldMask);
+			blockLast = _mm256_or_si256(blockLast, lastFoldMask);
+		}
+
+		const __m256i matchFirst = _mm256_cmpeq_epi8(blockFirst, firstChar);
+		const __m256i matchLast = _mm256_cmpeq_epi8(blockLast, lastChar);
+
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(matchFirst, matchLast));
+		while (mask != 0)
+		{
+			const unsigned int bitPos = __builtin_ctz(mask);
+			if (compareNeedle<caseInsensitive>(haystack + i + bitPos + 1, needle + 1, needleLength - 2))
+				return haystack + i + bitPos;
+
+			mask &= mask - 1;
+		}
+	}
+
+	if (i == numCandidates)
+		return nullptr;
+
+	// the remainder is less than a full AVX2 vector, so let the SSE2 version handle it
+	return findStringSSE2Impl<caseInsensitive>(haystack + i, haystackLength - i, needle, needleLength);
+}
+
+// for the findFirstOf() versions, unused char slots are filled with the first char, so we can always
+// compare against three chars.
+
+static const char* findFirstOfSSE2(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars)
+{
+	if (numChars == 1)
+		return (const char*)memchr(haystack, chars[0], haystackLength);
+
+	const __m128i char0 = _mm_set1_epi8(chars[0]);
+	const __m128i char1 = _mm_set1_epi8(chars[1]);
+	const __m128i char2 = _mm_set1_epi8(chars[numChars > 2 ? 2 : 0]);
+
+	size_t i = 0;
+	for (; i + 16 <= haystackLength; i += 16)
+	{
+		const __m128i block = _mm_loadu_si128((const __m128i*)(haystack + i));
+		const __m128i match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, char0), _mm_cmpeq_epi8(block, char1)),
+											_mm_cmpeq_epi8(block, char2));
+
+		const unsigned int mask = (unsigned int)_mm_movemask_epi8(match);
+		if (mask != 0)
+			return haystack + i + __builtin_ctz(mask);
+	}
+
+	if (i == haystackLength)
+		return nullptr;
+
+	return findFirstOfScalar(haystack + i, haystackLength - i, chars, numChars);
+}
+
+__attribute__((target("avx2")))
+static const char* findFirstOfAVX2(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars)
+{
+	if (numChars == 1)
+		return (const char*)memchr(haystack, chars[0], haystackLength);
+
+	const __m256i char0 = _mm256_set1_epi8(chars[0]);
+	const __m256i char1 = _mm256_set1_epi8(chars[1]);
+	const __m256i char2 = _mm256_set1_epi8(chars[numChars > 2 ? 2 : 0]);
+
+	size_t i = 0;
+	for (; i + 32 <= haystackLength; i += 32)
+	{
+		const __m256i block = _mm256_loadu_si256((const __m256i*)(haystack + i));
+		const __m256i match = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, char0), _mm256_cmpeq_epi8(block, char1)),
+											_mm256_cmpeq_epi8(block, char2));
+
+		const unsigned int mask = (unsigned int)_mm256_movemask_epi8(match);
+		if (mask != 0)
+			return haystack + i + __builtin_ctz(mask);
+	}
+
+	if (i == haystackLength)
+		return nullptr;
+
+	return findFirstOfSSE2(haystack + i, haystackLength - i, chars, numChars);
+}
+
+// for the findStrings() versions, each needle has its own first/last char match masks for each vector of
+// positions (the haystack is only loaded once for all the needles), and then candidate positions are checked
+// in order across all the needles.
+// These are templated on the number of needles so the per-needle loops are unrolled and everything stays in registers.
+
+template <unsigned int numNeedles, bool caseInsensitive>
+static const char* findStringsSSE2Impl(const char* haystack, size_t haystackLength, const char* const* needles,
+									   const size_t* needleLengths, unsigned int& needleIndex)
+{
+	__m128i firstChars[numNeedles];
+	__m128i lastChars[numNeedles];
+	__m128i firstFoldMasks[numNeedles];
+	__m128i lastFoldMasks[numNeedles];
+	size_t maxNeedleLength = 0;
+	for (unsigned int n = 0; n < numNeedles; n++)
+	{
+		firstChars[n] = _mm_set1_epi8(needles[n][0]);
+		lastChars[n] = _mm_set1_epi8(needles[n][needleLengths[n] - 1]);
+		firstFoldMasks[n] = _mm_set1_epi8(getCaseFoldMask(needles[n][0]));
+		lastFoldMasks[n] = _mm_set1_epi8(getCaseFoldMask(needles[n][needleLengths[n] - 1]));
+		maxNeedleLength = std::max(maxNeedleLength, needleLengths[n]);
+	}
+
+	size_t i = 0;
+	for (; i + 16 + maxNeedleLength - 1 <= haystackLength; i += 16)
+	{
+		const __m128i blockFirst = _mm_loadu_si128((const __m128i*)(haystack + i));
+
+		unsigned int masks[numNeedles];
+		unsigned int combinedMask = 0;
+		for (unsigned int n = 0; n < numNeedles; n++)
+		{
+			__m128i needleBlockFirst = blockFirst;
+			__m128i blockLast = _mm_loadu_si128((const __m128i*)(haystack + i + needleLengths[n] - 1));
+			if (caseInsensitive)
+			{
+				needleBlockFirst = _mm_or_si128(needleBlockFirst, firstFoldMasks[n]);
+				blockLast = _mm_or_si128(blockLast, lastFoldMasks[n]);
+			}
+
+			const __m128i match = _mm_and_si128(_mm_cmpeq_epi8(needleBlockFirst, firstChars[n]), _mm_cmpeq_epi8(blockLast, lastChars[n]));
+			masks[n] = (unsigned int)_mm_movemask_epi8(match);
+			combinedMask |= masks[n];
+		}
+
+		while (combinedMask != 0)
+		{
+			const unsigned int bitPos = __builtin_ctz(combinedMask);
+			const char* pos = haystack + i + bitPos;
+			for (unsigned int n = 0; n < numNeedles; n++)
+			{
+				if ((masks[n] & (1u << bitPos)) && checkNeedleMiddle<caseInsensitive>(pos, needles[n], needleLengths[n]))
+				{
+					needleIndex = n;
+					return pos;
+				}
+			}
+
+			combinedMask &= combinedMask - 1;
+		}
+	}
+
+	if (i >= haystackLength)
+		return nullptr;
+
+	return findStringsScalar<caseInsensitive>(haystack + i, haystackLength - i, needles, needleLengths, numNeedles, needleIndex);
+}
+
+template <bool caseInsensitive>
+static const char* findStringsSSE2(const char* haystack, size_t haystackLength, const char* const* needles,
+								   const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+{
+	switch (numNeedles)
+	{
+		case 1:
+			needleIndex = 0;
+			return findStringSSE2<caseInsensitive>(haystack, haystackLength, needles[0], needleLengths[0]);
+		case 2:
+			return findStringsSSE2Impl<2, caseInsensitive>(haystack, haystackLength, needles, needleLengths, needleIndex);
+		case 3:
+			return findStringsSSE2Impl<3, caseInsensitive>(haystack, haystackLength, needles, needleLengths, needleIndex);
+		default:
+			return findStringsSSE2Impl<4, caseInsensitive>(haystack, haystackLength, needles, needleLengths, needleIndex);
+	}
+}
+
+template <unsigned int numNeedles, bool caseInsensitive>
+__attribute__((target("avx2")))
+static const char* findStringsAVX2Impl(const char* haystack, size_t haystackLength, const char* const* needles,
+									   const size_t* needleLengths, unsigned int& needleIndex)
+{
+	__m256i firstChars[numNeedles];
+	__m256i lastChars[numNeedles];
+	__m256i firstFoldMasks[numNeedles];
+	__m256i lastFoldMasks[numNeedles];
+	size_t maxNeedleLength = 0;
+	for (unsigned int n = 0; n < numNeedles; n++)
+	{
+		firstChars[n] = _mm256_set1_epi8(needles[n][0]);
+		lastChars[n] = _mm256_set1_epi8(needles[n][needleLengths[n] - 1]);
+		firstFoldMasks[n] = _mm256_set1_epi8(getCaseFoldMask(needles[n][0]));
+		lastFoldMasks[n] = _mm256_set1_epi8(getCaseFoldMask(needles[n][needleLengths[n] - 1]));
+		maxNeedleLength = std::max(maxNeedleLength, needleLengths[n]);
+	}
+
+	size_t i = 0;
+	for (; i + 32 + maxNeedleLength - 1 <= haystackLength; i += 32)
+	{
+		const __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(haystack + i));
+
+		unsigned int masks[numNeedles];
+		unsigned int combinedMask = 0;
+		for (unsigned int n = 0; n < numNeedles; n++)
+		{
+			__m256i needleBlockFirst = blockFirst;
+			__m256i blockLast = _mm256_loadu_si256((const __m256i*)(haystack + i + needleLengths[n] - 1));
+			if (caseInsensitive)
+			{
+				needleBlockFirst = _mm256_or_si256(needleBlockFirst, firstFoldMasks[n]);
+				blockLast = _mm256_or_si256(blockLast, lastFoldMasks[n]);
+			}
+
+			const __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(needleBlockFirst, firstChars[n]), _mm256_cmpeq_epi8(blockLast, lastChars[n]));
+			masks[n] = (unsigned int)_mm256_movemask_epi8(match);
+			combinedMask |= masks[n];
+		}
+
+		while (combinedMask != 0)
+		{
+			const unsigned int bitPos = __builtin_ctz(combinedMask);
+			const char* pos = haystack + i + bitPos;
+			for (unsigned int n = 0; n < numNeedles; n++)
+			{
+				if ((masks[n] & (1u << bitPos)) && checkNeedleMiddle<caseInsensitive>(pos, needles[n], needleLengths[n]))
+				{
+					needleIndex = n;
+					return pos;
+				}
+			}
+
+			combinedMask &= combinedMask - 1;
+		}
+	}
+
+	if (i >= haystackLength)
+		return nullptr;
+
+	// the remainder is less than a full AVX2 vector (plus the longest needle), so let the SSE2 version handle it
+	return findStringsSSE2Impl<numNeedles, caseInsensitive>(haystack + i, haystackLength - i, needles, needleLengths, needleIndex);
+}
+
+template <bool caseInsensitive>
+static const char* findStringsAVX2(const char* haystack, size_t haystackLength, const char* const* needles,
+								   const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+{
+	switch (numNeedles)
+	{
+		case 1:
+			needleIndex = 0;
+			return findStringAVX2<caseInsensitive>(haystack, haystackLength, needles[0], needleLengths[0]);
+		case 2:
+			return findStringsAVX2Impl<2, caseInsensitive>(haystack, haystackLength, needles, needleLengths, needleIndex);
+		case 3:
+			return findStringsAVX2Impl<3, caseInsensitive>(haystack, haystackLength, needles, needleLengths, needleIndex);
+		default:
+			return findStringsAVX2Impl<4, caseInsensitive>(haystack, haystackLength, needles, needleLengths, needleIndex);
+	}
+}
+
+#endif // SNIFFLE_X86_KERNELS
+
+void SearchKernels::init()
+{
+#if SNIFFLE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		setKernelType(eKernelAVX2);
+		return;
+	}
+
+	setKernelType(eKernelSSE2);
+#else
+	setKernelType(eKernelScalar);
+#endif
+}
+
+bool SearchKernels::setKernelType(KernelType kernelType)
+{
+	switch (kernelType)
+	{
+		case eKernelScalar:
+			s_pFindStringFunc = findStringScalar<false>;
+			s_pFindStringCaseInsensitiveFunc = findStringScalar<true>;
+			s_pFindFirstOfFunc = findFirstOfScalar;
+			s_pFindStringsFunc = findStringsScalar<false>;
+			s_pFindStringsCaseInsensitiveFunc = findStringsScalar<true>;
+			break;
+#if SNIFFLE_X86_KERNELS
+		case eKernelSSE2:
+			s_pFindStringFunc = findStringSSE2<false>;
+			s_pFindStringCaseInsensitiveFunc = findStringSSE2<true>;
+			s_pFindFirstOfFunc = findFirstOfSSE2;
+			s_pFindStringsFunc = findStringsSSE2<false>;
+			s_pFindStringsCaseInsensitiveFunc = findStringsSSE2<true>;
+			break;
+		case eKernelAVX2:
+			__builtin_cpu_init();
+			if (!__builtin_cpu_supports("avx2"))
+				return false;
+			s_pFindStringFunc = findStringAVX2<false>;
+			s_pFindStringCaseInsensitiveFunc = findStringAVX2<true>;
+			s_pFindFirstOfFunc = findFirstOfAVX2;
+			s_pFindStringsFunc = findStringsAVX2<false>;
+			s_pFindStringsCaseInsensitiveFunc = findStringsAVX2<true>;
+			break;
+#endif
+		default:
+			return false;
+	}
+
+	s_kernelType = kernelType;
+	return true;
+}
+
+SearchKernels::KernelType SearchKernels::getKernelType()
+{
+	if (s_pFindStringFunc == findStringInit)
+	{
+		init();
+	}
+
+	return s_kernelType;
+}
+
+const char* SearchKernels::findStringInit(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	init();
+
+	return s_pFindStringFunc(haystack, haystackLength, needle, needleLength);
+}
+
+const char* SearchKernels::findStringCaseInsensitiveInit(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+	init();
+
+	return s_pFindStringCaseInsensitiveFunc(haystack, haystackLength, needle, needleLength);
+}
+
+const char* SearchKernels::findFirstOfInit(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars)
+{
+	init();
+
+	return s_pFindFirstOfFunc(haystack, haystackLength, chars, numChars);
+}
+
+const char* SearchKernels::findStringsInit(const char* haystack, size_t haystackLength, const char* const* needles,
+										   const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+{
+	init();
+
+	return s_pFindStringsFunc(haystack, haystackLength, needles, needleLengths, numNeedles, needleIndex);
+}
+
+const char* SearchKernels::findStringsCaseInsensitiveInit(const char* haystack, size_t haystackLength, const char* const* needles,
+														  const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+{
+	init();
+
+	return s_pFindStringsCaseInsensitiveFunc(haystack, haystackLength, needles, needleLengths, numNeedles, needleIndex);
+}
@@ -0,0 +1,111 @@
+/*
+ Sniffle
+ Copyright 2022 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef SEARCH_KERNELS_H
+#define SEARCH_KERNELS_H
+
+#include <cstddef>
+
+// Low-level vectorised search functions for searching content.
+// The implementation is chosen at runtime based off what the CPU supports (currently SSE2 as a baseline
+// on x86, and AVX2 where available), with a scalar fallback on other architectures.
+
+class SearchKernels
+{
+public:
+	enum KernelType
+	{
+		eKernelScalar,
+		eKernelSSE2,
+		eKernelAVX2
+	};
+
+	// works out which implementation to use. This is done automatically on first use if it
+	// hasn't been called before.
+	static void init();
+
+	// force a particular implementation (mainly for testing). Returns false if it's not supported
+	// by the current CPU.
+	static bool setKernelType(KernelType kernelType);
+
+	static KernelType getKernelType();
+
+	// returns a pointer to the first occurrence of needle within the haystack, or nullptr if not found.
+	// Neither the haystack nor needle need to be null-terminated.
+	static const char* findString(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+	{
+		return s_pFindStringFunc(haystack, haystackLength, needle, needleLength);
+	}
+
+	// as findString(), but ASCII letters match either case. The needle has to be lower case.
+	static const char* findStringCaseInsensitive(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+	{
+		return s_pFindStringCaseInsensitiveFunc(haystack, haystackLength, needle, needleLength);
+	}
+
+	// returns a pointer to the first char in the haystack which is any of the given chars, or nullptr if not found.
+	// numChars must be between 1 and kMaxFindFirstOfChars.
+	static const char* findFirstOf(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars)
+	{
+		return s_pFindFirstOfFunc(haystack, haystackLength, chars, numChars);
+	}
+
+	static const unsigned int kMaxFindFirstOfChars = 3;
+
+	// returns a pointer to the first position in the haystack where any of the needles start, or nullptr if none
+	// were found, setting needleIndex to which one (the lowest index if more than one starts there).
+	// numNeedles must be between 1 and kMaxFindStringsNeedles, and none of the needles can be empty.
+	static const char* findStrings(const char* haystack, size_t haystackLength, const char* const* needles,
+								   const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+	{
+		return s_pFindStringsFunc(haystack, haystackLength, needles, needleLengths, numNeedles, needleIndex);
+	}
+
+	// as findStrings(), but ASCII letters match either case. The needles have to be lower case.
+	static const char* findStringsCaseInsensitive(const char* haystack, size_t haystackLength, const char* const* needles,
+												  const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex)
+	{
+		return s_pFindStringsCaseInsensitiveFunc(haystack, haystackLength, needles, needleLengths, numNeedles, needleIndex);
+	}
+
+	static const unsigned int kMaxFindStringsNeedles = 4;
+
+private:
+	typedef const char* (*FindStringFunc)(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength);
+
+	typedef const char* (*FindFirstOfFunc)(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars);
+	typedef const char* (*FindStringsFunc)(const char* haystack, size_t haystackLength, const char* const* needles,
+										   const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex);
+
+	static const char* findStringInit(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength);
+	static const char* findStringCaseInsensitiveInit(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength);
+	static const char* findFirstOfInit(const char* haystack, size_t haystackLength, const char* chars, unsigned int numChars);
+	static const char* findStringsInit(const char* haystack, size_t haystackLength, const char* const* needles,
+									   const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex);
+	static const char* findStringsCaseInsensitiveInit(const char* haystack, size_t haystackLength, const char* const* needles,
+													  const size_t* needleLengths, unsigned int numNeedles, unsigned int& needleIndex);
+
+	static FindStringFunc	s_pFindStringFunc;
+	static FindStringFunc	s_pFindStringCaseInsensitiveFunc;
+	static FindFirstOfFunc	s_pFindFirstOfFunc;
+	static FindStringsFunc	s_pFindStringsFunc;
+	static FindStringsFunc	s_pFindStringsCaseInsensitiveFunc;
+	static KernelType		s_kernelType;
+};
+
+#endif // SEARCH_KERNELS_H
@@ -46,6 +46,17 @@ void StringHelpers::toLower(std::string& str)
 		str[i] = tolower(str[i]);
 }
 
+bool StringHelpers::containsLetters(const std::string& str)
+{
+	for (char c : str)
+	{
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+			return true;
+	}
+
+	return false;
+}
+
 std::string StringHelpers::formatSize(size_t amount)
 {
 	char szMemAvailable[16];
@@ -45,7 +45,7 @@ void ThreadedTaskPool::start(unsigned int threads)
 	
 	for (unsigned int i = 0; i < m_numThreads; i++)
 	{
-		std::thread newThread = std::thread(std::bind(&ThreadedTaskPool::workerThreadFunctionProcess, this));
+		std::thread newThread = std::thread(std::bind(&ThreadedTaskPool::workerThreadFunctionProcess, this, i));
 		m_aWorkerThreads.emplace_back(std::move(newThread));
 	}
 
@@ -55,7 +55,7 @@ void ThreadedTaskPool::start(unsigned int threads)
 	}
 }
 
-void ThreadedTaskPool::workerThreadFunctionProcess()
+void ThreadedTaskPool::workerThreadFunctionProcess(unsigned int threadIndex)
 {
 	Task* pThisTask = nullptr;
 	
@@ -74,11 +74,11 @@ void ThreadedTaskPool::workerThreadFunctionProcess()
 			m_aTasks.pop();
 		}
 		
-		processTask(pThisTask);
+		processTask(pThisTask, threadIndex);
 	}
 }
 
-void ThreadedTaskPool::workerThreadFunctionEvent()
+void ThreadedTaskPool::workerThreadFunctionEvent(unsigned int threadIndex)
 {
 	Task* pThisTask = nullptr;
 	
@@ -92,6 +92,6 @@ void ThreadedTaskPool::workerThreadFunctionEvent()
 			m_aTasks.pop();
 		}
 		
-		processTask(pThisTask);
+		processTask(pThisTask, threadIndex);
 	}
 }
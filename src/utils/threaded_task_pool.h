@@ -49,16 +49,18 @@ protected:
 	
 	void start(unsigned int threads);
 	
-	// it's (currently) the subclass's job to delete the task object when finished
-	virtual void processTask(Task* pTask) = 0;	
+	// it's (currently) the subclass's job to delete the task object when finished.
+	// threadIndex is the index of the worker thread processing the task (from 0 to threads - 1), so
+	// subclasses can keep per-thread state.
+	virtual void processTask(Task* pTask, unsigned int threadIndex) = 0;
 	
-	void workerThreadFunctionProcess(); // just process what's in the list
-	void workerThreadFunctionEvent(); // continue.
+	void workerThreadFunctionProcess(unsigned int threadIndex); // just process what's in the list
+	void workerThreadFunctionEvent(unsigned int threadIndex); // continue.
 	
 protected:
 	std::vector<std::thread>		m_aWorkerThreads;
 	
-	volatile bool					m_active;
+	std::atomic<bool>				m_active;
 	
 	std::mutex						m_lock;
 	unsigned int					m_numThreads;